@@ -0,0 +1,106 @@
+#version 460 core
+layout (local_size_x = 64) in;
+
+struct DrawCommand
+{
+        uint count;
+        uint instance_count;
+        uint first;
+        uint base_instance;
+};
+
+// min, max per chunk in world units
+layout (std430, binding = 3) readonly buffer ChunkBounds
+{
+        vec4 bounds[];
+};
+// first vertex, vertex count per chunk
+layout (std430, binding = 4) readonly buffer DrawRanges
+{
+        uvec2 ranges[];
+};
+layout (std430, binding = 5) writeonly buffer DrawCommands
+{
+        DrawCommand commands[];
+};
+layout (std430, binding = 6) buffer DrawCount
+{
+        uint draw_count;
+};
+
+// farthest depth of every texel footprint, built from last frame's depth
+layout (binding = 0) uniform sampler2D hiz;
+
+uniform int chunk_count;
+uniform vec4 planes[6];
+uniform mat4 previous_view_projection;
+uniform int use_hiz;
+
+
+bool outside_frustum(vec3 lo, vec3 hi)
+{
+        for (int i = 0 ; i < 6 ; i++)
+        {
+                vec3 corner = mix(lo, hi, greaterThan(planes[i].xyz, vec3(0.0f)));
+                if (dot(planes[i].xyz, corner) + planes[i].w < 0.0f)
+                        return true;
+        }
+        return false;
+}
+
+
+// tested against the frame the pyramid was built from
+bool occluded(vec3 lo, vec3 hi)
+{
+        vec2 screen_min = vec2(1.0f), screen_max = vec2(0.0f);
+        float nearest = 1.0f;
+        for (int i = 0 ; i < 8 ; i++)
+        {
+                vec3 corner = vec3((i & 1) != 0 ? hi.x : lo.x, (i & 2) != 0 ? hi.y : lo.y, (i & 4) != 0 ? hi.z : lo.z);
+                vec4 clip = previous_view_projection * vec4(corner, 1.0f);
+                // crosses the camera plane, no meaningful footprint
+                if (clip.w <= 0.0f)
+                        return false;
+                vec3 ndc = clip.xyz / clip.w;
+                screen_min = min(screen_min, ndc.xy * 0.5f + 0.5f);
+                screen_max = max(screen_max, ndc.xy * 0.5f + 0.5f);
+                nearest = min(nearest, ndc.z * 0.5f + 0.5f);
+        }
+        screen_min = clamp(screen_min, vec2(0.0f), vec2(1.0f));
+        screen_max = clamp(screen_max, vec2(0.0f), vec2(1.0f));
+
+        // pick the level where the footprint covers at most 2x2 texels
+        vec2 extent = (screen_max - screen_min) * vec2(textureSize(hiz, 0));
+        int levels = textureQueryLevels(hiz);
+        int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0f)))), 0, levels-1);
+
+        ivec2 size = textureSize(hiz, level);
+        ivec2 a = clamp(ivec2(screen_min * vec2(size)), ivec2(0), size-1);
+        ivec2 b = clamp(ivec2(screen_max * vec2(size)), ivec2(0), size-1);
+        float farthest = max(max(texelFetch(hiz, a, level).r, texelFetch(hiz, ivec2(b.x, a.y), level).r),
+                             max(texelFetch(hiz, ivec2(a.x, b.y), level).r, texelFetch(hiz, b, level).r));
+
+        return nearest > farthest;
+}
+
+
+void main()
+{
+        uint chunk = gl_GlobalInvocationID.x;
+        if (chunk >= uint(chunk_count))
+                return;
+
+        uvec2 range = ranges[chunk];
+        if (range.y == 0u)
+                return;
+
+        vec3 lo = bounds[chunk*2].xyz;
+        vec3 hi = bounds[chunk*2+1].xyz;
+        if (outside_frustum(lo, hi))
+                return;
+        if (use_hiz != 0 && occluded(lo, hi))
+                return;
+
+        uint slot = atomicAdd(draw_count, 1u);
+        commands[slot] = DrawCommand(range.y, 1u, range.x, chunk);
+}
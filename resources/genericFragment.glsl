@@ -2,15 +2,30 @@
 in vec2 uv;
 out vec4 FragColor;
 
-#define SURFACE_DISTANCE 0.01
-
 uniform float TIME;
 uniform vec2 RESOLUTION;
-uniform sampler3D VOXELS;
+// material per voxel, 0 is air. level L is the chunk mip with 2^L voxels per cell
+uniform usampler3D VOXELS;
+// the chunk index, one texel per chunk: 1 when every voxel of the chunk is air
+uniform usampler3D CHUNK_TAGS;
+// nested windows around the camera, level L is mip L of VOXELS addressed toroidally and stacked along z
+// (see clipmap.h). clipmap_origin is each window's first cell, VOXELS is read beyond the last
+uniform usampler3D CLIPMAP;
+uniform ivec3 clipmap_origin[4];
+uniform int use_clipmap;
+// chunk sized bricks with their mips, slots numbered x fastest over atlas_slots, and a page per chunk:
+// 0 for air, 0x8000 | material for a uniform chunk, 0xffff when it has no brick, else its slot + 1
+// (see brick_atlas.h)
+uniform usampler3D ATLAS;
+uniform usampler3D PAGES;
+uniform ivec3 atlas_slots;
+uniform int use_atlas;
+uniform ivec3 world_size;
+uniform float voxel_size;
 uniform float yaw;
 uniform float pitch;
 uniform float roll;
-uniform vec3 camera_forward;
+uniform vec3 camera_front;
 uniform vec3 camera_up;
 uniform vec3 camera_right;
 uniform vec3 camera_position;
@@ -35,63 +50,112 @@ mat2 rotate_2d(float angle)
 }
 
 
-float sdf_sphere(vec3 position, float size)
-{
-        return length(position) - size;
-}
+// one level per factor of two of the ray cone footprint, capped by the chunk mip chain
+#define MAX_LOD 6
+#define MAX_STEPS 512
+#define CHUNK_SHIFT 6
+#define CHUNK_TAG_EMPTY 1u
+#define CLIPMAP_LEVELS 4
+#define CLIPMAP_SIZE 128
+#define BRICK_PAGE_EMPTY 0u
+#define BRICK_PAGE_UNIFORM 0x8000u
+#define BRICK_PAGE_MISSING 0xffffu
 
+const vec3 palette[4] = vec3[4](
+        vec3(1.0f, 0.0f, 1.0f),
+        vec3(0.35f, 0.65f, 0.25f),
+        vec3(0.45f, 0.32f, 0.2f),
+        vec3(0.5f, 0.5f, 0.52f)
+);
 
-/*float sdf_texture()
-{
-        return length(position);
-}*/
-
-
-float map(vec3 position)
-{
-        // TODO add voxel sdf function or something
-        float sphere = sdf_sphere(position, 1.0f);
-        
-        return min(position.y + 0.75, sphere);
-}
 
-float ray_march(vec3 ray_origin, vec3 ray_direction)
+// finest clipmap level at or above lod whose window holds voxel, -1 if none does
+int clipmap_level(ivec3 voxel, int lod)
 {
-        float total_distance = 0.0f;
-        for(int i = 0; i < 200 ; i++)
+        for (int level = lod ; level < CLIPMAP_LEVELS ; level++)
         {
-                vec3 position = ray_origin + ray_direction * total_distance;
-        
-                float distance = map(position);
-        
-                total_distance += distance;
-        
-                // stop the ray steps from getting too small and the total distance from too far
-                if (distance < 0.001f || total_distance > far ) break;
+                ivec3 local = (voxel >> level) - clipmap_origin[level];
+                if (all(greaterThanEqual(local, ivec3(0))) && all(lessThan(local, ivec3(CLIPMAP_SIZE))))
+                        return level;
         }
-        return total_distance;
+        return -1;
 }
 
-vec3 get_normal(vec3 position)
+
+// material of the lod cell holding voxel, through the page table. false when the chunk has no brick
+bool atlas_fetch(ivec3 voxel, int lod, out uint material)
 {
-        float distance = map(position);
-        vec3 normal = distance - vec3(
-                map(position-vec3(0.01f,0.0f,0.0f)),
-                map(position-vec3(0.0f,0.01f,0.0f)),
-                map(position-vec3(0.0f,0.0f,0.01f))
-        );
-        return normalize(normal);
+        uint page = texelFetch(PAGES, voxel >> CHUNK_SHIFT, 0).r;
+        material = page & 0xffu;
+        if (page == BRICK_PAGE_MISSING)
+                return false;
+        if (page == BRICK_PAGE_EMPTY || (page & BRICK_PAGE_UNIFORM) != 0u)
+                return true;
+
+        int slot = int(page) - 1;
+        ivec3 brick = ivec3(slot % atlas_slots.x, (slot / atlas_slots.x) % atlas_slots.y, slot / (atlas_slots.x * atlas_slots.y));
+        int size = 1 << (CHUNK_SHIFT - lod);
+        material = texelFetch(ATLAS, brick * size + ((voxel >> lod) & (size - 1)), lod).r;
+        return true;
 }
 
 
-float get_light(vec3 position)
+// steps cell by cell through the voxel texture in voxel units. the cell size follows the width of the
+// pixel cone at the current distance (cone_start + t) * pixel_angle, so far rays take big steps
+// through the coarse mips and the step count stays bounded by the view, not the distance
+bool trace(vec3 origin, vec3 direction, float pixel_angle, float cone_start, float max_distance,
+           out float t, out vec3 normal, out uint material)
 {
-        vec3 _light = normalize(light-position);
-        vec3 normal = get_normal(position);
-        float diffusion = clamp(dot(normal, _light), 0.0f, 1.0f);
-        float distance = ray_march(position+normal*SURFACE_DISTANCE*2.0f, _light);
-        if (distance < length(light-position)) diffusion *= 0.1;
-        return diffusion;
+        vec3 inverse = 1.0f / direction;
+        vec3 t0 = -origin * inverse;
+        vec3 t1 = (vec3(world_size) - origin) * inverse;
+        vec3 t_near = min(t0, t1), t_far = max(t0, t1);
+        float enter = max(max(t_near.x, t_near.y), t_near.z);
+        float leave = min(min(min(t_far.x, t_far.y), t_far.z), max_distance);
+        if (enter > leave || leave < 0.0f)
+                return false;
+
+        t = max(enter, 0.0f);
+        int axis = t_near.x == enter ? 0 : t_near.y == enter ? 1 : 2;
+        normal = vec3(0.0f);
+        normal[axis] = -sign(direction[axis]);
+
+        vec3 step_side = step(vec3(0.0f), direction);
+        for (int i = 0 ; i < MAX_STEPS && t < leave ; i++)
+        {
+                float footprint = (cone_start + t) * pixel_angle;
+                int lod = clamp(int(floor(log2(max(footprint, 1.0f)))), 0, MAX_LOD);
+
+                // nudged into the cell the ray is entering so a boundary never picks the previous one
+                vec3 position = clamp(origin + direction * (t + 0.001f), vec3(0.0f), vec3(world_size) - 0.001f);
+                ivec3 voxel = ivec3(floor(position));
+
+                // an empty chunk is crossed in one step, without reading its voxels
+                bool empty = texelFetch(CHUNK_TAGS, voxel >> CHUNK_SHIFT, 0).r == CHUNK_TAG_EMPTY;
+                int level = use_clipmap != 0 && !empty ? clipmap_level(voxel, lod) : -1;
+                if (empty)
+                        lod = CHUNK_SHIFT;
+                else if (level >= 0)
+                        lod = level;
+                float cell_size = float(1 << lod);
+                ivec3 cell = voxel >> lod;
+
+                if (empty)
+                        material = 0u;
+                else if (level >= 0)
+                        material = texelFetch(CLIPMAP, (cell & (CLIPMAP_SIZE - 1)) + ivec3(0, 0, level * CLIPMAP_SIZE), 0).r;
+                else if (use_atlas == 0 || !atlas_fetch(voxel, lod, material))
+                        material = texelFetch(VOXELS, cell, lod).r;
+                if (material != 0u)
+                        return true;
+
+                vec3 exits = ((vec3(cell) + step_side) * cell_size - origin) * inverse;
+                t = min(min(exits.x, exits.y), exits.z);
+                axis = exits.x == t ? 0 : exits.y == t ? 1 : 2;
+                normal = vec3(0.0f);
+                normal[axis] = -sign(direction[axis]);
+        }
+        return false;
 }
 
 
@@ -100,26 +164,40 @@ void main()
         // Initialization
         vec2 UV = (gl_FragCoord.xy * 2.0 - RESOLUTION.xy) / RESOLUTION.y;
 
-        vec3 ray_origin = camera_position.zyx;
-        vec3 ray_direction = normalize(vec3(UV * fov, 1.0));
-        // apply pitch
-        ray_direction.zy *= rotate_2d(pitch);
-        // apply yaw
-        ray_direction.xz *= rotate_2d(-yaw);
-        vec3 color = vec3(0);
+        // same basis as the view matrix the rasterized renderers use
+        vec3 right = normalize(cross(camera_front, vec3(0.0f, 1.0f, 0.0f)));
+        vec3 up = cross(right, camera_front);
+        float tan_half_fov = tan(fov * 0.5f);
 
-        // Raymarching
-        float total_distance = ray_march(ray_origin, ray_direction);
-                
-        float diffuse_color = get_light(ray_origin + ray_direction * total_distance);
+        vec3 ray_origin = camera_position / voxel_size;
+        vec3 ray_direction = normalize(camera_front + (UV.x * right + UV.y * up) * tan_half_fov);
+        // width of one pixel per voxel of distance
+        float pixel_angle = 2.0f * tan_half_fov / RESOLUTION.y;
 
-        // DEPTH BUFFER?!!?!??!?
-        //color = vec3(total_distance * 0.2f);
+        vec3 sky = vec3(0.55f, 0.7f, 0.9f);
+        vec3 color = sky;
 
-        //normal buffer?
-        //color = get_normal(ray_origin+ray_direction*total_distance);
-
-        color = vec3(diffuse_color);
+        float distance;
+        vec3 normal;
+        uint material;
+        if (trace(ray_origin, ray_direction, pixel_angle, 0.0f, far / voxel_size, distance, normal, material))
+        {
+                vec3 position = ray_origin + ray_direction * distance;
+                vec3 _light = normalize(light / voxel_size - position);
+                float diffusion = clamp(dot(normal, _light), 0.0f, 1.0f);
+
+                // shadow ray continues the primary cone, it never needs finer cells than the pixel it lands in.
+                // it starts a pixel footprint off the surface so it leaves the coarse cell it was hit in
+                float shadow_distance;
+                vec3 shadow_normal;
+                uint shadow_material;
+                if (diffusion > 0.0f && trace(position + normal * max(distance * pixel_angle, 0.01f), _light, pixel_angle, distance,
+                                              length(light / voxel_size - position), shadow_distance, shadow_normal, shadow_material))
+                        diffusion *= 0.1;
+
+                color = palette[min(material, 3u)] * (0.35f + 0.65f * diffusion);
+                color = mix(color, sky, clamp(distance * voxel_size / far, 0.0f, 1.0f));
+        }
 
         FragColor = vec4(color, 1.0f);
 }
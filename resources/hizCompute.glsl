@@ -0,0 +1,35 @@
+#version 460 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// depth texture when building level 0, the pyramid itself after that
+layout (binding = 0) uniform sampler2D source;
+layout (r32f, binding = 0) uniform writeonly image2D destination;
+
+// -1 copies the depth buffer
+uniform int source_level;
+uniform ivec2 source_size;
+
+void main()
+{
+        ivec2 position = ivec2(gl_GlobalInvocationID.xy);
+        ivec2 size = imageSize(destination);
+        if (any(greaterThanEqual(position, size)))
+                return;
+
+        float depth = 0.0f;
+        if (source_level < 0)
+                depth = texelFetch(source, position, 0).r;
+        else
+        {
+                // odd sized levels fold their last row/column into the last texel so nothing is lost
+                ivec2 extent = ivec2(2) + ivec2(equal(position, size-1)) * (source_size & 1);
+                for (int y = 0 ; y < extent.y ; y++)
+                        for (int x = 0 ; x < extent.x ; x++)
+                        {
+                                ivec2 texel = min(position*2 + ivec2(x,y), source_size-1);
+                                depth = max(depth, texelFetch(source, texel, source_level).r);
+                        }
+        }
+
+        imageStore(destination, position, vec4(depth));
+}
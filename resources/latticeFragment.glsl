@@ -0,0 +1,102 @@
+#version 460 core
+in vec3 voxel_position;
+flat in vec3 normal;
+out vec4 FragColor;
+
+uniform usampler3D VOXELS;
+// 32 consecutive voxels along the axis per texel, see bitslab.h
+uniform usampler2D SLAB_X;
+uniform usampler2D SLAB_Y;
+uniform usampler2D SLAB_Z;
+uniform ivec3 world_size;
+// camera in voxels, chunks further than lod_distance are drawn from the mips of VOXELS
+uniform vec3 eye;
+uniform float lod_distance;
+
+#define CHUNK_SIZE 64
+#define MAX_LOD 6
+
+const vec3 palette[4] = vec3[4](
+        vec3(1.0f, 0.0f, 1.0f),
+        vec3(0.35f, 0.65f, 0.25f),
+        vec3(0.45f, 0.32f, 0.2f),
+        vec3(0.5f, 0.5f, 0.52f)
+);
+
+
+uint slab_word(int axis, ivec3 voxel)
+{
+        int u = voxel[(axis+1) % 3];
+        int v = voxel[(axis+2) % 3];
+        ivec2 texel = ivec2(u + (voxel[axis] >> 5) * world_size[(axis+1) % 3], v);
+        if (axis == 0)
+                return texelFetch(SLAB_X, texel, 0).r;
+        if (axis == 1)
+                return texelFetch(SLAB_Y, texel, 0).r;
+        return texelFetch(SLAB_Z, texel, 0).r;
+}
+
+
+// same as lod_from_distance in lod.cpp, measured to the nearest point of the chunk
+int chunk_lod(ivec3 voxel)
+{
+        vec3 chunk_min = vec3((voxel >> 6) * CHUNK_SIZE);
+        float distance = length(max(max(chunk_min - eye, eye - chunk_min - float(CHUNK_SIZE)), 0.0f));
+        if (distance < lod_distance)
+                return 0;
+        return min(int(floor(log2(distance / lod_distance))) + 1, MAX_LOD);
+}
+
+
+// coarse faces only exist on planes that are multiples of the cell size
+bool lod_face(int lod, int axis, ivec3 behind, ivec3 front, out uint material)
+{
+        int plane = max(behind[axis], front[axis]);
+        material = 0u;
+        if ((plane & ((1 << lod) - 1)) != 0)
+                return false;
+
+        material = texelFetch(VOXELS, behind >> lod, lod).r;
+        if (material == 0u)
+                return false;
+        if (front[axis] >= 0 && front[axis] < world_size[axis])
+                return texelFetch(VOXELS, front >> lod, lod).r == 0u;
+        return true;
+}
+
+
+void main()
+{
+        // a face exists where the voxel behind the slice is solid and the one in front is air
+        ivec3 behind = ivec3(floor(voxel_position - normal * 0.5f));
+        ivec3 front = ivec3(floor(voxel_position + normal * 0.5f));
+        int axis = normal.x != 0.0f ? 0 : normal.y != 0.0f ? 1 : 2;
+
+        vec3 sun = normalize(vec3(0.4f, 1.0f, 0.3f));
+        float diffuse = 0.35f + 0.65f * clamp(dot(normal, sun), 0.0f, 1.0f);
+
+        int lod = chunk_lod(behind);
+        if (lod > 0)
+        {
+                uint coarse;
+                if (!lod_face(lod, axis, behind, front, coarse))
+                        discard;
+                FragColor = vec4(palette[min(coarse, 3u)] * diffuse, 1.0f);
+                return;
+        }
+
+        // both cells sit in the same word unless the face lies on a 32 voxel boundary
+        uint word = slab_word(axis, behind);
+        if (((word >> (behind[axis] & 31)) & 1u) == 0u)
+                discard;
+        if (front[axis] >= 0 && front[axis] < world_size[axis])
+        {
+                uint front_word = (front[axis] >> 5) == (behind[axis] >> 5) ? word : slab_word(axis, front);
+                if (((front_word >> (front[axis] & 31)) & 1u) != 0u)
+                        discard;
+        }
+
+        uint material = texelFetch(VOXELS, behind, 0).r;
+
+        FragColor = vec4(palette[min(material, 3u)] * diffuse, 1.0f);
+}
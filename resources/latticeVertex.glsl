@@ -0,0 +1,23 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in uint aFace;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float voxel_size;
+
+out vec3 voxel_position;
+flat out vec3 normal;
+
+const vec3 normals[6] = vec3[6](
+        vec3( 1.0f, 0.0f, 0.0f), vec3(-1.0f, 0.0f, 0.0f),
+        vec3( 0.0f, 1.0f, 0.0f), vec3( 0.0f,-1.0f, 0.0f),
+        vec3( 0.0f, 0.0f, 1.0f), vec3( 0.0f, 0.0f,-1.0f)
+);
+
+void main()
+{
+        voxel_position = aPos;
+        normal = normals[aFace];
+        gl_Position = projection * view * vec4(aPos * voxel_size, 1.0f);
+}
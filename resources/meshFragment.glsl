@@ -0,0 +1,25 @@
+#version 460 core
+in vec3 voxel_position;
+flat in vec3 normal;
+out vec4 FragColor;
+
+uniform usampler3D VOXELS;
+
+const vec3 palette[4] = vec3[4](
+        vec3(1.0f, 0.0f, 1.0f),
+        vec3(0.35f, 0.65f, 0.25f),
+        vec3(0.45f, 0.32f, 0.2f),
+        vec3(0.5f, 0.5f, 0.52f)
+);
+
+void main()
+{
+        // the voxel owning this face sits half a voxel behind it
+        ivec3 voxel = ivec3(floor(voxel_position - normal * 0.5f));
+        uint material = texelFetch(VOXELS, voxel, 0).r;
+
+        vec3 sun = normalize(vec3(0.4f, 1.0f, 0.3f));
+        float diffuse = 0.35f + 0.65f * clamp(dot(normal, sun), 0.0f, 1.0f);
+
+        FragColor = vec4(palette[min(material, 3u)] * diffuse, 1.0f);
+}
@@ -0,0 +1,32 @@
+#version 460 core
+layout (location = 0) in uint packed_vertex;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float voxel_size;
+
+// indexed by gl_BaseInstance, set to the chunk index by every draw
+layout (std430, binding = 2) readonly buffer ChunkOrigins
+{
+        ivec4 chunk_origins[];
+};
+
+out vec3 voxel_position;
+flat out vec3 normal;
+
+const vec3 normals[6] = vec3[6](
+        vec3( 1.0f, 0.0f, 0.0f), vec3(-1.0f, 0.0f, 0.0f),
+        vec3( 0.0f, 1.0f, 0.0f), vec3( 0.0f,-1.0f, 0.0f),
+        vec3( 0.0f, 0.0f, 1.0f), vec3( 0.0f, 0.0f,-1.0f)
+);
+
+void main()
+{
+        // x 7 bits, y 7 bits, z 7 bits, face 3 bits
+        ivec3 local = ivec3(packed_vertex & 127u, (packed_vertex >> 7) & 127u, (packed_vertex >> 14) & 127u);
+        uint face = (packed_vertex >> 21) & 7u;
+
+        voxel_position = vec3(chunk_origins[gl_BaseInstance].xyz + local);
+        normal = normals[face];
+        gl_Position = projection * view * vec4(voxel_position * voxel_size, 1.0f);
+}
@@ -0,0 +1,1464 @@
+// cpu benchmark suite, run from the repository root: ./build/RMD_bench [filter]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "bitslab.h"
+#include "brick_atlas.h"
+#include "brush.h"
+#include "chunk.h"
+#include "chunk_cache.h"
+#include "chunk_image.h"
+#include "chunk_map.h"
+#include "clipmap.h"
+#include "dedup.h"
+#include "edit_queue.h"
+#include "frustum.h"
+#include "generator_cache.h"
+#include "journal.h"
+#include "lod.h"
+#include "mesher.h"
+#include "ray_batch.h"
+#include "raycast.h"
+#include "region_reader.h"
+#include "rle.h"
+#include "save.h"
+#include "slot_pool.h"
+#include "snapshot.h"
+
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
+
+const char* bench_filter = NULL;
+
+// keeps results alive so the optimizer can't drop the work
+volatile uint64_t bench_sink;
+
+
+// runs the function until at least half a second has passed and prints the time per iteration.
+// bytes is how much data one iteration touches, 0 skips the bandwidth column. returns ns per iteration, 0 if filtered
+template <typename F>
+double bench(const char* name, size_t bytes, F function)
+{
+        if (bench_filter && strstr(name, bench_filter) == NULL)
+                return 0.0;
+
+        function();
+
+        long long iterations = 0;
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+        while (elapsed < 0.5)
+        {
+                function();
+                iterations++;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        double ns = elapsed * 1e9 / iterations;
+        if (bytes)
+                printf("%-32s %12.1f ns/op %10.1f MB/s\n", name, ns, bytes / ns * 1e3);
+        else
+                printf("%-32s %12.1f ns/op\n", name, ns);
+        return ns;
+}
+
+
+void bench_bitslab(World* world)
+{
+        Chunk* chunk = world->chunks[0];
+        static uint32_t slab[BITSLAB_CHUNK_TEXELS];
+        static uint64_t columns[CHUNK_COLUMNS];
+        static const char* pack_names[3] = { "bitslab pack x", "bitslab pack y", "bitslab pack z" };
+        static const char* unpack_names[3] = { "bitslab unpack x", "bitslab unpack y", "bitslab unpack z" };
+
+        for (int axis = 0 ; axis < 3 ; axis++)
+        {
+                bench(pack_names[axis], sizeof(chunk->occupancy), [&]{
+                        bitslab_pack_chunk(chunk->occupancy, axis, slab);
+                        bench_sink += slab[axis];
+                });
+                bench(unpack_names[axis], sizeof(chunk->occupancy), [&]{
+                        bitslab_unpack_chunk(slab, axis, columns);
+                        bench_sink += columns[axis];
+                });
+        }
+
+        uint64_t matrix[64];
+        memcpy(matrix, chunk->occupancy, sizeof(matrix));
+        bench("bitslab transpose64", sizeof(matrix), [&]{
+                bitslab_transpose64(matrix);
+                bench_sink += matrix[0];
+        });
+}
+
+
+void bench_mesher(World* world)
+{
+        std::vector<uint32_t> vertices;
+        vertices.reserve(1 << 20);
+        bench("greedy mesh chunk", sizeof(Chunk::occupancy), [&]{
+                vertices.clear();
+                bench_sink += mesh_chunk(world, 0, &vertices, NULL);
+        });
+}
+
+
+void bench_lod(World* world)
+{
+        Chunk* chunk = world->chunks[0];
+        bench("chunk mips", sizeof(Chunk::occupancy) + CHUNK_VOLUME, [&]{
+                chunk_build_mips(chunk);
+                bench_sink += chunk->occupancy_mips[0];
+        });
+}
+
+
+// picks from above the terrain in random directions, the usual case for an edit cursor or a sightline
+void bench_raycast(World* world)
+{
+        const int count = 4096;
+        std::vector<glm::vec3> origins(count), directions(count);
+        glm::vec3 size = glm::vec3(world->width, world->height, world->depth) * (float)CHUNK_SIZE;
+        srand(42);
+        for (int i = 0 ; i < count ; i++)
+        {
+                origins[i] = glm::vec3(rand() / (float)RAND_MAX, 0.6f + 0.4f*rand() / (float)RAND_MAX, rand() / (float)RAND_MAX) * size;
+                directions[i] = glm::vec3(rand() / (float)RAND_MAX - 0.5f, -rand() / (float)RAND_MAX, rand() / (float)RAND_MAX - 0.5f);
+        }
+
+        RayHit hit;
+        double reference = bench("raycast reference x4096", 0, [&]{
+                for (int i = 0 ; i < count ; i++)
+                        bench_sink += raycast_reference(world, origins[i], directions[i], 512.0f, &hit);
+        });
+        double columns = bench("raycast x4096", 0, [&]{
+                for (int i = 0 ; i < count ; i++)
+                        bench_sink += raycast(world, origins[i], directions[i], 512.0f, &hit);
+        });
+        if (reference > 0.0)
+                printf("%-32s %12.2f Mrays/s\n", "raycast reference", count / reference * 1e3);
+        if (columns > 0.0)
+                printf("%-32s %12.2f Mrays/s\n", "raycast", count / columns * 1e3);
+}
+
+
+// sightlines between random points of the world, one batch per iteration
+void bench_ray_batch(World* world)
+{
+        const int count = 65536;
+        glm::vec3 size = glm::vec3(world->width, world->height, world->depth) * (float)CHUNK_SIZE;
+        RayBatch batch;
+        srand(7);
+        for (int i = 0 ; i < count ; i++)
+        {
+                glm::vec3 from = glm::vec3(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX) * size;
+                glm::vec3 to = glm::vec3(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX) * size;
+                ray_batch_add_segment(&batch, from, to);
+        }
+
+        JobPool pool;
+        job_pool_init(&pool, 0);
+
+        RayHit hit;
+        double single = bench("sightlines 64k raycast", 0, [&]{
+                for (const RayQuery& query : batch.rays)
+                        bench_sink += raycast(world, query.origin, query.direction, query.max_distance, &hit);
+        });
+        double packets = bench("sightlines 64k batch", 0, [&]{
+                ray_batch_trace(&batch, world, NULL);
+                bench_sink += batch.hits[0];
+        });
+        double threaded = bench("sightlines 64k batch threads", 0, [&]{
+                ray_batch_trace(&batch, world, &pool);
+                bench_sink += batch.hits[0];
+        });
+        if (single > 0.0)
+                printf("%-32s %12.2f Mrays/s\n", "sightlines raycast", count / single * 1e3);
+        if (packets > 0.0)
+                printf("%-32s %12.2f Mrays/s\n", "sightlines batch", count / packets * 1e3);
+        if (threaded > 0.0)
+                printf("%-32s %12.2f Mrays/s (%zu workers)\n", "sightlines batch threads", count / threaded * 1e3, pool.workers.size());
+
+        job_pool_destroy(&pool);
+}
+
+
+// chunks whose occupancy bits aren't exactly their non air voxels
+static int occupancy_mismatches(const World* world)
+{
+        static uint8_t scratch[CHUNK_VOLUME];
+        int mismatched = 0;
+        for (int i = 0 ; i < world_chunk_count(world) ; i++)
+        {
+                const Chunk* chunk = world->chunks[i];
+                if (chunk == NULL)
+                        continue;
+                const uint8_t* material = chunk_material_read(chunk, scratch);
+                bool same = true;
+                for (int z = 0 ; z < CHUNK_SIZE ; z++)
+                for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                {
+                        uint64_t bits = 0;
+                        for (int y = 0 ; y < CHUNK_SIZE ; y++)
+                                bits |= (uint64_t)(material[chunk_voxel_index(x,y,z)] != 0) << y;
+                        same = same && bits == chunk->occupancy[chunk_column_index(x,z)];
+                }
+                mismatched += !same;
+        }
+        return mismatched;
+}
+
+
+// carves a radius 64 sphere out of the middle of the world and fills it back in, voxel by voxel through
+// world_set and as one brush, then checks adding and painting kept occupancy equal to the material.
+// leaves the world edited, so it runs after everything that reads it. -1 when the check fails
+int bench_brush(World* world)
+{
+        glm::vec3 center = glm::vec3(world->width, world->height, world->depth) * (CHUNK_SIZE*0.5f);
+        const float radius = 64.0f;
+
+        glm::ivec3 lo = glm::ivec3(center - radius), hi = glm::ivec3(center + radius);
+        auto sphere = [&](uint8_t material){
+                for (int z = lo.z ; z < hi.z ; z++)
+                for (int y = lo.y ; y < hi.y ; y++)
+                for (int x = lo.x ; x < hi.x ; x++)
+                {
+                        glm::vec3 d = glm::vec3(x,y,z) + 0.5f - center;
+                        if (glm::dot(d,d) <= radius*radius)
+                                world_set(world, glm::ivec3(x,y,z), material);
+                }
+        };
+        double voxels = bench("brush sphere r64 world_set", 0, [&]{
+                sphere(0);
+                sphere(3);
+        });
+
+        Brush brush = {};
+        brush.shape = BRUSH_SPHERE;
+        brush.center = center;
+        brush.extent = glm::vec3(radius);
+        brush.material = 3;
+        BrushResult result;
+        double masks = bench("brush sphere r64", 0, [&]{
+                brush.op = BRUSH_SUBTRACT;
+                bench_sink += brush_apply(world, &brush, &result);
+                brush.op = BRUSH_ADD;
+                bench_sink += brush_apply(world, &brush, &result);
+        });
+        if (voxels > 0.0 && masks > 0.0)
+                printf("%-32s %12.1fx (%d voxels, %zu boxes)\n", "brush speedup", voxels / masks, result.voxels, result.dirty.size());
+        if (masks == 0.0)
+                return 0;
+
+        // a smaller sphere painted over the filled one, then material 0, which has to be refused
+        brush.op = BRUSH_PAINT;
+        brush.extent = glm::vec3(radius*0.5f);
+        brush.material = 5;
+        brush_apply(world, &brush, &result);
+        brush.material = 0;
+        int refused = brush_apply(world, &brush, &result) < 0;
+        brush.op = BRUSH_ADD;
+        refused += brush_apply(world, &brush, &result) < 0;
+        int mismatched = occupancy_mismatches(world);
+        if (refused != 2 || mismatched)
+        {
+                printf("brush: %d of 2 material 0 edits refused, occupancy wrong in %d chunks\n", refused, mismatched);
+                return -1;
+        }
+        return 0;
+}
+
+
+// three producer threads push edits as fast as they can while this thread drains them,
+// a full ring makes a producer retry like a network or script thread would next tick
+void bench_edit_queue()
+{
+        const int producers = 3, per_producer = 16384;
+        static EditQueue queue;
+        edit_queue_init(&queue);
+
+        long long received = 0;
+        double ns = bench("edit queue 3 producers 48k", 0, [&]{
+                std::vector<std::thread> threads;
+                for (int p = 0 ; p < producers ; p++)
+                        threads.push_back(std::thread([p]{
+                                Brush brush = {};
+                                brush.material = (uint8_t)p;
+                                for (int i = 0 ; i < per_producer ; i++)
+                                {
+                                        brush.center.x = (float)i;
+                                        while (!edit_queue_push(&queue, &brush))
+                                                std::this_thread::yield();
+                                }
+                        }));
+
+                Brush brush;
+                for (int popped = 0 ; popped < producers*per_producer ; )
+                {
+                        if (edit_queue_pop(&queue, &brush))
+                        {
+                                popped++;
+                                received++;
+                        }
+                        else
+                                std::this_thread::yield();
+                }
+                for (std::thread& thread : threads)
+                        thread.join();
+        });
+        if (ns > 0.0)
+                printf("%-32s %12.1f ns/edit (%lld received, %d rejected pushes)\n", "edit queue", ns / (producers*per_producer),
+                       received, queue.rejected.load());
+}
+
+
+// a reader thread keeps raycasting through snapshots while this thread edits and publishes,
+// neither side waits for the other
+void bench_snapshot(World* world)
+{
+        ChunkStore store;
+        if (chunk_store_init(&store, world) != 0)
+                return;
+
+        std::atomic<bool> reading(true);
+        std::atomic<long long> rays(0);
+        std::thread reader([&]{
+                int slot = snapshot_reader_register(&store);
+                RayHit hit;
+                glm::vec3 size = glm::vec3(world->width, world->height, world->depth) * (float)CHUNK_SIZE;
+                while (reading)
+                {
+                        const WorldSnapshot* snapshot = snapshot_acquire(&store, slot);
+                        for (int i = 0 ; i < 64 ; i++)
+                                bench_sink += raycast(&snapshot->world, size*glm::vec3(0.5f, 0.9f, 0.5f),
+                                                      glm::vec3(i % 8 - 3.5f, -4.0f, i / 8 - 3.5f), 512.0f, &hit);
+                        snapshot_release(&store, slot);
+                        rays += 64;
+                }
+        });
+
+        Brush brush = {};
+        brush.shape = BRUSH_SPHERE;
+        brush.extent = glm::vec3(8.0f);
+        brush.material = 3;
+        BrushResult result;
+        int edits = 0, copied = 0, reclaimed = 0;
+        srand(3);
+        auto start = std::chrono::steady_clock::now();
+        double ns = bench("snapshot edit + publish", 0, [&]{
+                brush.center = glm::vec3(rand() % (world->width*CHUNK_SIZE), rand() % (world->height*CHUNK_SIZE), rand() % (world->depth*CHUNK_SIZE));
+                brush.op = edits++ % 2 ? BRUSH_ADD : BRUSH_SUBTRACT;
+                brush_apply(world, &brush, &result);
+                copied += store.chunks_copied;
+                chunk_store_publish(&store, world);
+                reclaimed += store.reclaimed;
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        reading = false;
+        reader.join();
+        if (ns > 0.0)
+                printf("%-32s %12.2f Mrays/s while editing (%d chunks copied, %d freed, %zu waiting)\n", "snapshot reader",
+                       rays / seconds * 1e-6, copied, reclaimed, store.retired.size());
+        chunk_store_destroy(&store, world);
+}
+
+
+// decoding a terrain chunk, then streams cut short, bit flipped or made up: none of them may be read
+// past its end or write past the chunk (run it under -fsanitize=address to see that), and the made up
+// ones have to be refused. returns -1 when a check fails
+int bench_rle(World* world)
+{
+        std::vector<uint8_t> scratch(CHUNK_VOLUME), raw(CHUNK_VOLUME);
+        const uint8_t* material = chunk_material_read(world->chunks[0], scratch.data());
+        std::vector<uint8_t> stream;
+        rle_encode(stream, material, CHUNK_VOLUME);
+        bench("rle decode chunk", CHUNK_VOLUME, [&]{
+                memset(raw.data(), 0, CHUNK_VOLUME);
+                bench_sink += rle_decode(stream.data(), stream.data() + stream.size(), raw.data(), CHUNK_VOLUME);
+        });
+        if (bench_filter && strstr("rle decode chunk", bench_filter) == NULL)
+                return 0;
+
+        int failed = 0;
+        memset(raw.data(), 0, CHUNK_VOLUME);
+        failed += !rle_decode(stream.data(), stream.data() + stream.size(), raw.data(), CHUNK_VOLUME)
+                  || memcmp(raw.data(), material, CHUNK_VOLUME) != 0;
+
+        // every cut, and a flipped bit in every byte of the first 4KB. copied so the end is the allocation's
+        int refused = 0, tries = 0;
+        for (size_t cut = 0 ; cut < stream.size() ; cut += 1 + cut/64, tries++)
+        {
+                std::vector<uint8_t> cut_stream(stream.begin(), stream.begin() + cut);
+                memset(raw.data(), 0, CHUNK_VOLUME);
+                refused += !rle_decode(cut_stream.data(), cut_stream.data() + cut_stream.size(), raw.data(), CHUNK_VOLUME);
+        }
+        std::vector<uint8_t> flipped = stream;
+        for (size_t i = 0 ; i < flipped.size() && i < 4096 ; i++, tries++)
+        {
+                flipped[i] ^= 1 << (i % 8);
+                memset(raw.data(), 0, CHUNK_VOLUME);
+                refused += !rle_decode(flipped.data(), flipped.data() + flipped.size(), raw.data(), CHUNK_VOLUME);
+                flipped[i] ^= 1 << (i % 8);
+        }
+
+        // a varint longer than 64 bits, one that never ends, and runs that wrap size_t
+        std::vector<uint8_t> made_up[3];
+        made_up[0].assign(11, 0xff);
+        made_up[0].push_back(0x01);
+        made_up[1].assign(3, 0x80);
+        rle_put_varint(made_up[2], 16);
+        rle_put_varint(made_up[2], 1);
+        made_up[2].push_back(7);
+        rle_put_varint(made_up[2], SIZE_MAX - 8);
+        rle_put_varint(made_up[2], 1);
+        made_up[2].push_back(7);
+        int accepted = 0;
+        for (std::vector<uint8_t>& bad : made_up)
+        {
+                memset(raw.data(), 0, CHUNK_VOLUME);
+                accepted += rle_decode(bad.data(), bad.data() + bad.size(), raw.data(), CHUNK_VOLUME);
+        }
+
+        printf("%-32s %12d of %d damaged streams refused, %d of 3 made up ones accepted\n", "rle decode damaged", refused, tries, accepted);
+        if (failed || accepted)
+        {
+                printf("rle decode %s\n", failed ? "doesn't give the chunk back" : "accepted a stream it should have refused");
+                return -1;
+        }
+        return 0;
+}
+
+
+// what recording undo costs a radius 32 brush, and undoing it again. edits a world of its own, the
+// subtract and add pairs don't put back the material the terrain had. then a journal that spills every
+// step, with undos cut off by new steps and the oldest steps forgotten: the spilled figure has to match
+// the steps still held and the spill file has to reuse what was dropped. -1 when it doesn't
+int bench_journal()
+{
+        World own = {};
+        Journal journal;
+        if (world_create(&own, 2, 2, 2, 1337) != 0)
+                return 0;
+        if (journal_init(&journal, JOURNAL_MEMORY_BUDGET) != 0)
+        {
+                world_destroy(&own);
+                return 0;
+        }
+        World* world = &own;
+
+        Brush brush = {};
+        brush.shape = BRUSH_SPHERE;
+        brush.center = glm::vec3(world->width, world->height, world->depth) * (CHUNK_SIZE*0.5f) + 0.25f;
+        brush.extent = glm::vec3(32.0f);
+        brush.op = BRUSH_SUBTRACT;
+        brush.material = 3;
+        BrushResult result;
+        bench("journal brush r32 untracked", 0, [&]{
+                brush.op = BRUSH_SUBTRACT;
+                bench_sink += brush_apply(world, &brush, &result);
+                brush.op = BRUSH_ADD;
+                bench_sink += brush_apply(world, &brush, &result);
+        });
+
+        world->journal = &journal;
+        double recorded = bench("journal brush r32 recorded", 0, [&]{
+                brush.op = BRUSH_SUBTRACT;
+                bench_sink += brush_apply(world, &brush, &result);
+                brush.op = BRUSH_ADD;
+                bench_sink += brush_apply(world, &brush, &result);
+        });
+        bench("journal undo + redo r32", 0, [&]{
+                bench_sink += journal_undo(&journal, world);
+                bench_sink += journal_redo(&journal, world);
+        });
+        if (recorded > 0.0)
+                printf("%-32s %12.1f%% of raw (%zu steps, %zuKB in memory, %zuKB spilled)\n", "journal deltas",
+                       100.0 * journal.encoded_bytes / journal.raw_bytes, journal.entries.size(),
+                       journal.memory_bytes/1024, journal.spilled_bytes/1024);
+        world->journal = NULL;
+        journal_destroy(&journal);
+
+        int failed = 0;
+        bool spill = !bench_filter || strstr("journal spill", bench_filter);
+        if (spill && journal_init(&journal, 0) == 0)
+        {
+                if (journal.spill == NULL)
+                {
+                        journal_destroy(&journal);
+                        world_destroy(&own);
+                        return 0;
+                }
+                world->journal = &journal;
+                brush.extent = glm::vec3(8.0f);
+                size_t peak = 0, wrong = 0;
+                srand(13);
+                for (int step = 0 ; step < 6*JOURNAL_MAX_ENTRIES ; step++)
+                {
+                        brush.center = glm::vec3(rand() % (world->width*CHUNK_SIZE), rand() % (world->height*CHUNK_SIZE), rand() % (world->depth*CHUNK_SIZE));
+                        brush.op = step % 2 ? BRUSH_ADD : BRUSH_SUBTRACT;
+                        brush_apply(world, &brush, &result);
+                        if (step % 16 == 15)
+                                for (int undo = 0 ; undo < 8 ; undo++)
+                                        journal_undo(&journal, world);
+
+                        size_t spilled = 0, pages = 0;
+                        for (const JournalEntry& entry : journal.entries)
+                        {
+                                spilled += entry.data ? 0 : entry.size;
+                                pages += entry.data ? 0 : (entry.size + JOURNAL_SPILL_PAGE - 1) / JOURNAL_SPILL_PAGE;
+                        }
+                        wrong += spilled != journal.spilled_bytes;
+                        peak = std::max(peak, pages*JOURNAL_SPILL_PAGE);
+                }
+                fseek(journal.spill, 0, SEEK_END);
+                size_t file = ftell(journal.spill);
+                // first fit over pages, growing by doubling: within twice the most pages ever held
+                size_t bound = 2*peak;
+                printf("%-32s %12zuKB file for %zuKB held at most, %zuKB held now\n", "journal spill",
+                       file/1024, peak/1024, journal.spilled_bytes/1024);
+                if (wrong || file > bound)
+                {
+                        printf("journal spill: %zu steps with the wrong spilled figure, file %zuKB past %zuKB\n", wrong, file/1024, bound/1024);
+                        failed++;
+                }
+                world->journal = NULL;
+                journal_destroy(&journal);
+        }
+        world_destroy(&own);
+        return failed ? -1 : 0;
+}
+
+
+// frames of brush edits logged to a save in /tmp, then the save is loaded into a fresh world and compared.
+// the world comes in already edited, those edits have to reach the save too. -1 when the reload differs
+int bench_save(World* world)
+{
+        char directory[] = "/tmp/rmd_save_XXXXXX";
+        if (mkdtemp(directory) == NULL)
+                return 0;
+
+        ChunkStore store;
+        SaveWorker saver;
+        if (save_open(&saver, directory, world, &store, SAVE_FORMAT_COMPRESSED, NULL) != 0 || chunk_store_init(&store, world) != 0)
+                return 0;
+
+        Brush brush = {};
+        brush.shape = BRUSH_SPHERE;
+        brush.extent = glm::vec3(6.0f);
+        brush.material = 2;
+        BrushResult result;
+        int frames = 0;
+        srand(11);
+        double ns = bench("save log frame", 0, [&]{
+                brush.center = glm::vec3(rand() % (world->width*CHUNK_SIZE), rand() % (world->height*CHUNK_SIZE), rand() % (world->depth*CHUNK_SIZE));
+                brush.op = frames++ % 2 ? BRUSH_ADD : BRUSH_SUBTRACT;
+                brush_apply(world, &brush, &result);
+                save_log_dirty(&saver, world);
+                // what the upload would do
+                for (int i = 0 ; i < world_chunk_count(world) ; i++)
+                        world->chunks[i]->dirty = false;
+                chunk_store_publish(&store, world);
+                save_checkpoint(&saver, frames % 64 == 0);
+        });
+        save_close(&saver);
+
+        SaveMetrics metrics;
+        save_metrics(&saver, &metrics);
+        if (ns > 0.0)
+                printf("%-32s %12.2f ms latency (max %.2f) %llu records %llu fsyncs %llu checkpoints %.1fx write amplification\n", "save",
+                       metrics.latency_milliseconds, metrics.latency_max_milliseconds, (unsigned long long)metrics.records,
+                       (unsigned long long)metrics.fsyncs, (unsigned long long)metrics.checkpoints, metrics.write_amplification);
+
+        World loaded = {};
+        SaveWorker reader;
+        ChunkStore unused;
+        int mismatched = -1;
+        if (world_create(&loaded, world->width, world->height, world->depth, world->seed) == 0
+         && save_open(&reader, directory, &loaded, &unused, SAVE_FORMAT_COMPRESSED, NULL) == 0)
+        {
+                mismatched = 0;
+                for (int i = 0 ; i < world_chunk_count(world) ; i++)
+                        mismatched += memcmp(world->chunks[i]->material, loaded.chunks[i]->material, CHUNK_VOLUME) != 0
+                                   || memcmp(world->chunks[i]->occupancy, loaded.chunks[i]->occupancy, sizeof(Chunk::occupancy)) != 0;
+                reader.logged = false;
+                save_close(&reader);
+        }
+        world_destroy(&loaded);
+        chunk_store_destroy(&store, world);
+        std::filesystem::remove_all(directory);
+        if (mismatched < 0)
+                printf("save: unable to reload the save\n");
+        else if (mismatched)
+                printf("save: reload mismatch in %d chunks\n", mismatched);
+        return mismatched ? -1 : 0;
+}
+
+
+// fnv-1a over a whole chunk image
+static uint64_t image_hash(const uint8_t* image)
+{
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0 ; i < CHUNK_IMAGE_BYTES ; i++)
+                hash = (hash ^ image[i]) * 0x100000001b3ull;
+        return hash;
+}
+
+
+// region files on disk for an 8x8x8 chunk world, copies of the bench world's region with their
+// coordinates patched, streamed back in batches after evicting them from the page cache. both formats
+// end up as upload ready chunk images: run length encoded regions are decoded and repacked, image
+// regions are read straight into place (a heap buffer stands in for the mapped staging buffer).
+// every image has to match the bench world and be the same whichever backend read it, -1 when not
+int bench_region_reader(World* world)
+{
+        if (bench_filter && strstr("region read", bench_filter) == NULL)
+                return 0;
+        int failed = 0;
+
+        glm::ivec3 regions = glm::ivec3(4, 4, 4);
+        std::vector<RegionRead> reads;
+        glm::ivec3 chunks = regions*SAVE_REGION_CHUNKS;
+        for (int z = 0 ; z < chunks.z ; z++)
+        for (int y = 0 ; y < chunks.y ; y++)
+        for (int x = 0 ; x < chunks.x ; x++)
+        {
+                RegionRead read = {};
+                read.chunk = glm::ivec3(x, y, z);
+                reads.push_back(read);
+        }
+
+        // a streaming sized batch, the destinations are reused between batches
+        const int batch = 64;
+        std::vector<uint8_t> images((size_t)batch*CHUNK_IMAGE_BYTES);
+        std::vector<Chunk*> scratch(batch);
+        for (int i = 0 ; i < batch ; i++)
+                scratch[i] = chunk_create(glm::ivec3(0));
+        JobPool pool;
+        job_pool_init(&pool, 0);
+
+        static const char* format_names[2] = { "rle", "image" };
+        for (int format = SAVE_FORMAT_COMPRESSED ; format <= SAVE_FORMAT_IMAGES ; format++)
+        {
+                // a hash of every image the first backend read, the others have to read the same
+                std::vector<uint64_t> hashes(reads.size(), 0);
+                bool hashed = false;
+                char directory[] = "/tmp/rmd_regions_XXXXXX";
+                if (mkdtemp(directory) == NULL)
+                        break;
+
+                // every chunk dirty once so the checkpoint writes them all out
+                ChunkStore store;
+                SaveWorker saver;
+                if (save_open(&saver, directory, world, &store, format, NULL) != 0 || chunk_store_init(&store, world) != 0)
+                        break;
+                for (int i = 0 ; i < world_chunk_count(world) ; i++)
+                        chunk_mark_dirty(world->chunks[i], {glm::ivec3(0), glm::ivec3(CHUNK_SIZE)});
+                save_log_dirty(&saver, world);
+                for (int i = 0 ; i < world_chunk_count(world) ; i++)
+                        world->chunks[i]->dirty = false;
+                chunk_store_publish(&store, world);
+                save_close(&saver);
+                chunk_store_destroy(&store, world);
+
+                char path[512];
+                save_region_path(directory, glm::ivec3(0), path, sizeof(path));
+                std::vector<uint8_t> region;
+                FILE* file = fopen(path, "rb");
+                if (file)
+                {
+                        fseek(file, 0, SEEK_END);
+                        region.resize(ftell(file));
+                        fseek(file, 0, SEEK_SET);
+                        if (fread(region.data(), 1, region.size(), file) != region.size())
+                                region.clear();
+                        fclose(file);
+                }
+                if (region.size() < sizeof(SaveRegionHeader))
+                {
+                        printf("no region file to read back\n");
+                        std::filesystem::remove_all(directory);
+                        failed++;
+                        break;
+                }
+
+                std::vector<std::string> paths;
+                for (int rz = 0 ; rz < regions.z ; rz++)
+                for (int ry = 0 ; ry < regions.y ; ry++)
+                for (int rx = 0 ; rx < regions.x ; rx++)
+                {
+                        SaveRegionHeader* header = (SaveRegionHeader*)region.data();
+                        header->x = rx;
+                        header->y = ry;
+                        header->z = rz;
+                        save_region_path(directory, glm::ivec3(rx, ry, rz), path, sizeof(path));
+                        file = fopen(path, "wb");
+                        if (file == NULL)
+                                continue;
+                        fwrite(region.data(), 1, region.size(), file);
+                        fflush(file);
+                        fsync(fileno(file));
+                        fclose(file);
+                        paths.push_back(path);
+                }
+                printf("%-32s %12.1f MB on disk\n", format == SAVE_FORMAT_IMAGES ? "region files image" : "region files rle",
+                       (double)region.size()*paths.size() / 1e6);
+
+                for (int backend = REGION_READER_URING ; backend <= REGION_READER_PREAD ; backend++)
+                for (int cold = 1 ; cold >= 0 ; cold--)
+                {
+                        RegionReader reader;
+                        if (region_reader_init(&reader, directory, &pool, backend) != 0)
+                                continue;
+                        if (reader.backend != backend)
+                        {
+                                region_reader_destroy(&reader);
+                                continue;
+                        }
+
+                        auto run = [&](int first, int count)
+                        {
+                                for (int i = 0 ; i < count ; i++)
+                                {
+                                        reads[first + i].material = format == SAVE_FORMAT_IMAGES ? NULL : scratch[i]->material;
+                                        reads[first + i].image = format == SAVE_FORMAT_IMAGES ? &images[(size_t)i*CHUNK_IMAGE_BYTES] : NULL;
+                                }
+                                int ok = region_reader_read(&reader, &reads[first], count);
+                                if (format == SAVE_FORMAT_IMAGES)
+                                        return ok;
+
+                                // what upload_dirty_chunks would still do: occupancy from the material, slabs and mips
+                                job_pool_parallel_for(&pool, count, 1, [&](int begin, int end)
+                                {
+                                        for (int i = begin ; i < end ; i++)
+                                        {
+                                                Chunk* chunk = scratch[i];
+                                                for (int z = 0 ; z < CHUNK_SIZE ; z++)
+                                                for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                                                {
+                                                        uint64_t bits = 0;
+                                                        for (int y = 0 ; y < CHUNK_SIZE ; y++)
+                                                                bits |= (uint64_t)(chunk->material[chunk_voxel_index(x,y,z)] != 0) << y;
+                                                        chunk->occupancy[chunk_column_index(x,z)] = bits;
+                                                }
+                                                chunk->version++;
+                                                chunk_image_pack(chunk, &images[(size_t)i*CHUNK_IMAGE_BYTES]);
+                                        }
+                                });
+                                return ok;
+                        };
+
+                        if (!cold)
+                        {
+                                // the first pass pulls everything into the page cache
+                                for (int first = 0 ; first < (int)reads.size() ; first += batch)
+                                        run(first, std::min(batch, (int)reads.size() - first));
+                                region_reader_forget(&reader);
+                        }
+                        else
+                                for (const std::string& name : paths)
+                                {
+                                        int fd = open(name.c_str(), O_RDONLY);
+                                        if (fd < 0)
+                                                continue;
+                                        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                                        close(fd);
+                                }
+                        reader.reads = reader.syscalls = reader.bytes = 0;
+
+                        int ok = 0, mismatched = 0, disagreed = 0;
+                        double seconds = 0.0;
+                        for (int first = 0 ; first < (int)reads.size() ; first += batch)
+                        {
+                                int count = std::min(batch, (int)reads.size() - first);
+                                auto start = std::chrono::steady_clock::now();
+                                ok += run(first, count);
+                                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                                // every region is a copy of the bench world's
+                                for (int i = 0 ; i < count ; i++)
+                                {
+                                        glm::ivec3 c = reads[first + i].chunk % SAVE_REGION_CHUNKS;
+                                        const Chunk* chunk = world->chunks[world_chunk_index(world, c.x, c.y, c.z)];
+                                        const uint8_t* image = &images[(size_t)i*CHUNK_IMAGE_BYTES];
+                                        if (reads[first + i].status != REGION_READ_OK)
+                                                continue;
+                                        mismatched += memcmp(chunk->material, image + CHUNK_IMAGE_TEXELS, CHUNK_VOLUME) != 0
+                                                   || memcmp(chunk->occupancy, image + CHUNK_IMAGE_OCCUPANCY, sizeof(chunk->occupancy)) != 0;
+                                        uint64_t hash = image_hash(image);
+                                        if (!hashed)
+                                                hashes[first + i] = hash;
+                                        disagreed += hash != hashes[first + i];
+                                }
+                        }
+                        hashed = true;
+                        if (ok != (int)reads.size() || mismatched || disagreed)
+                        {
+                                printf("region read %s %s: %d of %d chunks read, %d mismatched, %d differ from the first backend\n",
+                                       format_names[format], region_reader_backend_names[backend], ok, (int)reads.size(), mismatched, disagreed);
+                                failed++;
+                        }
+
+                        char name[64];
+                        snprintf(name, sizeof(name), "region read %s %s %s", format_names[format], region_reader_backend_names[backend], cold ? "cold" : "warm");
+                        printf("%-32s %12.0f chunks/s %10.1f MB/s %6.1f reads/syscall\n", name, ok / seconds,
+                               reader.bytes / seconds / 1e6, reader.syscalls ? (double)reader.reads / reader.syscalls : 0.0);
+                        region_reader_destroy(&reader);
+                }
+
+                // the reader doesn't check the region checksum, so a payload damaged in place has to come
+                // back as an error from the decoder instead of a read past the payload
+                save_region_path(directory, glm::ivec3(0), path, sizeof(path));
+                SaveRegionHeader* header = (SaveRegionHeader*)region.data();
+                file = format == SAVE_FORMAT_COMPRESSED && header->sizes[0] && header->sizes[1] ? fopen(path, "wb") : NULL;
+                if (file)
+                {
+                        header->x = header->y = header->z = 0;
+                        memset(&region[save_region_payload_offset(header->version)], 0xff, std::min<size_t>(header->sizes[0], 16));
+                        fwrite(region.data(), 1, region.size(), file);
+                        fclose(file);
+
+                        RegionReader reader;
+                        if (region_reader_init(&reader, directory, &pool, REGION_READER_PREAD) == 0)
+                        {
+                                RegionRead damaged[2] = {};
+                                damaged[0].chunk = glm::ivec3(0, 0, 0);
+                                damaged[0].material = scratch[0]->material;
+                                damaged[1].chunk = glm::ivec3(1, 0, 0);
+                                damaged[1].material = scratch[1]->material;
+                                region_reader_read(&reader, damaged, 2);
+                                if (damaged[0].status != REGION_READ_ERROR || damaged[1].status != REGION_READ_OK)
+                                {
+                                        printf("region read of a damaged payload: status %d, its neighbour %d\n", damaged[0].status, damaged[1].status);
+                                        failed++;
+                                }
+                                region_reader_destroy(&reader);
+                        }
+                }
+                std::filesystem::remove_all(directory);
+        }
+
+        job_pool_destroy(&pool);
+        for (Chunk* chunk : scratch)
+                chunk_destroy(chunk);
+        return failed ? -1 : 0;
+}
+
+
+void bench_generator()
+{
+        GeneratorCache cache;
+        generator_cache_init(&cache, 1337, GENERATOR_CACHE_CHUNKS);
+        Chunk* chunk = chunk_create(glm::ivec3(1, 0, 1));
+        bench("chunk generate", CHUNK_VOLUME, [&]{
+                chunk_generate(chunk, 1337);
+        });
+        bench("generator cache fill", CHUNK_VOLUME, [&]{
+                generator_cache_fill(&cache, chunk);
+        });
+        bench("generator cache matches", CHUNK_VOLUME, [&]{
+                bench_sink += generator_cache_matches(&cache, chunk);
+        });
+        chunk_destroy(chunk);
+        generator_cache_destroy(&cache);
+
+        if (bench_filter && strstr("save diffs", bench_filter) == NULL)
+                return;
+
+        // one small edit into a fresh world, checkpointed storing every chunk and only the edited ones
+        for (int diffs = 0 ; diffs <= 1 ; diffs++)
+        {
+                World world = {};
+                char directory[] = "/tmp/rmd_diffs_XXXXXX";
+                if (world_create(&world, 2, 2, 2, 1337) != 0 || mkdtemp(directory) == NULL)
+                        return;
+                generator_cache_init(&cache, world.seed, GENERATOR_CACHE_CHUNKS);
+                ChunkStore store;
+                SaveWorker saver;
+                if (save_open(&saver, directory, &world, &store, SAVE_FORMAT_COMPRESSED, diffs ? &cache : NULL) == 0
+                 && chunk_store_init(&store, &world) == 0)
+                {
+                        Brush brush = {};
+                        brush.shape = BRUSH_SPHERE;
+                        brush.op = BRUSH_SUBTRACT;
+                        brush.center = glm::vec3(20.0f, 40.0f, 20.0f);
+                        brush.extent = glm::vec3(6.0f);
+                        BrushResult result;
+                        brush_apply(&world, &brush, &result);
+                        save_log_dirty(&saver, &world);
+                        for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+                                world.chunks[i]->dirty = false;
+                        chunk_store_publish(&store, &world);
+                        save_close(&saver);
+
+                        SaveMetrics metrics;
+                        save_metrics(&saver, &metrics);
+                        printf("%-32s %12zu region bytes %4llu chunks stored %4llu generated\n", diffs ? "save diffs" : "save diffs off",
+                               metrics.region_bytes, (unsigned long long)metrics.chunks_written, (unsigned long long)metrics.chunks_generated);
+                        chunk_store_destroy(&store, &world);
+                }
+                generator_cache_destroy(&cache);
+                world_destroy(&world);
+                std::filesystem::remove_all(directory);
+        }
+}
+
+
+void bench_dedup()
+{
+        if (bench_filter && strstr("dedup", bench_filter) == NULL)
+                return;
+
+        // 8x4x8 chunks of terrain, the upper half is all air
+        World world = {};
+        if (world_create(&world, 8, 4, 8, 1337) != 0)
+                return;
+        size_t bytes = (size_t)world_chunk_count(&world)*CHUNK_VOLUME;
+        ChunkDedup dedup;
+        bench("dedup pass 256 chunks cold", bytes, [&]{
+                chunk_dedup_init(&dedup, &world);
+                chunk_dedup_world(&dedup, &world, true);
+        });
+        bench("dedup pass 256 chunks warm", 0, [&]{
+                chunk_dedup_world(&dedup, &world, true);
+        });
+        DedupStats stats = dedup.stats;
+        printf("%-32s %4d empty %4d solid %4d shared %8.1f MB material instead of %.1f MB, %.1f MB saved\n", "dedup", stats.empty,
+               stats.solid, stats.shared, stats.bytes_resident/1e6, stats.bytes_unshared/1e6, (stats.bytes_unshared - stats.bytes_resident)/1e6);
+
+        chunk_dedup_destroy(&dedup);
+        world_destroy(&world);
+}
+
+
+// a camera flying over 16x2x16 chunks of terrain with 24MB for resident and 1MB for packed chunks,
+// painting as it goes, then every chunk is compared against the same world kept fully resident. the
+// last lap has no visible list, as with gpu culling, and still has to evict. -1 when a check fails
+int bench_chunk_cache()
+{
+        if (bench_filter && strstr("chunk cache", bench_filter) == NULL)
+                return 0;
+
+        World world = {}, reference = {};
+        if (world_create(&world, 16, 2, 16, 1337) != 0 || world_create(&reference, 16, 2, 16, 1337) != 0)
+                return 0;
+        GeneratorCache generator;
+        generator_cache_init(&generator, world.seed, GENERATOR_CACHE_CHUNKS);
+        ChunkStore store;
+        chunk_store_init(&store, &world);
+        ChunkCache cache;
+        chunk_cache_init(&cache, &world, 24u << 20, 1u << 20, &generator);
+
+        Brush brush = {};
+        brush.shape = BRUSH_SPHERE;
+        brush.op = BRUSH_ADD;
+        brush.material = 2;
+        brush.extent = glm::vec3(8.0f);
+        BrushResult result;
+        VisibleChunks visible = {};
+        visible.indices.resize(world_chunk_count(&world));
+        double milliseconds = 0.0;
+        int frames = 0, evicted = 0, spilled = 0, restored = 0, by_distance = 0, peak_pages = 0;
+        for (int lap = 0 ; lap < 3 ; lap++)
+        for (int step = 0 ; step < 16*CHUNK_SIZE ; step += 8, frames++)
+        {
+                // a diagonal there, back and there again, seeing the chunks within four of it
+                float t = lap == 1 ? 16*CHUNK_SIZE - step : step;
+                glm::vec3 camera = glm::vec3(t, 80.0f, t*0.7f + 100.0f);
+                visible.count = 0;
+                for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+                {
+                        glm::vec3 d = (glm::vec3(world.chunks[i]->coord) + 0.5f) * (float)CHUNK_SIZE - camera;
+                        if (glm::length(glm::vec2(d.x, d.z)) < 4.0f*CHUNK_SIZE)
+                                visible.indices[visible.count++] = i;
+                }
+                if (step % 64 == 0)
+                {
+                        brush.center = camera - glm::vec3(0.0f, 30.0f, 0.0f);
+                        brush_apply(&world, &brush, &result);
+                        brush_apply(&reference, &brush, &result);
+                }
+                // what the upload would do
+                for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+                {
+                        Chunk* chunk = world.chunks[i];
+                        if (chunk->mips_version != chunk->version && chunk->material)
+                                chunk_build_mips(chunk);
+                        chunk->dirty = false;
+                }
+                chunk_cache_update(&cache, &world, camera, lap < 2 ? &visible : NULL);
+                chunk_store_publish(&store, &world);
+                milliseconds += cache.stats.milliseconds;
+                if (lap == 2)
+                        by_distance += cache.stats.evicted;
+                evicted += cache.stats.evicted;
+                spilled += cache.stats.spilled;
+                restored += cache.stats.restored;
+        }
+
+        // back and forth between the ends of the diagonal, both carved up, with room for the chunks used at one
+        // of them and nothing packed in memory: every trip the chunks left behind spill again, into the pages
+        // their last copy left
+        glm::vec3 ends[2] = {glm::vec3(0.0f, 80.0f, 100.0f), glm::vec3(16*CHUNK_SIZE, 80.0f, 16*CHUNK_SIZE*0.7f + 100.0f)};
+        brush.op = BRUSH_SUBTRACT;
+        brush.extent = glm::vec3(24.0f);
+        for (glm::vec3 end : ends)
+        for (int x = -3 ; x <= 3 ; x++)
+        for (int z = -3 ; z <= 3 ; z++)
+        {
+                brush.center = end + glm::vec3(x*CHUNK_SIZE/2, -50.0f, z*CHUNK_SIZE/2);
+                brush_apply(&world, &brush, &result);
+                brush_apply(&reference, &brush, &result);
+        }
+        for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+        {
+                Chunk* chunk = world.chunks[i];
+                if (chunk->mips_version != chunk->version && chunk->material)
+                        chunk_build_mips(chunk);
+                chunk->dirty = false;
+        }
+        cache.packed_budget = 0;
+        cache.ram_budget = 24*sizeof(ChunkMaterial);
+        int trips = 0;
+        for (int frame = 0 ; frame < 256 ; frame++)
+        {
+                glm::vec3 camera = ends[frame / 16 % 2];
+                trips += frame % 16 == 0;
+                visible.count = 0;
+                for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+                {
+                        glm::vec3 d = (glm::vec3(world.chunks[i]->coord) + 0.5f) * (float)CHUNK_SIZE - camera;
+                        if (glm::length(glm::vec2(d.x, d.z)) < 1.5f*CHUNK_SIZE)
+                                visible.indices[visible.count++] = i;
+                }
+                chunk_cache_update(&cache, &world, camera, &visible);
+                chunk_store_publish(&store, &world);
+                spilled += cache.stats.spilled;
+                int pages = 0;
+                for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+                {
+                        const ChunkMaterial* block = world.chunks[i]->material_block;
+                        if (block && block->tier == CHUNK_SPILLED)
+                                pages += (int)((block->size + CHUNK_CACHE_SPILL_PAGE - 1) / CHUNK_CACHE_SPILL_PAGE);
+                }
+                peak_pages = std::max(peak_pages, pages);
+        }
+        fseek(cache.spill, 0, SEEK_END);
+        long file = ftell(cache.spill);
+        // appending every spill would be many times that, reused pages keep it near the most spilled at once
+        bool spill_grew = file > 2L*peak_pages*CHUNK_CACHE_SPILL_PAGE;
+        size_t held = 0;
+        for (const ChunkMaterial* block : cache.spilled)
+                held += block->size;
+
+        std::vector<uint8_t> scratch(CHUNK_VOLUME);
+        int mismatched = 0;
+        for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+                mismatched += memcmp(chunk_material_read(world.chunks[i], scratch.data()), reference.chunks[i]->material, CHUNK_VOLUME) != 0;
+        if (mismatched)
+                printf("chunk cache mismatch in %d chunks\n", mismatched);
+        if (by_distance == 0)
+                printf("chunk cache: nothing evicted without a visible list\n");
+        if (held != cache.spilled_bytes)
+                printf("chunk cache: %zu spilled bytes counted, %zu held\n", cache.spilled_bytes, held);
+        if (spill_grew)
+                printf("chunk cache: spill file of %.1f MB for %.1f MB held at most\n", file/1e6, (double)peak_pages*CHUNK_CACHE_SPILL_PAGE/1e6);
+
+        const ChunkCacheStats* stats = &cache.stats;
+        printf("%-32s %12.3f ms/frame %6d evicted (%d by distance) %5d spilled %5d restored\n", "chunk cache update", milliseconds / frames,
+               evicted, by_distance, spilled, restored);
+        printf("%-32s %12.1f MB resident of %.1f MB, %d/%d/%d/%d resident/packed/spilled/generated, %.1f MB packed %.1f MB spilled\n",
+               "chunk cache", stats->resident_bytes/1e6, world_chunk_count(&world)*sizeof(ChunkMaterial)/1e6, stats->tiers[CHUNK_RESIDENT],
+               stats->tiers[CHUNK_PACKED], stats->tiers[CHUNK_SPILLED], stats->tiers[CHUNK_GENERATED], stats->packed_bytes/1e6, stats->spilled_bytes/1e6);
+        printf("%-32s %12.1f MB file after %d trips, %d chunks spilled in all\n", "chunk cache spill", file/1e6, trips, spilled);
+
+        chunk_store_destroy(&store, &world);
+        world_destroy(&world);
+        world_destroy(&reference);
+        chunk_cache_destroy(&cache);
+        generator_cache_destroy(&generator);
+        return mismatched || by_distance == 0 || spill_grew || held != cache.spilled_bytes ? -1 : 0;
+}
+
+
+// chunk lookups in a 128x16x128 area of chunks around the origin, 1024 a batch: hits in random order,
+// misses just above it, and the 3x3x3 around every chunk of a row as the mesher would ask for it
+void bench_chunk_map()
+{
+        if (bench_filter && strstr("chunk map", bench_filter) == NULL)
+                return;
+
+        std::vector<glm::ivec3> coords;
+        for (int z = -64 ; z < 64 ; z++)
+        for (int y = -8 ; y < 8 ; y++)
+        for (int x = -64 ; x < 64 ; x++)
+                coords.push_back(glm::ivec3(x, y, z));
+        ChunkMap map;
+        chunk_map_init(&map, 0);
+        std::unordered_map<uint64_t, int> reference;
+        for (int i = 0 ; i < (int)coords.size() ; i++)
+        {
+                chunk_map_insert(&map, coords[i], i);
+                reference[chunk_coord_key(coords[i])] = i;
+        }
+
+        const int batch = 1024;
+        std::vector<glm::ivec3> hits(batch), misses(batch);
+        srand(9);
+        for (int i = 0 ; i < batch ; i++)
+        {
+                hits[i] = coords[rand() % coords.size()];
+                misses[i] = hits[i] + glm::ivec3(0, 16, 0);
+        }
+        auto lookups = [&](const char* name, const std::vector<glm::ivec3>& keys, double* ns)
+        {
+                *ns = bench(name, 0, [&]{
+                        for (const glm::ivec3& c : keys)
+                                bench_sink += chunk_map_find(&map, c);
+                }) / batch;
+        };
+        auto reference_lookups = [&](const char* name, const std::vector<glm::ivec3>& keys, double* ns)
+        {
+                *ns = bench(name, 0, [&]{
+                        for (const glm::ivec3& c : keys)
+                        {
+                                auto found = reference.find(chunk_coord_key(c));
+                                bench_sink += found == reference.end() ? -1 : found->second;
+                        }
+                }) / batch;
+        };
+        double hit, miss, reference_hit, reference_miss;
+        lookups("chunk map 1024 hits", hits, &hit);
+        reference_lookups("chunk map 1024 hits unordered_map", hits, &reference_hit);
+        lookups("chunk map 1024 misses", misses, &miss);
+        reference_lookups("chunk map 1024 misses unordered_map", misses, &reference_miss);
+
+        // a row of 128 chunks with its 3x3x3 around each
+        double finds = bench("chunk map 3x3x3 row", 0, [&]{
+                for (int x = -64 ; x < 64 ; x++)
+                for (int n = 0 ; n < 27 ; n++)
+                        bench_sink += chunk_map_find(&map, glm::ivec3(x + n%3 - 1, n/3%3 - 1, n/9 - 1));
+        });
+        double cached = bench("chunk map 3x3x3 row neighbourhood", 0, [&]{
+                ChunkNeighbourhood neighbourhood = {};
+                for (int x = -64 ; x < 64 ; x++)
+                {
+                        chunk_neighbourhood_move(&neighbourhood, &map, glm::ivec3(x, 0, 0));
+                        for (int n = 0 ; n < 27 ; n++)
+                                bench_sink += chunk_neighbourhood_find(&neighbourhood, &map, glm::ivec3(x + n%3 - 1, n/3%3 - 1, n/9 - 1));
+                }
+        });
+
+        // every key still there after half are removed and the rest inserted again
+        for (size_t i = 0 ; i < coords.size() ; i += 2)
+        {
+                chunk_map_remove(&map, coords[i]);
+                reference.erase(chunk_coord_key(coords[i]));
+        }
+        for (size_t i = 0 ; i < coords.size() ; i += 4)
+        {
+                chunk_map_insert(&map, coords[i], -(int)i);
+                reference[chunk_coord_key(coords[i])] = -(int)i;
+        }
+        int mismatched = map.count != reference.size();
+        for (const glm::ivec3& c : coords)
+        {
+                auto found = reference.find(chunk_coord_key(c));
+                mismatched += chunk_map_find(&map, c) != (found == reference.end() ? -1 : found->second);
+                mismatched += chunk_map_find(&map, c + glm::ivec3(0, 16, 0)) != -1;
+        }
+        if (mismatched)
+                printf("chunk map mismatch in %d lookups\n", mismatched);
+
+        if (finds && cached)
+                printf("%-32s %12.1f ns hit %.1f ns miss, unordered_map %.1f ns hit %.1f ns miss, neighbourhood %.1fx, %zu slots for %zu chunks\n",
+                       "chunk map", hit, miss, reference_hit, reference_miss, finds / cached, map.capacity, map.count);
+        chunk_map_destroy(&map);
+}
+
+
+// the camera crossing 16x2x16 chunks of terrain a few voxels a frame with an edit now and then. the
+// texture is a cpu copy the uploads are applied to, compared in the end against one filled from scratch
+void bench_clipmap()
+{
+        if (bench_filter && strstr("clipmap", bench_filter) == NULL)
+                return;
+
+        World world = {};
+        if (world_create(&world, 16, 2, 16, 1337) != 0)
+                return;
+        Clipmap clipmap;
+        clipmap_init(&clipmap);
+        std::vector<uint8_t> texture(clipmap_texture_bytes());
+        auto apply = [](const Clipmap* clipmap, std::vector<uint8_t>& texture)
+        {
+                for (const ClipmapUpload& upload : clipmap->uploads)
+                for (int z = 0 ; z < upload.size ; z++)
+                for (int y = 0 ; y < upload.size ; y++)
+                        memcpy(&texture[upload.texel.x + (size_t)(upload.texel.y + y)*CLIPMAP_SIZE + (size_t)(upload.texel.z + z)*CLIPMAP_SIZE*CLIPMAP_SIZE],
+                               &clipmap->staging[upload.offset + (size_t)(y + z*upload.size)*upload.size], upload.size);
+        };
+
+        glm::vec3 camera = glm::vec3(100.0f, 80.0f, 300.0f);
+        clipmap_update(&clipmap, &world, camera);
+        apply(&clipmap, texture);
+        size_t fill = clipmap.staging.size();
+        double fill_milliseconds = clipmap.milliseconds;
+
+        Brush brush = {};
+        brush.shape = BRUSH_SPHERE;
+        brush.op = BRUSH_ADD;
+        brush.material = 3;
+        brush.extent = glm::vec3(6.0f);
+        BrushResult result;
+        int frames = 0, moves = 0, blocks = 0;
+        size_t bytes = 0, move_bytes = 0;
+        double milliseconds = 0.0;
+        for (int step = 0 ; step < 12*CHUNK_SIZE ; step += 4, frames++)
+        {
+                camera.x += 4.0f;
+                if (step % 128 == 0)
+                {
+                        brush.center = camera - glm::vec3(0.0f, 40.0f, 0.0f);
+                        brush_apply(&world, &brush, &result);
+                        for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+                                world.chunks[i]->dirty = false;
+                }
+                clipmap_update(&clipmap, &world, camera);
+                apply(&clipmap, texture);
+                milliseconds += clipmap.milliseconds;
+                blocks += clipmap.uploaded_blocks;
+                bytes += clipmap.staging.size();
+                if (step % 128 != 0 && clipmap.uploaded_blocks)
+                {
+                        moves++;
+                        move_bytes += clipmap.staging.size();
+                }
+        }
+
+        Clipmap fresh;
+        clipmap_init(&fresh);
+        std::vector<uint8_t> reference(clipmap_texture_bytes());
+        clipmap_update(&fresh, &world, camera);
+        apply(&fresh, reference);
+        if (texture != reference)
+                printf("clipmap mismatch against a full refill\n");
+
+        printf("%-32s %12.3f ms/frame %5d blocks over %d frames, %.1f MB uploaded instead of %.1f MB refilling every frame\n",
+               "clipmap update", milliseconds / frames, blocks, frames, bytes/1e6, (double)fill*frames/1e6);
+        printf("%-32s %12.1f KB per chunk crossed (%d), %.1f MB and %.2f ms for the first fill\n",
+               "clipmap", moves ? move_bytes/1024.0/moves : 0.0, moves, fill/1e6, fill_milliseconds);
+        clipmap_destroy(&clipmap);
+        clipmap_destroy(&fresh);
+        world_destroy(&world);
+}
+
+
+// 16x2x16 chunks of terrain with boxes carving whole chunks empty (leaving holes in the atlas) and
+// spheres filling some of them back in, a dedup pass after each. the atlas is a cpu copy the uploads and moves are applied to, checked against the world
+void bench_brick_atlas()
+{
+        if (bench_filter && strstr("brick atlas", bench_filter) == NULL)
+                return;
+
+        World world = {};
+        if (world_create(&world, 16, 2, 16, 1337) != 0)
+                return;
+        ChunkDedup dedup;
+        chunk_dedup_init(&dedup, &world);
+        chunk_dedup_world(&dedup, &world, true);
+        BrickAtlas atlas;
+        if (brick_atlas_init(&atlas, &world, glm::ivec3(8, 8, 8)) != 0)
+                return;
+
+        const size_t brick = CHUNK_VOLUME + CHUNK_MIP_BYTES;
+        std::vector<uint8_t> texture(brick_atlas_texture_bytes(&atlas));
+        size_t uploaded = 0;
+        int moves = 0;
+        double milliseconds = 0.0;
+        auto update = [&]()
+        {
+                brick_atlas_update(&atlas, &world, BRICK_ATLAS_MOVES_PER_FRAME);
+                for (const BrickUpload& upload : atlas.uploads)
+                        memcpy(&texture[upload.slot*brick], &atlas.staging[upload.offset], brick);
+                for (const BrickMove& move : atlas.moves)
+                        memcpy(&texture[move.to*brick], &texture[move.from*brick], brick);
+                uploaded += atlas.staging.size();
+                moves += atlas.moves.size();
+                milliseconds += atlas.milliseconds;
+        };
+        update();
+        size_t fill = uploaded;
+        int filled = atlas.pool.used;
+
+        Brush brush = {};
+        brush.material = 1;
+        BrushResult result;
+        int frames = 1;
+        srand(3);
+        for (int edit = 0 ; edit < 8 ; edit++)
+        {
+                glm::vec3 corner = glm::vec3(1 + rand() % 14, 1, 1 + rand() % 14) * (float)CHUNK_SIZE;
+                brush.shape = edit % 2 ? BRUSH_SPHERE : BRUSH_BOX;
+                brush.op = edit % 2 ? BRUSH_ADD : BRUSH_SUBTRACT;
+                brush.center = edit % 2 ? corner + glm::vec3(20.0f, 0.0f, -20.0f) : corner;
+                brush.extent = edit % 2 ? glm::vec3(24.0f) : glm::vec3(1.5f*CHUNK_SIZE, CHUNK_SIZE, 1.5f*CHUNK_SIZE);
+                brush_apply(&world, &brush, &result);
+                for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+                        world.chunks[i]->dirty = false;
+                chunk_dedup_world(&dedup, &world, true);
+                for (int frame = 0 ; frame < 8 ; frame++, frames++)
+                        update();
+        }
+        // until the bricks are packed
+        int settle = 0;
+        do
+        {
+                update();
+                settle++;
+        }
+        while (!atlas.moves.empty());
+
+        int mismatched = 0, holes = 0;
+        std::vector<uint8_t> scratch(CHUNK_VOLUME), expected(brick);
+        for (int i = 0 ; i < world_chunk_count(&world) ; i++)
+        {
+                Chunk* chunk = world.chunks[i];
+                const uint8_t* material = chunk_material_read(chunk, scratch.data());
+                uint16_t page = atlas.pages[i];
+                if (page == BRICK_PAGE_MISSING)
+                        continue;
+                if (page == BRICK_PAGE_EMPTY || (page & BRICK_PAGE_UNIFORM))
+                {
+                        memset(expected.data(), page & 0xff, CHUNK_VOLUME);
+                        mismatched += memcmp(expected.data(), material, CHUNK_VOLUME) != 0;
+                        continue;
+                }
+                memcpy(expected.data(), material, CHUNK_VOLUME);
+                // the atlas builds stale mips on the side, the chunk keeps its own
+                const uint8_t* mips = chunk_material_mips_read(chunk, expected.data() + CHUNK_VOLUME);
+                if (mips != expected.data() + CHUNK_VOLUME)
+                        memcpy(expected.data() + CHUNK_VOLUME, mips, CHUNK_MIP_BYTES);
+                mismatched += memcmp(expected.data(), &texture[(page - 1)*brick], brick) != 0;
+        }
+        for (int slot = 0 ; slot < atlas.pool.used ; slot++)
+                holes += atlas.slot_chunk[slot] < 0;
+        if (mismatched || holes)
+                printf("brick atlas mismatch in %d chunks, %d holes\n", mismatched, holes);
+
+        printf("%-32s %12.3f ms/frame %d moves, %.1f MB uploaded after a %.1f MB first fill, packed %d frames after the last edit\n",
+               "brick atlas update", milliseconds / (frames + settle), moves, (uploaded - fill)/1e6, fill/1e6, settle);
+        printf("%-32s %12d of %d slots for %d chunks (%d at first), %d missing, %.1f MB instead of %.1f MB of world texture\n",
+               "brick atlas", atlas.pool.used, atlas.pool.capacity, world_chunk_count(&world), filled, atlas.missing,
+               atlas.pool.used*brick/1e6, world_chunk_count(&world)*brick/1e6);
+        brick_atlas_destroy(&atlas);
+        chunk_dedup_destroy(&dedup);
+        world_destroy(&world);
+}
+
+
+// mesh page churn: free a random mesh, take pages for a new one
+void bench_slot_pool()
+{
+        SlotPool pool;
+        slot_pool_init(&pool, 8192);
+        std::vector<SlotRun> runs;
+        srand(5);
+        bench("slot pool alloc + free", 0, [&]{
+                if (runs.size() > 512 || (!runs.empty() && rand() % 2))
+                {
+                        size_t r = rand() % runs.size();
+                        slot_pool_free(&pool, runs[r].first, runs[r].count);
+                        runs[r] = runs.back();
+                        runs.pop_back();
+                }
+                int count = 1 + rand() % 8;
+                int first = slot_pool_alloc(&pool, count);
+                if (first >= 0)
+                        runs.push_back({first, count});
+        });
+}
+
+
+void bench_frustum()
+{
+        // a 64x8x256 grid of chunks around the camera, 131072 boxes
+        World world = {};
+        world.width = 64;
+        world.height = 8;
+        world.depth = 256;
+        ChunkBounds bounds;
+        chunk_bounds_build(&bounds, &world);
+
+        glm::vec3 eye = glm::vec3(world.width, world.height, world.depth) * (CHUNK_SIZE*VOXEL_SIZE*0.5f);
+        glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.3f, -0.2f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f/9.0f, 0.01f, 1000.0f);
+        Frustum frustum;
+        frustum_extract(&frustum, projection * view);
+
+        std::vector<int> visible(bounds.count);
+        int scalar = frustum_cull_scalar(&frustum, &bounds, visible.data());
+        int simd = frustum_cull(&frustum, &bounds, visible.data());
+        if (scalar != simd)
+                printf("frustum cull mismatch: scalar %d simd %d\n", scalar, simd);
+
+        bench("frustum cull 128k scalar", bounds.count*6*sizeof(float), [&]{
+                bench_sink += frustum_cull_scalar(&frustum, &bounds, visible.data());
+        });
+        bench("frustum cull 128k", bounds.count*6*sizeof(float), [&]{
+                bench_sink += frustum_cull(&frustum, &bounds, visible.data());
+        });
+}
+
+
+int main(int argc, char* argv[])
+{
+        if (argc > 1)
+                bench_filter = argv[1];
+
+        World world = {};
+        if (world_create(&world, 2, 2, 2, 1337) != 0)
+        {
+                printf("unable to allocate the world.\n");
+                return -1;
+        }
+        // benches that check their results count here, the run fails if any did
+        int failed = 0;
+
+        bench_bitslab(&world);
+        bench_mesher(&world);
+        bench_lod(&world);
+        bench_raycast(&world);
+        bench_ray_batch(&world);
+        failed += bench_brush(&world) != 0;
+        bench_edit_queue();
+        bench_snapshot(&world);
+        failed += bench_rle(&world) != 0;
+        failed += bench_journal() != 0;
+        failed += bench_save(&world) != 0;
+        failed += bench_region_reader(&world) != 0;
+        bench_generator();
+        bench_dedup();
+        failed += bench_chunk_cache() != 0;
+        bench_slot_pool();
+        bench_chunk_map();
+        bench_clipmap();
+        bench_brick_atlas();
+        bench_frustum();
+
+        world_destroy(&world);
+        if (failed)
+        {
+                printf("%d benches failed their checks\n", failed);
+                return -1;
+        }
+        return 0;
+}
@@ -0,0 +1,102 @@
+#include "bitslab.h"
+
+#include <string.h>
+
+
+void bitslab_transpose64(uint64_t matrix[64])
+{
+        // swap ever smaller off diagonal blocks: 32x32, 16x16, ... 1x1
+        uint64_t mask = 0x00000000FFFFFFFFull;
+        for (int j = 32 ; j != 0 ; j >>= 1, mask ^= mask << j)
+        {
+                for (int k = 0 ; k < 64 ; k = ((k | j) + 1) & ~j)
+                {
+                        uint64_t t = ((matrix[k] >> j) ^ matrix[k | j]) & mask;
+                        matrix[k] ^= t << j;
+                        matrix[k | j] ^= t;
+                }
+        }
+}
+
+
+static void store_row(uint32_t out[BITSLAB_CHUNK_TEXELS], int u, int v, uint64_t row)
+{
+        int i = u + v*CHUNK_SIZE;
+        out[i] = (uint32_t)row;
+        out[i + CHUNK_SIZE*CHUNK_SIZE] = (uint32_t)(row >> 32);
+}
+
+
+static uint64_t load_row(const uint32_t in[BITSLAB_CHUNK_TEXELS], int u, int v)
+{
+        int i = u + v*CHUNK_SIZE;
+        return (uint64_t)in[i] | ((uint64_t)in[i + CHUNK_SIZE*CHUNK_SIZE] << 32);
+}
+
+
+void bitslab_pack_chunk(const uint64_t columns[CHUNK_COLUMNS], int axis, uint32_t out[BITSLAB_CHUNK_TEXELS])
+{
+        uint64_t matrix[64];
+        switch (axis)
+        {
+        case 0: // u = y, v = z. rows x bits y -> rows y bits x
+                for (int z = 0 ; z < CHUNK_SIZE ; z++)
+                {
+                        for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                                matrix[x] = columns[chunk_column_index(x,z)];
+                        bitslab_transpose64(matrix);
+                        for (int y = 0 ; y < CHUNK_SIZE ; y++)
+                                store_row(out, y, z, matrix[y]);
+                }
+                break;
+        case 1: // u = z, v = x. columns already run along y
+                for (int z = 0 ; z < CHUNK_SIZE ; z++)
+                        for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                                store_row(out, z, x, columns[chunk_column_index(x,z)]);
+                break;
+        case 2: // u = x, v = y. rows z bits y -> rows y bits z
+                for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                {
+                        for (int z = 0 ; z < CHUNK_SIZE ; z++)
+                                matrix[z] = columns[chunk_column_index(x,z)];
+                        bitslab_transpose64(matrix);
+                        for (int y = 0 ; y < CHUNK_SIZE ; y++)
+                                store_row(out, x, y, matrix[y]);
+                }
+                break;
+        }
+}
+
+
+void bitslab_unpack_chunk(const uint32_t in[BITSLAB_CHUNK_TEXELS], int axis, uint64_t columns[CHUNK_COLUMNS])
+{
+        uint64_t matrix[64];
+        switch (axis)
+        {
+        case 0:
+                for (int z = 0 ; z < CHUNK_SIZE ; z++)
+                {
+                        for (int y = 0 ; y < CHUNK_SIZE ; y++)
+                                matrix[y] = load_row(in, y, z);
+                        bitslab_transpose64(matrix);
+                        for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                                columns[chunk_column_index(x,z)] = matrix[x];
+                }
+                break;
+        case 1:
+                for (int z = 0 ; z < CHUNK_SIZE ; z++)
+                        for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                                columns[chunk_column_index(x,z)] = load_row(in, z, x);
+                break;
+        case 2:
+                for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                {
+                        for (int y = 0 ; y < CHUNK_SIZE ; y++)
+                                matrix[y] = load_row(in, x, y);
+                        bitslab_transpose64(matrix);
+                        for (int z = 0 ; z < CHUNK_SIZE ; z++)
+                                columns[chunk_column_index(x,z)] = matrix[z];
+                }
+                break;
+        }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+
+// bit sliced occupancy, one 2D R32UI texture per axis.
+// a texel holds 32 consecutive voxels along the axis, so a lattice fragment
+// answers "is this cell solid" with one fetch and a bit test.
+//
+// for axis a the other two axes are u = (a+1)%3 and v = (a+2)%3 (same as the lattice quads)
+// and word w of the column at (u,v) lives at texel (u + w*size[u], v).
+// words of the same slice are next to each other, which is what a slice quad reads.
+#define BITSLAB_WORDS_PER_CHUNK (CHUNK_SIZE/32)
+#define BITSLAB_CHUNK_TEXELS (BITSLAB_WORDS_PER_CHUNK*CHUNK_SIZE*CHUNK_SIZE)
+
+// in place transpose of a 64x64 bit matrix: bit x of row y becomes bit y of row x
+void bitslab_transpose64(uint64_t matrix[64]);
+
+// chunk local slab block for one axis: [word][u + v*CHUNK_SIZE]
+void bitslab_pack_chunk(const uint64_t columns[CHUNK_COLUMNS], int axis, uint32_t out[BITSLAB_CHUNK_TEXELS]);
+void bitslab_unpack_chunk(const uint32_t in[BITSLAB_CHUNK_TEXELS], int axis, uint64_t columns[CHUNK_COLUMNS]);
+
+inline glm::ivec2 bitslab_texture_size(glm::ivec3 world_size, int axis)
+{
+        int u = (axis+1) % 3, v = (axis+2) % 3;
+        return glm::ivec2(world_size[u] * (world_size[axis]/32), world_size[v]);
+}
+
+// texel offset of word `word` (0..BITSLAB_WORDS_PER_CHUNK) of the chunk at coord
+inline glm::ivec2 bitslab_chunk_offset(glm::ivec3 world_size, glm::ivec3 coord, int axis, int word)
+{
+        int u = (axis+1) % 3, v = (axis+2) % 3;
+        int w = coord[axis]*BITSLAB_WORDS_PER_CHUNK + word;
+        return glm::ivec2(coord[u]*CHUNK_SIZE + w*world_size[u], coord[v]*CHUNK_SIZE);
+}
@@ -0,0 +1,144 @@
+#include "brick_atlas.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "lod.h"
+
+
+int brick_atlas_init(BrickAtlas* atlas, const World* world, glm::ivec3 slots)
+{
+        int count = slots.x*slots.y*slots.z;
+        // slot + 1 has to stay clear of the uniform bit
+        if (count <= 0 || count >= BRICK_PAGE_UNIFORM)
+        {
+                printf("a brick atlas of %d slots doesn't fit the page table\n", count);
+                return -1;
+        }
+        atlas->slots = slots;
+        slot_pool_init(&atlas->pool, count);
+        atlas->slot_chunk.assign(count, -1);
+
+        int chunks = world_chunk_count(world);
+        atlas->pages.assign(chunks, BRICK_PAGE_EMPTY);
+        // no chunk is at this version yet, so the first update gives every chunk its page
+        atlas->versions.assign(chunks, ~0u);
+        atlas->tags.assign(chunks, 0xff);
+        atlas->pages_changed = true;
+
+        atlas->uploads.clear();
+        atlas->staging.clear();
+        atlas->moves.clear();
+        atlas->missing = 0;
+        atlas->milliseconds = 0.0;
+        return 0;
+}
+
+
+void brick_atlas_destroy(BrickAtlas* atlas)
+{
+        atlas->slot_chunk.clear();
+        atlas->pages.clear();
+        atlas->versions.clear();
+        atlas->tags.clear();
+        atlas->uploads.clear();
+        atlas->staging.clear();
+        atlas->moves.clear();
+}
+
+
+// the chunk's texels and mips into the staging buffer, listed for slot
+static void stage_brick(BrickAtlas* atlas, const Chunk* chunk, int slot)
+{
+        size_t offset = atlas->staging.size();
+        atlas->staging.resize(offset + CHUNK_VOLUME + CHUNK_MIP_BYTES);
+        uint8_t* texels = &atlas->staging[offset];
+        // an evicted chunk is unpacked straight into place
+        const uint8_t* material = chunk_material_read(chunk, texels);
+        if (material != texels)
+                memcpy(texels, material, CHUNK_VOLUME);
+        // stale mips are built straight into place too
+        const uint8_t* mips = chunk_material_mips_read(chunk, texels + CHUNK_VOLUME);
+        if (mips != texels + CHUNK_VOLUME)
+                memcpy(texels + CHUNK_VOLUME, mips, CHUNK_MIP_BYTES);
+        atlas->uploads.push_back({slot, offset});
+}
+
+
+void brick_atlas_update(BrickAtlas* atlas, const World* world, int max_moves)
+{
+        auto start = std::chrono::steady_clock::now();
+        atlas->uploads.clear();
+        atlas->staging.clear();
+        atlas->moves.clear();
+        atlas->missing = 0;
+
+        for (int i = 0 ; i < world_chunk_count(world) ; i++)
+        {
+                const Chunk* chunk = world->chunks[i];
+                if (chunk == NULL)
+                        continue;
+                uint8_t tag = world->tags ? world->tags[i] : (uint8_t)CHUNK_TAG_MIXED;
+                if (atlas->versions[i] == chunk->version && atlas->tags[i] == tag && atlas->pages[i] != BRICK_PAGE_MISSING)
+                        continue;
+                atlas->versions[i] = chunk->version;
+                atlas->tags[i] = tag;
+
+                // the missing page has the uniform bit set too
+                uint16_t page = atlas->pages[i];
+                int slot = page != BRICK_PAGE_EMPTY && !(page & BRICK_PAGE_UNIFORM) ? page - 1 : -1;
+                if (tag != CHUNK_TAG_MIXED)
+                {
+                        if (slot >= 0)
+                        {
+                                slot_pool_free(&atlas->pool, slot, 1);
+                                atlas->slot_chunk[slot] = -1;
+                        }
+                        page = tag == CHUNK_TAG_EMPTY ? BRICK_PAGE_EMPTY : BRICK_PAGE_UNIFORM | chunk_material_get(chunk, 0);
+                }
+                else
+                {
+                        if (slot < 0)
+                                slot = slot_pool_alloc(&atlas->pool, 1);
+                        if (slot < 0)
+                        {
+                                page = BRICK_PAGE_MISSING;
+                                atlas->missing++;
+                        }
+                        else
+                        {
+                                atlas->slot_chunk[slot] = i;
+                                page = slot + 1;
+                                stage_brick(atlas, chunk, slot);
+                        }
+                }
+                if (page != atlas->pages[i])
+                {
+                        atlas->pages[i] = page;
+                        atlas->pages_changed = true;
+                }
+        }
+
+        // the last brick fills the first hole, until there is no hole before the last brick
+        int last = (int)atlas->slot_chunk.size() - 1;
+        for (int move = 0 ; move < max_moves && !atlas->pool.free.empty() ; move++)
+        {
+                while (last >= 0 && atlas->slot_chunk[last] < 0)
+                        last--;
+                int hole = atlas->pool.free[0].first;
+                if (last < hole)
+                        break;
+
+                // first fit hands out the first hole
+                slot_pool_alloc(&atlas->pool, 1);
+                slot_pool_free(&atlas->pool, last, 1);
+                int chunk = atlas->slot_chunk[last];
+                atlas->slot_chunk[hole] = chunk;
+                atlas->slot_chunk[last] = -1;
+                atlas->pages[chunk] = hole + 1;
+                atlas->pages_changed = true;
+                atlas->moves.push_back({last, hole});
+        }
+        atlas->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
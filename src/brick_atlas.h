@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "slot_pool.h"
+
+// page table entries, one per chunk. anything else is the chunk's atlas slot + 1
+#define BRICK_PAGE_EMPTY 0
+// | material, for a chunk that is that material throughout
+#define BRICK_PAGE_UNIFORM 0x8000
+// no slot was free, the shader reads the world sized texture instead
+#define BRICK_PAGE_MISSING 0xffff
+// slots moved towards the front of the atlas per update
+#define BRICK_ATLAS_MOVES_PER_FRAME 2
+
+// a brick staged for its slot: CHUNK_VOLUME texels then the CHUNK_MIP_BYTES mips, as in lod.h
+typedef struct BrickUpload
+{
+        int slot;
+        size_t offset;
+}BrickUpload;
+
+// a brick copied from one slot to another on the gpu, every mip level
+typedef struct BrickMove
+{
+        int from, to;
+}BrickMove;
+
+// the material of the world as chunk sized bricks in one atlas texture (with the chunk mips as its own
+// mips) and a page table with an entry per chunk. chunks the chunk index (see dedup.h) knows to be
+// uniform take no slot, their material is in the page itself. slots come from a SlotPool, and freed
+// slots are filled back in from the end of the atlas a few moves a frame so the bricks stay packed
+// at its front
+typedef struct BrickAtlas
+{
+        // size of the atlas in bricks, slots are numbered x fastest
+        glm::ivec3 slots;
+        SlotPool pool;
+        // world index of the chunk in every slot, -1 when free
+        std::vector<int> slot_chunk;
+
+        // what the page table holds, and the chunk version and tag each entry was written for
+        std::vector<uint16_t> pages;
+        std::vector<unsigned int> versions;
+        std::vector<uint8_t> tags;
+        // set until the render thread has copied pages into the page table
+        bool pages_changed;
+
+        // written by brick_atlas_update for the render thread: uploads first, then moves
+        std::vector<BrickUpload> uploads;
+        std::vector<uint8_t> staging;
+        std::vector<BrickMove> moves;
+
+        // chunks without a slot for want of one, over the last update
+        int missing;
+        double milliseconds;
+}BrickAtlas;
+
+int brick_atlas_init(BrickAtlas* atlas, const World* world, glm::ivec3 slots);
+void brick_atlas_destroy(BrickAtlas* atlas);
+
+// after chunk_dedup_world, on the world or a snapshot of it (the render thread's): chunks whose version or
+// tag changed get a page (and a staged brick when they need a slot), then up to max_moves bricks move from
+// the last used slots into the first free ones
+void brick_atlas_update(BrickAtlas* atlas, const World* world, int max_moves);
+
+// first texel of slot in level 0 of the atlas
+inline glm::ivec3 brick_atlas_slot_origin(const BrickAtlas* atlas, int slot)
+{
+        glm::ivec3 brick = glm::ivec3(slot % atlas->slots.x, (slot / atlas->slots.x) % atlas->slots.y, slot / (atlas->slots.x*atlas->slots.y));
+        return brick * CHUNK_SIZE;
+}
+
+// bytes of the atlas texture, mips included
+inline size_t brick_atlas_texture_bytes(const BrickAtlas* atlas)
+{
+        return (size_t)atlas->slots.x*atlas->slots.y*atlas->slots.z*(CHUNK_VOLUME + CHUNK_MIP_BYTES);
+}
@@ -0,0 +1,238 @@
+#include "brush.h"
+#include "journal.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+
+const char* brush_shape_names[BRUSH_SHAPE_COUNT] = { "sphere", "box", "cylinder" };
+
+
+// bits [lo, hi) of a column, lo and hi already clamped to [0, CHUNK_SIZE]
+static inline uint64_t span_mask(int lo, int hi)
+{
+        if (hi <= lo)
+                return 0;
+        uint64_t upper = hi >= 64 ? ~0ull : (1ull << hi) - 1;
+        return upper & ~((1ull << lo) - 1);
+}
+
+
+// first and one past last voxel whose center is within extent of center
+static inline void voxel_range(float center, float extent, int* lo, int* hi)
+{
+        *lo = (int)ceilf(center - extent - 0.5f);
+        *hi = (int)floorf(center + extent - 0.5f) + 1;
+}
+
+
+// half height of the brush in the column whose center is dx, dz away from the brush center, false if it misses it
+static bool column_extent(const Brush* brush, float dx, float dz, float* half)
+{
+        float radius = brush->extent.x;
+        switch (brush->shape)
+        {
+        case BRUSH_SPHERE:
+        {
+                float d = radius*radius - dx*dx - dz*dz;
+                if (d < 0.0f)
+                        return false;
+                *half = sqrtf(d);
+                return true;
+        }
+        case BRUSH_CYLINDER:
+                if (dx*dx + dz*dz > radius*radius)
+                        return false;
+                *half = brush->extent.y;
+                return true;
+        default:
+                if (fabsf(dx) > brush->extent.x || fabsf(dz) > brush->extent.z)
+                        return false;
+                *half = brush->extent.y;
+                return true;
+        }
+}
+
+
+// writes material to every voxel of the column at x, z whose bit is set, xoring the change into journal when set
+static inline void write_bits(Chunk* chunk, int x, int z, uint64_t bits, uint8_t material, Journal* journal)
+{
+        int first = chunk_voxel_index(x,0,z);
+        uint8_t* column = &chunk->material[first];
+        uint8_t* delta = journal ? &journal->material_xor[first] : NULL;
+        while (bits)
+        {
+                int y = __builtin_ctzll(bits)*CHUNK_SIZE;
+                if (delta)
+                        delta[y] ^= column[y] ^ material;
+                column[y] = material;
+                bits &= bits - 1;
+        }
+}
+
+
+// the part of the brush inside the chunk at index, lo/hi are the brush bounds local to it and clamped to it.
+// the chunk is only copied out of its snapshot and its shared material (see world_chunk_write) once a
+// column actually changes
+static int brush_apply_chunk(const Brush* brush, World* world, int index, glm::ivec3 lo, glm::ivec3 hi, DirtyBox* box)
+{
+        Chunk* chunk = world->chunks[index];
+        bool writable = false;
+        // painting compares against the voxels, an evicted chunk is brought back first
+        if (brush->op == BRUSH_PAINT && chunk->material == NULL)
+        {
+                chunk = world_chunk_write(world, index);
+                if (chunk == NULL)
+                        return 0;
+                writable = true;
+        }
+        glm::ivec3 origin = chunk->coord * CHUNK_SIZE;
+        glm::ivec3 changed_min = glm::ivec3(CHUNK_SIZE), changed_max = glm::ivec3(0);
+        // union of the changed bits of every column, its lowest and highest bit bound the box along y
+        uint64_t changed_rows = 0;
+        int voxels = 0;
+
+        for (int z = lo.z ; z < hi.z ; z++)
+        {
+                float dz = origin.z + z + 0.5f - brush->center.z;
+                for (int x = lo.x ; x < hi.x ; x++)
+                {
+                        float dx = origin.x + x + 0.5f - brush->center.x;
+                        float half;
+                        if (!column_extent(brush, dx, dz, &half))
+                                continue;
+
+                        int y0, y1;
+                        voxel_range(brush->center.y, half, &y0, &y1);
+                        uint64_t mask = span_mask(glm::max(y0 - origin.y, lo.y), glm::min(y1 - origin.y, hi.y));
+                        if (mask == 0)
+                                continue;
+
+                        uint64_t column = chunk->occupancy[chunk_column_index(x,z)];
+                        uint64_t changed = 0;
+                        if (brush->op == BRUSH_ADD)
+                                changed = mask & ~column;
+                        else if (brush->op == BRUSH_SUBTRACT)
+                                changed = mask & column;
+                        else
+                        {
+                                // occupancy stays, only voxels that end up a different material count
+                                uint64_t solid = mask & column;
+                                const uint8_t* materials = &chunk->material[chunk_voxel_index(x,0,z)];
+                                while (solid)
+                                {
+                                        int y = __builtin_ctzll(solid);
+                                        solid &= solid - 1;
+                                        if (materials[y*CHUNK_SIZE] != brush->material)
+                                                changed |= 1ull << y;
+                                }
+                        }
+                        if (changed == 0)
+                                continue;
+
+                        if (!writable)
+                        {
+                                chunk = world_chunk_write(world, index);
+                                if (chunk == NULL)
+                                        return 0;
+                                writable = true;
+                        }
+                        // add and subtract flip exactly the changed bits, paint none
+                        uint64_t flipped = 0;
+                        if (brush->op == BRUSH_ADD)
+                        {
+                                chunk->occupancy[chunk_column_index(x,z)] |= mask;
+                                flipped = changed;
+                        }
+                        else if (brush->op == BRUSH_SUBTRACT)
+                        {
+                                chunk->occupancy[chunk_column_index(x,z)] &= ~mask;
+                                flipped = changed;
+                        }
+                        if (world->journal)
+                                world->journal->occupancy_xor[chunk_column_index(x,z)] ^= flipped;
+                        write_bits(chunk, x, z, changed, brush->op == BRUSH_SUBTRACT ? 0 : brush->material, world->journal);
+
+                        voxels += __builtin_popcountll(changed);
+                        changed_rows |= changed;
+                        changed_min.x = glm::min(changed_min.x, x);
+                        changed_min.z = glm::min(changed_min.z, z);
+                        changed_max.x = glm::max(changed_max.x, x + 1);
+                        changed_max.z = glm::max(changed_max.z, z + 1);
+                }
+        }
+
+        if (voxels == 0)
+                return 0;
+        changed_min.y = __builtin_ctzll(changed_rows);
+        changed_max.y = 64 - __builtin_clzll(changed_rows);
+        *box = {changed_min, changed_max};
+        return voxels;
+}
+
+
+int brush_apply(World* world, const Brush* brush, BrushResult* result)
+{
+        auto start = std::chrono::steady_clock::now();
+        result->dirty.clear();
+        result->voxels = 0;
+
+        // air under set occupancy bits would leave the mesher, the raycast and the save disagreeing about the chunk
+        if (brush->op != BRUSH_SUBTRACT && brush->material == 0)
+        {
+                printf("a brush can't add or paint material 0, subtract instead\n");
+                result->microseconds = 0.0;
+                return -1;
+        }
+
+        // voxel bounds of the whole brush, a sphere reaches its radius along every axis
+        glm::vec3 extent = brush->extent;
+        if (brush->shape == BRUSH_SPHERE)
+                extent = glm::vec3(extent.x);
+        else if (brush->shape == BRUSH_CYLINDER)
+                extent.z = extent.x;
+        glm::ivec3 lo, hi;
+        for (int axis = 0 ; axis < 3 ; axis++)
+                voxel_range(brush->center[axis], extent[axis], &lo[axis], &hi[axis]);
+
+        glm::ivec3 size = glm::ivec3(world->width, world->height, world->depth) * CHUNK_SIZE;
+        lo = glm::max(lo, glm::ivec3(0));
+        hi = glm::min(hi, size);
+        if (glm::any(glm::lessThanEqual(hi, lo)))
+        {
+                result->microseconds = 0.0;
+                return 0;
+        }
+
+        if (world->journal)
+                journal_begin(world->journal);
+        glm::ivec3 first = lo / CHUNK_SIZE, last = (hi - 1) / CHUNK_SIZE;
+        for (int cz = first.z ; cz <= last.z ; cz++)
+        for (int cy = first.y ; cy <= last.y ; cy++)
+        for (int cx = first.x ; cx <= last.x ; cx++)
+        {
+                int index = world_chunk_index(world, cx, cy, cz);
+                Chunk* chunk = world->chunks[index];
+                if (chunk == NULL)
+                        continue;
+
+                glm::ivec3 origin = chunk->coord * CHUNK_SIZE;
+                glm::ivec3 chunk_lo = glm::max(lo - origin, glm::ivec3(0));
+                glm::ivec3 chunk_hi = glm::min(hi - origin, glm::ivec3(CHUNK_SIZE));
+
+                DirtyBox box;
+                int voxels = brush_apply_chunk(brush, world, index, chunk_lo, chunk_hi, &box);
+                if (voxels == 0)
+                        continue;
+                chunk_mark_dirty(world->chunks[index], box);
+                if (world->journal)
+                        journal_chunk(world->journal, index, box);
+                result->dirty.push_back({index, box});
+                result->voxels += voxels;
+        }
+        if (world->journal)
+                journal_end(world->journal);
+
+        result->microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        return result->voxels;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+
+enum BrushShape
+{
+        BRUSH_SPHERE,
+        BRUSH_BOX,
+        BRUSH_CYLINDER,
+        BRUSH_SHAPE_COUNT
+};
+extern const char* brush_shape_names[BRUSH_SHAPE_COUNT];
+
+enum BrushOp
+{
+        // fills empty voxels with the material, solid ones keep theirs
+        BRUSH_ADD,
+        BRUSH_SUBTRACT,
+        // changes the material of solid voxels only
+        BRUSH_PAINT,
+        BRUSH_OP_COUNT
+};
+
+// in voxel units, a voxel is inside when its center is.
+// extent is the half size of a box, x is the radius of a sphere, x/y the radius/half height of a y aligned cylinder
+typedef struct Brush
+{
+        int shape, op;
+        glm::vec3 center, extent;
+        uint8_t material;
+}Brush;
+
+// what one edit touched: the tightest box of changed voxels per chunk, chunks that didn't change are left out
+typedef struct BrushDirty
+{
+        int chunk;
+        DirtyBox box;
+}BrushDirty;
+
+typedef struct BrushResult
+{
+        std::vector<BrushDirty> dirty;
+        int voxels;
+        double microseconds;
+}BrushResult;
+
+// rasterizes the brush into one span mask per column and applies it with a single and/or per column.
+// every changed chunk gets its box merged into its dirty box (see chunk_mark_dirty) so the
+// uploader only repacks that region, returns the number of voxels changed. adding or painting
+// material 0 is refused with -1, occupancy has to stay exactly the non air voxels
+int brush_apply(World* world, const Brush* brush, BrushResult* result);
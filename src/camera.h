@@ -0,0 +1,16 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+typedef struct Camera
+{
+        const float near = 0.01,far = 100;
+        const float fov = 70.0f,sensitivity = 0.05f;
+        glm::vec2 resolution;
+        float speed = 0.25f;
+        float yaw=0.0f, pitch=0.0f, roll=0.0f;
+        glm::vec3 position = glm::vec3(0.0f,0.0f,-3.0f);
+        glm::vec3 direction, front, up, right;
+        glm::mat4 view = glm::mat4(1.0f);
+        glm::mat4 projection = glm::mat4(1.0f);
+}Camera;
@@ -0,0 +1,366 @@
+#include "chunk.h"
+#include "lod.h"
+#include "rle.h"
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+
+static bool material_unpack(const ChunkMaterial* block, glm::ivec3 coord, uint8_t* voxels);
+
+
+Chunk* chunk_create(glm::ivec3 coord)
+{
+        Chunk* chunk = (Chunk*) calloc(1, sizeof(Chunk));
+        if (chunk == NULL)
+        {
+                printf("unable to allocate chunk %d %d %d\n", coord.x, coord.y, coord.z);
+                return NULL;
+        }
+        chunk->material_block = chunk_material_create();
+        if (chunk->material_block == NULL)
+        {
+                printf("unable to allocate chunk %d %d %d\n", coord.x, coord.y, coord.z);
+                free(chunk);
+                return NULL;
+        }
+        chunk->material = chunk->material_block->voxels;
+        chunk->coord = coord;
+        return chunk;
+}
+
+
+void chunk_destroy(Chunk* chunk)
+{
+        if (chunk == NULL)
+                return;
+        chunk_material_release(chunk->material_block);
+        free(chunk);
+}
+
+
+ChunkMaterial* chunk_material_create()
+{
+        ChunkMaterial* block = (ChunkMaterial*) calloc(1, sizeof(ChunkMaterial));
+        if (block)
+                block->references = 1;
+        return block;
+}
+
+
+void chunk_material_release(ChunkMaterial* block)
+{
+        if (block && block->references.fetch_sub(1) == 1)
+        {
+                free(block->packed);
+                free(block);
+        }
+}
+
+
+uint8_t* chunk_material_write(Chunk* chunk)
+{
+        ChunkMaterial* block = chunk->material_block;
+        if (block->tier == CHUNK_RESIDENT && block->references.load() == 1)
+                return chunk->material;
+
+        ChunkMaterial* copy = chunk_material_create();
+        if (copy == NULL)
+        {
+                printf("unable to copy the material of chunk %d %d %d\n", chunk->coord.x, chunk->coord.y, chunk->coord.z);
+                return NULL;
+        }
+        // an evicted block comes back resident
+        if (block->tier == CHUNK_RESIDENT)
+                memcpy(copy->voxels, block->voxels, CHUNK_VOLUME);
+        else
+                material_unpack(block, chunk->coord, copy->voxels);
+        chunk->material_block = copy;
+        chunk->material = copy->voxels;
+        chunk_material_release(block);
+        return chunk->material;
+}
+
+
+void chunk_material_share(Chunk* chunk, ChunkMaterial* block)
+{
+        if (chunk->material_block == block)
+                return;
+        block->references++;
+        chunk_material_release(chunk->material_block);
+        chunk->material_block = block;
+        chunk->material = block->tier == CHUNK_RESIDENT ? block->voxels : NULL;
+}
+
+
+void chunk_mark_dirty(Chunk* chunk, DirtyBox box)
+{
+        if (chunk->dirty)
+        {
+                chunk->dirty_box.min = glm::min(chunk->dirty_box.min, box.min);
+                chunk->dirty_box.max = glm::max(chunk->dirty_box.max, box.max);
+        }
+        else
+        {
+                chunk->dirty_box = box;
+                chunk->dirty = true;
+        }
+        chunk->version++;
+}
+
+
+void chunk_set(Chunk* chunk, int x, int y, int z, uint8_t material)
+{
+        uint8_t* voxels = chunk_material_write(chunk);
+        if (voxels == NULL)
+                return;
+        voxels[chunk_voxel_index(x,y,z)] = material;
+
+        uint64_t bit = 1ull << y;
+        if (material)
+                chunk->occupancy[chunk_column_index(x,z)] |= bit;
+        else
+                chunk->occupancy[chunk_column_index(x,z)] &= ~bit;
+
+        glm::ivec3 voxel = glm::ivec3(x,y,z);
+        chunk_mark_dirty(chunk, {voxel, voxel+1});
+}
+
+
+// cheap integer hash, good enough for terrain
+static unsigned int hash(int x, int z, unsigned int seed)
+{
+        unsigned int h = seed ^ (x*374761393u) ^ (z*668265263u);
+        h = (h ^ (h >> 13)) * 1274126177u;
+        return h ^ (h >> 16);
+}
+
+
+static float value_noise(float x, float z, unsigned int seed)
+{
+        int ix = (int)floorf(x), iz = (int)floorf(z);
+        float fx = x-ix, fz = z-iz;
+        fx = fx*fx*(3.0f-2.0f*fx);
+        fz = fz*fz*(3.0f-2.0f*fz);
+
+        float a = hash(ix,iz,seed)/4294967295.0f;
+        float b = hash(ix+1,iz,seed)/4294967295.0f;
+        float c = hash(ix,iz+1,seed)/4294967295.0f;
+        float d = hash(ix+1,iz+1,seed)/4294967295.0f;
+
+        return a + (b-a)*fx + (c-a)*fz + (a-b-c+d)*fx*fz;
+}
+
+
+// rolling heightmap, grass on top of dirt on top of stone. occupancy may be NULL
+static void generate(glm::ivec3 coord, unsigned int seed, uint64_t* occupancy, uint8_t* voxels)
+{
+        if (occupancy)
+                memset(occupancy, 0, CHUNK_COLUMNS*sizeof(uint64_t));
+        memset(voxels, 0, CHUNK_VOLUME);
+
+        glm::ivec3 origin = coord * CHUNK_SIZE;
+        for (int z = 0 ; z < CHUNK_SIZE ; z++)
+        {
+                for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                {
+                        float wx = origin.x+x, wz = origin.z+z;
+                        float height = 48.0f
+                                + 24.0f*value_noise(wx/96.0f, wz/96.0f, seed)
+                                + 6.0f*value_noise(wx/24.0f, wz/24.0f, seed+1);
+                        int top = (int)height - origin.y;
+                        if (top <= 0)
+                                continue;
+                        if (top > CHUNK_SIZE)
+                                top = CHUNK_SIZE;
+
+                        if (occupancy)
+                                occupancy[chunk_column_index(x,z)] = top == 64 ? ~0ull : (1ull << top)-1;
+                        for (int y = 0 ; y < top ; y++)
+                        {
+                                int depth = (int)height - (origin.y+y);
+                                uint8_t material = depth <= 1 ? 1 : depth <= 4 ? 2 : 3;
+                                voxels[chunk_voxel_index(x,y,z)] = material;
+                        }
+                }
+        }
+}
+
+
+void chunk_generate(Chunk* chunk, unsigned int seed)
+{
+        uint8_t* voxels = chunk_material_write(chunk);
+        if (voxels == NULL)
+                return;
+        generate(chunk->coord, seed, chunk->occupancy, voxels);
+        chunk_mark_dirty(chunk, {glm::ivec3(0), glm::ivec3(CHUNK_SIZE)});
+}
+
+
+// voxels of an evicted block, false (and air) when the spill file can't be read back
+static bool material_unpack(const ChunkMaterial* block, glm::ivec3 coord, uint8_t* voxels)
+{
+        memset(voxels, 0, CHUNK_VOLUME);
+        if (block->tier == CHUNK_GENERATED)
+        {
+                generate(coord, block->seed, NULL, voxels);
+                return true;
+        }
+        if (block->tier == CHUNK_PACKED)
+                return rle_decode(block->packed, block->packed + block->size, voxels, CHUNK_VOLUME);
+
+        uint8_t* packed = (uint8_t*) malloc(block->size);
+        bool ok = packed && pread(block->fd, packed, block->size, block->offset) == (ssize_t)block->size
+               && rle_decode(packed, packed + block->size, voxels, CHUNK_VOLUME);
+        free(packed);
+        if (!ok)
+        {
+                printf("unable to read chunk %d %d %d back from the spill file\n", coord.x, coord.y, coord.z);
+                memset(voxels, 0, CHUNK_VOLUME);
+        }
+        return ok;
+}
+
+
+const uint8_t* chunk_material_read(const Chunk* chunk, uint8_t* scratch)
+{
+        if (chunk->material)
+                return chunk->material;
+        material_unpack(chunk->material_block, chunk->coord, scratch);
+        return scratch;
+}
+
+
+uint8_t chunk_material_get(const Chunk* chunk, int index)
+{
+        if (chunk->material)
+                return chunk->material[index];
+        uint8_t* scratch = (uint8_t*) malloc(CHUNK_VOLUME);
+        if (scratch == NULL)
+                return 0;
+        uint8_t material = chunk_material_read(chunk, scratch)[index];
+        free(scratch);
+        return material;
+}
+
+
+int world_create(World* world, int width, int height, int depth, unsigned int seed)
+{
+        world->width = width;
+        world->height = height;
+        world->depth = depth;
+        world->seed = seed;
+        world->store = NULL;
+        world->journal = NULL;
+
+        int count = world_chunk_count(world);
+        world->chunks = (Chunk**) calloc(count, sizeof(Chunk*));
+        world->tags = (uint8_t*) calloc(count, 1);
+        if (world->chunks == NULL || world->tags == NULL || chunk_map_init(&world->map, count) != 0)
+                return -1;
+
+        for (int z = 0 ; z < depth ; z++)
+        for (int y = 0 ; y < height ; y++)
+        for (int x = 0 ; x < width ; x++)
+        {
+                Chunk* chunk = chunk_create(glm::ivec3(x,y,z));
+                if (chunk == NULL)
+                        return -1;
+                chunk_generate(chunk, seed);
+                chunk_build_mips(chunk);
+                world->chunks[world_chunk_index(world,x,y,z)] = chunk;
+                chunk_map_insert(&world->map, glm::ivec3(x,y,z), world_chunk_index(world,x,y,z));
+        }
+        return 0;
+}
+
+
+void world_destroy(World* world)
+{
+        if (world->chunks == NULL)
+                return;
+        for (int i = 0 ; i < world_chunk_count(world) ; i++)
+                chunk_destroy(world->chunks[i]);
+        free(world->chunks);
+        free(world->tags);
+        chunk_map_destroy(&world->map);
+        world->chunks = NULL;
+        world->tags = NULL;
+}
+
+
+int world_chunk_find(const World* world, glm::ivec3 coord)
+{
+        return chunk_map_find(&world->map, coord);
+}
+
+
+Chunk* world_chunk_at(const World* world, glm::ivec3 voxel)
+{
+        if (voxel.x < 0 || voxel.y < 0 || voxel.z < 0)
+                return NULL;
+        glm::ivec3 c = voxel / CHUNK_SIZE;
+        if (c.x >= world->width || c.y >= world->height || c.z >= world->depth)
+                return NULL;
+        return world->chunks[world_chunk_index(world,c.x,c.y,c.z)];
+}
+
+
+uint8_t world_get(const World* world, glm::ivec3 voxel)
+{
+        Chunk* chunk = world_chunk_at(world, voxel);
+        if (chunk == NULL)
+                return 0;
+        glm::ivec3 l = voxel % CHUNK_SIZE;
+        return chunk_material_get(chunk, chunk_voxel_index(l.x,l.y,l.z));
+}
+
+
+void world_set(World* world, glm::ivec3 voxel, uint8_t material)
+{
+        if (world_chunk_at(world, voxel) == NULL)
+                return;
+        glm::ivec3 c = voxel / CHUNK_SIZE;
+        Chunk* chunk = world_chunk_write(world, world_chunk_index(world,c.x,c.y,c.z));
+        if (chunk == NULL)
+                return;
+        glm::ivec3 l = voxel % CHUNK_SIZE;
+        chunk_set(chunk, l.x, l.y, l.z, material);
+}
+
+
+Chunk* world_chunk_write(World* world, int index)
+{
+        Chunk* chunk = world_chunk_own(world, index);
+        if (chunk == NULL || chunk_material_write(chunk) == NULL)
+                return NULL;
+        if (world->tags)
+                world->tags[index] = CHUNK_TAG_MIXED;
+        return chunk;
+}
+
+
+Chunk* world_chunk_own(World* world, int index)
+{
+        Chunk* chunk = world->chunks[index];
+        if (chunk == NULL || !chunk->shared || world->store == NULL)
+                return chunk;
+
+        // readers keep the old one until the store can prove nobody holds it
+        Chunk* copy = (Chunk*) malloc(sizeof(Chunk));
+        if (copy == NULL)
+        {
+                printf("unable to copy chunk %d %d %d\n", chunk->coord.x, chunk->coord.y, chunk->coord.z);
+                return NULL;
+        }
+        memcpy(copy, chunk, sizeof(Chunk));
+        copy->shared = false;
+        copy->material_block->references++;
+        world->chunks[index] = copy;
+        chunk_store_retire(world->store, chunk);
+        return copy;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <glm/glm.hpp>
+
+#include "chunk_map.h"
+
+// a chunk is a cube of CHUNK_SIZE voxels per side
+// occupancy is stored as one 64 bit column per (x,z) running along y so the
+// bitwise passes (meshing, culling, raycasts) can work a whole column at a time
+#define CHUNK_SIZE 64
+#define CHUNK_COLUMNS (CHUNK_SIZE*CHUNK_SIZE)
+#define CHUNK_VOLUME (CHUNK_SIZE*CHUNK_SIZE*CHUNK_SIZE)
+
+// level 0 is the chunk itself, level CHUNK_MIP_LEVELS-1 is a single cell
+#define CHUNK_MIP_LEVELS 7
+// sizes of levels 1.. stored back to back
+#define CHUNK_MIP_BYTES (32*32*32 + 16*16*16 + 8*8*8 + 4*4*4 + 2*2*2 + 1)
+#define CHUNK_MIP_COLUMNS (32*32 + 16*16 + 8*8 + 4*4 + 2*2 + 1)
+
+// edge length of a voxel in world units
+#define VOXEL_SIZE (1.0f/16.0f)
+
+// inclusive min, exclusive max, in voxels local to the chunk
+typedef struct DirtyBox
+{
+        glm::ivec3 min, max;
+}DirtyBox;
+
+// what the chunk index says about a chunk, see World::tags
+enum ChunkTag
+{
+        CHUNK_TAG_MIXED,
+        // every voxel air
+        CHUNK_TAG_EMPTY,
+        // every voxel the same solid material
+        CHUNK_TAG_SOLID,
+};
+
+// where the voxels of a material block are, the chunk cache evicts the ones far away (see chunk_cache.h)
+enum ChunkTier
+{
+        CHUNK_RESIDENT,
+        // run length encoded in memory
+        CHUNK_PACKED,
+        // run length encoded in the spill file of the cache
+        CHUNK_SPILLED,
+        // nothing kept, the voxels are what the terrain generator makes of seed
+        CHUNK_GENERATED,
+};
+
+// the material of a chunk, in a block of its own so chunks with the same voxels can share it (see dedup.h).
+// freed when the last chunk holding a reference lets go, any thread. evicted blocks never change and are
+// allocated without voxels
+typedef struct ChunkMaterial
+{
+        std::atomic<int> references;
+        int tier;
+        // CHUNK_PACKED: size bytes at packed. CHUNK_SPILLED: size bytes at offset in the file fd
+        uint8_t* packed;
+        size_t size;
+        int fd;
+        long offset;
+        unsigned int seed;
+        uint8_t voxels[CHUNK_VOLUME];
+}ChunkMaterial;
+
+typedef struct Chunk
+{
+        // index: x + z*CHUNK_SIZE, bit y
+        uint64_t occupancy[CHUNK_COLUMNS];
+        // index: x + y*CHUNK_SIZE + z*CHUNK_SIZE*CHUNK_SIZE, same layout as the 3D texture.
+        // the voxels of material_block, which other chunks may hold too: chunk_material_write before writing.
+        // NULL while the block is evicted, chunk_material_read and chunk_material_get work either way
+        uint8_t* material;
+        ChunkMaterial* material_block;
+
+        // levels 1.. in the same layouts, see lod.h. occupancy is OR reduced, material is a majority vote
+        uint64_t occupancy_mips[CHUNK_MIP_COLUMNS];
+        uint8_t material_mips[CHUNK_MIP_BYTES];
+
+        glm::ivec3 coord;
+        bool dirty;
+        // published in a snapshot, the world thread copies it before the next edit (see snapshot.h)
+        bool shared;
+        DirtyBox dirty_box;
+        // bumped on every edit, the upload worker keeps the one on the gpu (UploadWorker::resident_version)
+        unsigned int version;
+        // version the mips were built from, they are stale whenever it differs from version
+        unsigned int mips_version;
+}Chunk;
+
+typedef struct World
+{
+        // size of the world in chunks
+        int width, height, depth;
+        unsigned int seed;
+        Chunk** chunks;
+        // set while readers on other threads see the chunks through snapshots, NULL edits in place
+        struct ChunkStore* store;
+        // brush edits record their undo steps here when set, see journal.h
+        struct Journal* journal;
+        // the chunk index, a ChunkTag per chunk. chunk_dedup_world fills it in and world_chunk_write sets
+        // the chunk it hands out back to CHUNK_TAG_MIXED. world thread only, snapshots get a copy
+        uint8_t* tags;
+        // chunk coordinate to index in chunks. filled in once by world_create, snapshots share it
+        ChunkMap map;
+}World;
+
+
+inline int chunk_column_index(int x, int z)
+{
+        return x + z*CHUNK_SIZE;
+}
+
+
+inline int chunk_voxel_index(int x, int y, int z)
+{
+        return x + y*CHUNK_SIZE + z*CHUNK_SIZE*CHUNK_SIZE;
+}
+
+
+inline bool chunk_solid(const Chunk* chunk, int x, int y, int z)
+{
+        return (chunk->occupancy[chunk_column_index(x,z)] >> y) & 1;
+}
+
+
+inline int world_chunk_index(const World* world, int x, int y, int z)
+{
+        return x + y*world->width + z*world->width*world->height;
+}
+
+
+// a chunk coordinate packed into a hash key, 21 bits an axis (two's complement, so negative coordinates work)
+inline uint64_t chunk_coord_key(glm::ivec3 coord)
+{
+        return (uint64_t)(coord.x & 0x1fffff) | (uint64_t)(coord.y & 0x1fffff) << 21 | (uint64_t)(coord.z & 0x1fffff) << 42;
+}
+
+
+inline int world_chunk_count(const World* world)
+{
+        return world->width*world->height*world->depth;
+}
+
+
+Chunk* chunk_create(glm::ivec3 coord);
+void chunk_destroy(Chunk* chunk);
+
+// a zeroed block with one reference
+ChunkMaterial* chunk_material_create();
+void chunk_material_release(ChunkMaterial* block);
+// the material of chunk ready to be written, copied out of the block first when other chunks hold it.
+// NULL when out of memory
+uint8_t* chunk_material_write(Chunk* chunk);
+// chunk drops its block for block, which must hold the same voxels
+void chunk_material_share(Chunk* chunk, ChunkMaterial* block);
+// the voxels of chunk, unpacked into scratch (CHUNK_VOLUME bytes) when its block is evicted. any thread
+const uint8_t* chunk_material_read(const Chunk* chunk, uint8_t* scratch);
+// one voxel, index as in chunk_voxel_index. slow for an evicted chunk, it is unpacked whole
+uint8_t chunk_material_get(const Chunk* chunk, int index);
+
+void chunk_set(Chunk* chunk, int x, int y, int z, uint8_t material);
+void chunk_mark_dirty(Chunk* chunk, DirtyBox box);
+void chunk_generate(Chunk* chunk, unsigned int seed);
+
+int world_create(World* world, int width, int height, int depth, unsigned int seed);
+void world_destroy(World* world);
+
+// index of the chunk at chunk coordinate coord, -1 when the world has none there
+int world_chunk_find(const World* world, glm::ivec3 coord);
+// world space voxel lookup, anything outside the world is air
+Chunk* world_chunk_at(const World* world, glm::ivec3 voxel);
+uint8_t world_get(const World* world, glm::ivec3 voxel);
+void world_set(World* world, glm::ivec3 voxel, uint8_t material);
+// the chunk at index, ready to be edited: a chunk a snapshot can see is replaced by a private copy first
+// and its material is unshared
+Chunk* world_chunk_write(World* world, int index);
+// like world_chunk_write but only the chunk itself is copied, the material block stays shared.
+// for changes that keep the voxels, like pointing the chunk at an identical block
+Chunk* world_chunk_own(World* world, int index);
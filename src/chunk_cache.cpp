@@ -0,0 +1,287 @@
+#include "chunk_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+#include "rle.h"
+
+
+int chunk_cache_init(ChunkCache* cache, const World* world, size_t ram_budget, size_t packed_budget, GeneratorCache* generator)
+{
+        cache->ram_budget = ram_budget;
+        cache->packed_budget = packed_budget;
+        cache->generator = generator;
+        cache->used.assign(world_chunk_count(world), 0);
+        cache->frame = 0;
+        cache->stats = {};
+
+        // removed by the os once it is closed
+        cache->spill = tmpfile();
+        slot_pool_init(&cache->spill_pages, 0);
+        cache->spilled.clear();
+        cache->spilled_bytes = 0;
+        if (cache->spill == NULL)
+                printf("no spill file for the chunk cache, packed chunks stay in memory\n");
+        return 0;
+}
+
+
+void chunk_cache_destroy(ChunkCache* cache)
+{
+        for (ChunkMaterial* block : cache->spilled)
+                chunk_material_release(block);
+        cache->spilled.clear();
+        if (cache->spill)
+                fclose(cache->spill);
+        cache->spill = NULL;
+        cache->used.clear();
+}
+
+
+// an evicted block, without room for voxels
+static ChunkMaterial* evicted_block(int tier)
+{
+        ChunkMaterial* block = (ChunkMaterial*) calloc(1, offsetof(ChunkMaterial, voxels));
+        if (block == NULL)
+                return NULL;
+        block->references = 1;
+        block->tier = tier;
+        block->fd = -1;
+        return block;
+}
+
+
+// points the chunk at index to block. the chunk is copied first when a snapshot can see it, readers
+// keep the block they had until the store frees the old chunk
+static bool replace_block(World* world, int index, ChunkMaterial* block)
+{
+        Chunk* chunk = world_chunk_own(world, index);
+        if (chunk)
+                chunk_material_share(chunk, block);
+        chunk_material_release(block);
+        return chunk != NULL;
+}
+
+
+static bool evict(ChunkCache* cache, World* world, int index)
+{
+        const Chunk* chunk = world->chunks[index];
+        ChunkMaterial* block;
+        if (cache->generator && generator_cache_matches(cache->generator, chunk))
+        {
+                block = evicted_block(CHUNK_GENERATED);
+                if (block == NULL)
+                        return false;
+                block->seed = cache->generator->seed;
+        }
+        else
+        {
+                std::vector<uint8_t> packed;
+                rle_encode(packed, chunk->material, CHUNK_VOLUME);
+                block = evicted_block(CHUNK_PACKED);
+                if (block == NULL)
+                        return false;
+                block->packed = (uint8_t*) malloc(packed.size());
+                if (block->packed == NULL)
+                {
+                        chunk_material_release(block);
+                        return false;
+                }
+                memcpy(block->packed, packed.data(), packed.size());
+                block->size = packed.size();
+        }
+        return replace_block(world, index, block);
+}
+
+
+static int spill_page_count(size_t size)
+{
+        return (int)((size + CHUNK_CACHE_SPILL_PAGE - 1) / CHUNK_CACHE_SPILL_PAGE);
+}
+
+
+static bool spill(ChunkCache* cache, World* world, int index)
+{
+        const ChunkMaterial* packed = world->chunks[index]->material_block;
+        // into pages blocks let go of, the file only grows when none are free
+        SlotPool* pages = &cache->spill_pages;
+        int count = spill_page_count(packed->size);
+        int first = slot_pool_alloc(pages, count);
+        if (first < 0)
+        {
+                slot_pool_grow(pages, pages->capacity + std::max(count, pages->capacity));
+                first = slot_pool_alloc(pages, count);
+        }
+        long offset = (long)first*CHUNK_CACHE_SPILL_PAGE;
+        int fd = fileno(cache->spill);
+        ChunkMaterial* block = NULL;
+        if (pwrite(fd, packed->packed, packed->size, offset) != (ssize_t)packed->size || (block = evicted_block(CHUNK_SPILLED)) == NULL)
+        {
+                printf("unable to spill chunk material\n");
+                slot_pool_free(pages, first, count);
+                return false;
+        }
+        block->size = packed->size;
+        block->fd = fd;
+        block->offset = offset;
+        block->references++;
+        cache->spilled.push_back(block);
+        cache->spilled_bytes += block->size;
+        return replace_block(world, index, block);
+}
+
+
+// spilled blocks only the cache holds, because their chunks were restored or a later eviction
+// replaced them, give their pages back
+static void reclaim_spilled(ChunkCache* cache)
+{
+        for (size_t s = 0 ; s < cache->spilled.size() ; )
+        {
+                ChunkMaterial* block = cache->spilled[s];
+                if (block->references.load() > 1)
+                {
+                        s++;
+                        continue;
+                }
+                slot_pool_free(&cache->spill_pages, block->offset / CHUNK_CACHE_SPILL_PAGE, spill_page_count(block->size));
+                cache->spilled_bytes -= block->size;
+                chunk_material_release(block);
+                cache->spilled[s] = cache->spilled.back();
+                cache->spilled.pop_back();
+        }
+}
+
+
+static float chunk_distance(const Chunk* chunk, glm::vec3 camera_voxel)
+{
+        glm::vec3 center = (glm::vec3(chunk->coord) + 0.5f) * (float)CHUNK_SIZE;
+        return glm::length(center - camera_voxel);
+}
+
+
+void chunk_cache_update(ChunkCache* cache, World* world, glm::vec3 camera_voxel, const VisibleChunks* visible)
+{
+        auto start = std::chrono::steady_clock::now();
+        uint64_t frame = ++cache->frame;
+        int count = world_chunk_count(world);
+        glm::ivec3 camera_chunk = glm::ivec3(glm::floor(camera_voxel / (float)CHUNK_SIZE));
+
+        if (visible)
+                for (int v = 0 ; v < visible->count ; v++)
+                        cache->used[visible->indices[v]] = frame;
+        // counting every chunk as used would never evict anything, so without a list the nearby ones stand in
+        int radius = visible ? CHUNK_CACHE_KEEP_RADIUS : CHUNK_CACHE_VIEW_RADIUS;
+        int used = 0;
+        for (int i = 0 ; i < count ; i++)
+        {
+                const Chunk* chunk = world->chunks[i];
+                if (chunk == NULL)
+                        continue;
+                glm::ivec3 d = glm::abs(chunk->coord - camera_chunk);
+                if (chunk->dirty || glm::max(d.x, glm::max(d.y, d.z)) <= radius)
+                        cache->used[i] = frame;
+                used += cache->used[i] == frame;
+        }
+
+        // used again: back to resident, nearest first
+        std::vector<std::pair<float, int>> order;
+        for (int i = 0 ; i < count ; i++)
+                if (world->chunks[i] && world->chunks[i]->material == NULL && cache->used[i] == frame)
+                        order.push_back({chunk_distance(world->chunks[i], camera_voxel), i});
+        std::sort(order.begin(), order.end());
+        int restored = 0;
+        for (size_t o = 0 ; o < order.size() && restored < CHUNK_CACHE_RESTORES_PER_FRAME ; o++)
+        {
+                Chunk* chunk = world_chunk_own(world, order[o].second);
+                if (chunk && chunk_material_write(chunk))
+                        restored++;
+        }
+
+        // what is resident and packed now. shared blocks (see dedup.h) are counted once and never evicted,
+        // evicting one chunk of them wouldn't free anything
+        ChunkCacheStats stats = {};
+        std::vector<const ChunkMaterial*> shared;
+        for (int i = 0 ; i < count ; i++)
+        {
+                const Chunk* chunk = world->chunks[i];
+                if (chunk == NULL)
+                        continue;
+                const ChunkMaterial* block = chunk->material_block;
+                stats.tiers[block->tier]++;
+                if (block->tier == CHUNK_PACKED)
+                        stats.packed_bytes += block->size;
+                if (block->tier != CHUNK_RESIDENT)
+                        continue;
+                if (block->references.load() > 1)
+                        shared.push_back(block);
+                else
+                        stats.resident_bytes += sizeof(ChunkMaterial);
+        }
+        std::sort(shared.begin(), shared.end());
+        stats.resident_bytes += (std::unique(shared.begin(), shared.end()) - shared.begin())*sizeof(ChunkMaterial);
+
+        // least recently used first, the furthest first among chunks last used in the same frame
+        if (stats.resident_bytes > cache->ram_budget)
+        {
+                order.clear();
+                for (int i = 0 ; i < count ; i++)
+                {
+                        const Chunk* chunk = world->chunks[i];
+                        if (chunk == NULL || chunk->material == NULL || cache->used[i] == frame || chunk->dirty
+                         || chunk->mips_version != chunk->version || chunk->material_block->references.load() > 1)
+                                continue;
+                        order.push_back({-chunk_distance(chunk, camera_voxel), i});
+                }
+                std::sort(order.begin(), order.end(), [&](const std::pair<float, int>& a, const std::pair<float, int>& b) {
+                        uint64_t used_a = cache->used[a.second], used_b = cache->used[b.second];
+                        return used_a != used_b ? used_a < used_b : a.first < b.first;
+                });
+                for (size_t o = 0 ; o < order.size() && stats.resident_bytes > cache->ram_budget ; o++)
+                {
+                        int index = order[o].second;
+                        if (!evict(cache, world, index))
+                                continue;
+                        const ChunkMaterial* block = world->chunks[index]->material_block;
+                        stats.resident_bytes -= sizeof(ChunkMaterial);
+                        stats.tiers[CHUNK_RESIDENT]--;
+                        stats.tiers[block->tier]++;
+                        if (block->tier == CHUNK_PACKED)
+                                stats.packed_bytes += block->size;
+                        stats.evicted++;
+                }
+        }
+
+        // the oldest packed payloads go to disk
+        reclaim_spilled(cache);
+        if (stats.packed_bytes > cache->packed_budget && cache->spill)
+        {
+                order.clear();
+                for (int i = 0 ; i < count ; i++)
+                        if (world->chunks[i] && world->chunks[i]->material_block->tier == CHUNK_PACKED)
+                                order.push_back({0.0f, i});
+                std::sort(order.begin(), order.end(), [&](const std::pair<float, int>& a, const std::pair<float, int>& b) {
+                        return cache->used[a.second] < cache->used[b.second];
+                });
+                for (size_t o = 0 ; o < order.size() && stats.packed_bytes > cache->packed_budget ; o++)
+                {
+                        int index = order[o].second;
+                        size_t size = world->chunks[index]->material_block->size;
+                        if (!spill(cache, world, index))
+                                break;
+                        stats.packed_bytes -= size;
+                        stats.tiers[CHUNK_PACKED]--;
+                        stats.tiers[CHUNK_SPILLED]++;
+                        stats.spilled++;
+                }
+        }
+
+        stats.spilled_bytes = cache->spilled_bytes;
+        stats.restored = restored;
+        stats.used = used;
+        stats.by_distance = visible == NULL;
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        cache->stats = stats;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "frustum.h"
+#include "generator_cache.h"
+#include "slot_pool.h"
+
+// material blocks kept resident before the least recently used ones are evicted
+#define CHUNK_CACHE_RAM_BUDGET (256u << 20)
+// run length encoded blocks kept in memory before the oldest go to the spill file
+#define CHUNK_CACHE_PACKED_BUDGET (32u << 20)
+// chunks this far from the camera's chunk (per axis) count as used every frame and are never evicted
+#define CHUNK_CACHE_KEEP_RADIUS 2
+// without a visible list (gpu culling keeps it on the gpu) chunks this far count as used instead
+#define CHUNK_CACHE_VIEW_RADIUS 8
+// evicted chunks brought back per frame once they are used again, nearest first
+#define CHUNK_CACHE_RESTORES_PER_FRAME 4
+// the spill file is handed out in pages, the pages of a spilled block nothing holds any more are written again
+#define CHUNK_CACHE_SPILL_PAGE 4096
+
+typedef struct ChunkCacheStats
+{
+        // chunks in each ChunkTier
+        int tiers[4];
+        // distinct resident blocks, packed payloads in memory, and the payloads in the spill file still held
+        size_t resident_bytes, packed_bytes, spilled_bytes;
+        // over the last update. by_distance when there was no visible list and use was guessed from
+        // CHUNK_CACHE_VIEW_RADIUS, used is how many chunks counted as used
+        int evicted, spilled, restored;
+        int used;
+        bool by_distance;
+        double milliseconds;
+}ChunkCacheStats;
+
+// bounds the memory chunk material takes as the camera explores. the material blocks of chunks that
+// haven't been visible or near the camera for the longest (further away first on a tie) are evicted
+// once the resident ones pass the ram budget: to nothing when the chunk is still what the generator
+// makes, else run length encoded in memory, and from there to a spill file once those pass the packed
+// budget. occupancy and mips stay with the chunk, so culling, meshing and ray casts never notice.
+// chunks come back resident when an edit writes them (chunk_material_write) or when they are used again
+typedef struct ChunkCache
+{
+        size_t ram_budget, packed_budget;
+        // optional, unedited chunks are dropped instead of packed
+        GeneratorCache* generator;
+
+        // frame each chunk was last visible, near the camera or edited in
+        std::vector<uint64_t> used;
+        uint64_t frame;
+
+        // evicted blocks read their spilled payloads back from it, so it stays open until the cache is destroyed
+        FILE* spill;
+        SlotPool spill_pages;
+        // every spilled block, with a reference of the cache's own: once it is the only one left no chunk
+        // or snapshot can read the block any more and its pages are freed
+        std::vector<ChunkMaterial*> spilled;
+        size_t spilled_bytes;
+
+        ChunkCacheStats stats;
+}ChunkCache;
+
+int chunk_cache_init(ChunkCache* cache, const World* world, size_t ram_budget, size_t packed_budget, GeneratorCache* generator);
+// after the world and its chunk store: blocks still spilled read from the file until then
+void chunk_cache_destroy(ChunkCache* cache);
+
+// world thread, before chunk_store_publish. visible is what was drawn last frame, NULL when that isn't
+// known on the cpu (chunks within CHUNK_CACHE_VIEW_RADIUS count as used then). brings used chunks back,
+// then evicts down to the budgets
+void chunk_cache_update(ChunkCache* cache, World* world, glm::vec3 camera_voxel, const VisibleChunks* visible);
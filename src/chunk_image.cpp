@@ -0,0 +1,42 @@
+#include "chunk_image.h"
+#include "lod.h"
+
+#include <string.h>
+
+
+void chunk_image_pack(const Chunk* chunk, uint8_t* image)
+{
+        // an evicted chunk is unpacked straight into the image
+        uint8_t* texels = image + CHUNK_IMAGE_TEXELS;
+        const uint8_t* material = chunk_material_read(chunk, texels);
+        if (material != texels)
+                memcpy(texels, material, CHUNK_VOLUME);
+
+        uint32_t* slabs = (uint32_t*)(image + CHUNK_IMAGE_SLABS);
+        for (int axis = 0 ; axis < 3 ; axis++)
+                bitslab_pack_chunk(chunk->occupancy, axis, slabs + axis*BITSLAB_CHUNK_TEXELS);
+
+        // a snapshot chunk can't be written, so its mips aren't rebuilt in place
+        if (chunk->mips_version == chunk->version)
+                memcpy(image + CHUNK_IMAGE_MIPS, chunk->material_mips, CHUNK_MIP_BYTES);
+        else
+        {
+                uint64_t occupancy_mips[CHUNK_MIP_COLUMNS];
+                lod_build_mips(chunk->occupancy, texels, occupancy_mips, image + CHUNK_IMAGE_MIPS);
+        }
+
+        memset(image + CHUNK_IMAGE_MIPS + CHUNK_MIP_BYTES, 0, CHUNK_IMAGE_OCCUPANCY - CHUNK_IMAGE_MIPS - CHUNK_MIP_BYTES);
+        memcpy(image + CHUNK_IMAGE_OCCUPANCY, chunk->occupancy, sizeof(chunk->occupancy));
+        size_t end = CHUNK_IMAGE_OCCUPANCY + sizeof(chunk->occupancy);
+        memset(image + end, 0, CHUNK_IMAGE_BYTES - end);
+}
+
+
+void chunk_image_unpack(Chunk* chunk, const uint8_t* image)
+{
+        uint8_t* voxels = chunk_material_write(chunk);
+        if (voxels == NULL)
+                return;
+        memcpy(voxels, image + CHUNK_IMAGE_TEXELS, CHUNK_VOLUME);
+        memcpy(chunk->occupancy, image + CHUNK_IMAGE_OCCUPANCY, sizeof(chunk->occupancy));
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bitslab.h"
+#include "chunk.h"
+
+// a whole chunk laid out the way the upload worker stages it, byte for byte, so a chunk kept like
+// this goes from disk to the gpu without being decoded or repacked:
+//   material texels, x fastest like the 3D texture
+//   the bit slabs of the three axes, axis after axis (see bitslab.h)
+//   the material mips, levels 1.. (see lod.h)
+//   the occupancy columns, as they sit in the ssbo
+#define CHUNK_IMAGE_TEXELS 0
+#define CHUNK_IMAGE_SLABS CHUNK_VOLUME
+#define CHUNK_IMAGE_SLAB_BYTES (3*BITSLAB_CHUNK_TEXELS*sizeof(uint32_t))
+#define CHUNK_IMAGE_MIPS (CHUNK_IMAGE_SLABS + CHUNK_IMAGE_SLAB_BYTES)
+#define CHUNK_IMAGE_OCCUPANCY ((CHUNK_IMAGE_MIPS + CHUNK_MIP_BYTES + 7) & ~(size_t)7)
+// whole pages, so images back to back in a file or a staging buffer all start page aligned
+#define CHUNK_IMAGE_BYTES ((CHUNK_IMAGE_OCCUPANCY + CHUNK_COLUMNS*sizeof(uint64_t) + 4095) & ~(size_t)4095)
+
+// reads the chunk only, stale mips are reduced straight into the image
+void chunk_image_pack(const Chunk* chunk, uint8_t* image);
+// material and occupancy back out of an image, the mips are left for the next upload to rebuild
+void chunk_image_unpack(Chunk* chunk, const uint8_t* image);
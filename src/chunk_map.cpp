@@ -0,0 +1,264 @@
+#include "chunk_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "chunk.h"
+
+
+// splitmix64's finalizer, the packed coordinates differ mostly in their low bits
+static uint64_t key_hash(uint64_t key)
+{
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ull;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebull;
+        return key ^ (key >> 31);
+}
+
+
+// the top 7 bits go in the control byte, the low bits pick the first group
+static int8_t hash_tag(uint64_t hash)
+{
+        return (int8_t)(hash >> 57);
+}
+
+
+// bit i set where the control byte of slot i of the group equals tag
+static uint32_t group_match(const int8_t* control, int8_t tag)
+{
+#if defined(__SSE2__)
+        __m128i group = _mm_load_si128((const __m128i*)control);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+#else
+        uint32_t bits = 0;
+        for (int i = 0 ; i < CHUNK_MAP_GROUP ; i++)
+                bits |= (uint32_t)(control[i] == tag) << i;
+        return bits;
+#endif
+}
+
+
+// empty and deleted are the only negative control bytes
+static uint32_t group_free(const int8_t* control)
+{
+#if defined(__SSE2__)
+        return _mm_movemask_epi8(_mm_load_si128((const __m128i*)control));
+#else
+        uint32_t bits = 0;
+        for (int i = 0 ; i < CHUNK_MAP_GROUP ; i++)
+                bits |= (uint32_t)(control[i] < 0) << i;
+        return bits;
+#endif
+}
+
+
+static int allocate(ChunkMap* map, size_t capacity)
+{
+        // aligned so a group loads with one aligned sse2 load
+        map->control = (int8_t*) aligned_alloc(CHUNK_MAP_GROUP, capacity);
+        map->keys = (uint64_t*) malloc(capacity*sizeof(uint64_t));
+        map->values = (int*) malloc(capacity*sizeof(int));
+        if (map->control == NULL || map->keys == NULL || map->values == NULL)
+        {
+                free(map->control);
+                free(map->keys);
+                free(map->values);
+                map->control = NULL;
+                map->keys = NULL;
+                map->values = NULL;
+                return -1;
+        }
+        memset(map->control, CHUNK_MAP_EMPTY, capacity);
+        map->capacity = capacity;
+        map->count = 0;
+        map->deleted = 0;
+        return 0;
+}
+
+
+int chunk_map_init(ChunkMap* map, size_t expected)
+{
+        // at most 7/8 full before it grows
+        size_t capacity = CHUNK_MAP_GROUP;
+        while (capacity*7/8 < expected)
+                capacity *= 2;
+        return allocate(map, capacity);
+}
+
+
+void chunk_map_destroy(ChunkMap* map)
+{
+        free(map->control);
+        free(map->keys);
+        free(map->values);
+        map->control = NULL;
+        map->keys = NULL;
+        map->values = NULL;
+        map->capacity = map->count = map->deleted = 0;
+}
+
+
+void chunk_map_clear(ChunkMap* map)
+{
+        if (map->control)
+                memset(map->control, CHUNK_MAP_EMPTY, map->capacity);
+        map->count = 0;
+        map->deleted = 0;
+}
+
+
+// slot holding key, -1 if it isn't there
+static long find_slot(const ChunkMap* map, uint64_t key, uint64_t hash)
+{
+        if (map->control == NULL)
+                return -1;
+        int8_t tag = hash_tag(hash);
+        size_t groups = map->capacity / CHUNK_MAP_GROUP;
+        size_t group = hash & (groups - 1);
+        for (size_t step = 1 ; step <= groups ; step++)
+        {
+                const int8_t* control = map->control + group*CHUNK_MAP_GROUP;
+                for (uint32_t match = group_match(control, tag) ; match ; match &= match - 1)
+                {
+                        size_t slot = group*CHUNK_MAP_GROUP + __builtin_ctz(match);
+                        if (map->keys[slot] == key)
+                                return slot;
+                }
+                if (group_match(control, CHUNK_MAP_EMPTY))
+                        return -1;
+                // triangular steps visit every group of a power of two table
+                group = (group + step) & (groups - 1);
+        }
+        return -1;
+}
+
+
+// first empty or deleted slot along key's probe sequence, the table has room
+static size_t free_slot(const ChunkMap* map, uint64_t hash)
+{
+        size_t groups = map->capacity / CHUNK_MAP_GROUP;
+        size_t group = hash & (groups - 1);
+        for (size_t step = 1 ; ; step++)
+        {
+                uint32_t free = group_free(map->control + group*CHUNK_MAP_GROUP);
+                if (free)
+                        return group*CHUNK_MAP_GROUP + __builtin_ctz(free);
+                group = (group + step) & (groups - 1);
+        }
+}
+
+
+// into a table of capacity slots, which also drops the deleted ones
+static int rehash(ChunkMap* map, size_t capacity)
+{
+        ChunkMap old = *map;
+        if (allocate(map, capacity) != 0)
+        {
+                *map = old;
+                return -1;
+        }
+        for (size_t slot = 0 ; slot < old.capacity ; slot++)
+        {
+                if (old.control[slot] < 0)
+                        continue;
+                uint64_t hash = key_hash(old.keys[slot]);
+                size_t to = free_slot(map, hash);
+                map->control[to] = hash_tag(hash);
+                map->keys[to] = old.keys[slot];
+                map->values[to] = old.values[slot];
+                map->count++;
+        }
+        chunk_map_destroy(&old);
+        return 0;
+}
+
+
+int chunk_map_find(const ChunkMap* map, glm::ivec3 coord)
+{
+        uint64_t key = chunk_coord_key(coord);
+        long slot = find_slot(map, key, key_hash(key));
+        return slot < 0 ? -1 : map->values[slot];
+}
+
+
+int chunk_map_insert(ChunkMap* map, glm::ivec3 coord, int value)
+{
+        uint64_t key = chunk_coord_key(coord);
+        uint64_t hash = key_hash(key);
+        long slot = find_slot(map, key, hash);
+        if (slot >= 0)
+        {
+                map->values[slot] = value;
+                return 0;
+        }
+
+        if ((map->count + map->deleted + 1)*8 > map->capacity*7)
+        {
+                // mostly tombstones: the same size is enough
+                size_t capacity = (map->count + 1)*8 > map->capacity*7/2 ? map->capacity*2 : map->capacity;
+                if (map->control == NULL)
+                        capacity = CHUNK_MAP_GROUP;
+                if (rehash(map, capacity) != 0)
+                        return -1;
+        }
+        size_t to = free_slot(map, hash);
+        map->deleted -= map->control[to] == CHUNK_MAP_DELETED;
+        map->control[to] = hash_tag(hash);
+        map->keys[to] = key;
+        map->values[to] = value;
+        map->count++;
+        return 0;
+}
+
+
+bool chunk_map_remove(ChunkMap* map, glm::ivec3 coord)
+{
+        uint64_t key = chunk_coord_key(coord);
+        long slot = find_slot(map, key, key_hash(key));
+        if (slot < 0)
+                return false;
+        // a probe ends at a group with an empty slot anyway, so in one the slot can go back to empty
+        const int8_t* group = map->control + (slot & ~(long)(CHUNK_MAP_GROUP - 1));
+        if (group_match(group, CHUNK_MAP_EMPTY))
+                map->control[slot] = CHUNK_MAP_EMPTY;
+        else
+        {
+                map->control[slot] = CHUNK_MAP_DELETED;
+                map->deleted++;
+        }
+        map->count--;
+        return true;
+}
+
+
+// offset from the centre as an index into ChunkNeighbourhood::indices, -1 outside the 3x3x3
+static int neighbourhood_slot(glm::ivec3 offset)
+{
+        if ((unsigned)(offset.x+1) > 2u || (unsigned)(offset.y+1) > 2u || (unsigned)(offset.z+1) > 2u)
+                return -1;
+        return (offset.x+1) + (offset.y+1)*3 + (offset.z+1)*9;
+}
+
+
+void chunk_neighbourhood_move(ChunkNeighbourhood* neighbourhood, const ChunkMap* map, glm::ivec3 center)
+{
+        glm::ivec3 moved = center - neighbourhood->center;
+        if (neighbourhood->valid && moved == glm::ivec3(0))
+                return;
+        int indices[27];
+        for (int z = -1 ; z <= 1 ; z++)
+        for (int y = -1 ; y <= 1 ; y++)
+        for (int x = -1 ; x <= 1 ; x++)
+        {
+                int old = neighbourhood->valid ? neighbourhood_slot(moved + glm::ivec3(x, y, z)) : -1;
+                indices[(x+1) + (y+1)*3 + (z+1)*9] = old >= 0 ? neighbourhood->indices[old] : chunk_map_find(map, center + glm::ivec3(x, y, z));
+        }
+        memcpy(neighbourhood->indices, indices, sizeof(indices));
+        neighbourhood->center = center;
+        neighbourhood->valid = true;
+}
+
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+// slots probed together, one sse2 compare of their control bytes
+#define CHUNK_MAP_GROUP 16
+#define CHUNK_MAP_EMPTY ((int8_t)-128)
+#define CHUNK_MAP_DELETED ((int8_t)-2)
+
+// chunk coordinate to chunk index, open addressing over groups of CHUNK_MAP_GROUP slots (swiss table
+// style). keys are chunk_coord_key, each slot has a control byte holding 7 bits of the key's hash, so a
+// probe compares a whole group of them at once and only reads the keys that matched. groups are probed
+// quadratically and a group with an empty slot ends the probe
+typedef struct ChunkMap
+{
+        // a control byte, key and value per slot. capacity is a power of two, at least a group
+        int8_t* control;
+        uint64_t* keys;
+        int* values;
+        size_t capacity, count, deleted;
+}ChunkMap;
+
+// the 3x3x3 chunks around center, for code that looks at a chunk's neighbours chunk after chunk
+typedef struct ChunkNeighbourhood
+{
+        glm::ivec3 center;
+        // x fastest, -1 where there is no chunk
+        int indices[27];
+        bool valid;
+}ChunkNeighbourhood;
+
+int chunk_map_init(ChunkMap* map, size_t expected);
+void chunk_map_destroy(ChunkMap* map);
+void chunk_map_clear(ChunkMap* map);
+
+// the value stored for coord, -1 if none
+int chunk_map_find(const ChunkMap* map, glm::ivec3 coord);
+// adds or replaces coord, -1 when out of memory
+int chunk_map_insert(ChunkMap* map, glm::ivec3 coord, int value);
+// false if coord wasn't there
+bool chunk_map_remove(ChunkMap* map, glm::ivec3 coord);
+
+// centres the neighbourhood on center, only the chunks the old box didn't cover are looked up.
+// the map must not change while a neighbourhood of it is in use (set valid to false after it does)
+void chunk_neighbourhood_move(ChunkNeighbourhood* neighbourhood, const ChunkMap* map, glm::ivec3 center);
+
+// the value stored for coord, without probing when it is in the cached 3x3x3, else the neighbourhood moves to it
+inline int chunk_neighbourhood_find(ChunkNeighbourhood* neighbourhood, const ChunkMap* map, glm::ivec3 coord)
+{
+        glm::ivec3 o = coord - neighbourhood->center + 1;
+        if (!neighbourhood->valid || (unsigned)o.x > 2u || (unsigned)o.y > 2u || (unsigned)o.z > 2u)
+        {
+                chunk_neighbourhood_move(neighbourhood, map, coord);
+                return neighbourhood->indices[13];
+        }
+        return neighbourhood->indices[o.x + o.y*3 + o.z*9];
+}
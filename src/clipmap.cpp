@@ -0,0 +1,104 @@
+#include "clipmap.h"
+
+#include <string.h>
+#include <chrono>
+
+#include "lod.h"
+
+
+int clipmap_init(Clipmap* clipmap)
+{
+        for (int level = 0 ; level < CLIPMAP_LEVELS ; level++)
+        {
+                int chunks = clipmap_chunks(level);
+                clipmap->origin[level] = glm::ivec3(0);
+                // nothing valid yet, the first update writes every block
+                clipmap->blocks[level].assign(chunks*chunks*chunks, ClipmapBlock{});
+        }
+        clipmap->uploads.clear();
+        clipmap->staging.clear();
+        clipmap->uploaded_blocks = 0;
+        clipmap->milliseconds = 0.0;
+        return 0;
+}
+
+
+void clipmap_destroy(Clipmap* clipmap)
+{
+        for (int level = 0 ; level < CLIPMAP_LEVELS ; level++)
+                clipmap->blocks[level].clear();
+        clipmap->uploads.clear();
+        clipmap->staging.clear();
+}
+
+
+// level's cells of chunk (NULL for air) into texels, size^3 bytes
+static void block_texels(const Chunk* chunk, int level, uint8_t* texels)
+{
+        int size = CHUNK_SIZE >> level;
+        if (chunk == NULL)
+                memset(texels, 0, (size_t)size*size*size);
+        else if (level == 0)
+        {
+                // an evicted chunk is unpacked straight into place
+                const uint8_t* material = chunk_material_read(chunk, texels);
+                if (material != texels)
+                        memcpy(texels, material, CHUNK_VOLUME);
+        }
+        else
+        {
+                uint8_t scratch[CHUNK_MIP_BYTES];
+                const uint8_t* mips = chunk_material_mips_read(chunk, scratch);
+                memcpy(texels, mips + chunk_mip_offset(level), (size_t)size*size*size);
+        }
+}
+
+
+void clipmap_update(Clipmap* clipmap, const World* world, glm::vec3 camera_voxel)
+{
+        auto start = std::chrono::steady_clock::now();
+        clipmap->uploads.clear();
+        clipmap->staging.clear();
+        clipmap->uploaded_blocks = 0;
+
+        // windows are centred on the chunk corner nearest the camera
+        glm::ivec3 center = glm::ivec3(glm::floor(camera_voxel / (float)CHUNK_SIZE + 0.5f));
+        for (int level = 0 ; level < CLIPMAP_LEVELS ; level++)
+        {
+                int chunks = clipmap_chunks(level);
+                int size = CHUNK_SIZE >> level;
+                glm::ivec3 origin = center - chunks/2;
+                clipmap->origin[level] = origin;
+
+                for (int z = 0 ; z < chunks ; z++)
+                for (int y = 0 ; y < chunks ; y++)
+                for (int x = 0 ; x < chunks ; x++)
+                {
+                        // chunks is a power of two, so the mask wraps negative coordinates too
+                        glm::ivec3 coord = origin + glm::ivec3(x, y, z);
+                        glm::ivec3 wrapped = coord & (chunks - 1);
+                        ClipmapBlock* block = &clipmap->blocks[level][wrapped.x + wrapped.y*chunks + wrapped.z*chunks*chunks];
+                        int index = world_chunk_find(world, coord);
+                        const Chunk* chunk = index >= 0 ? world->chunks[index] : NULL;
+                        unsigned int version = chunk ? chunk->version : 0;
+                        if (block->valid && block->coord == coord && block->chunk == index && block->version == version)
+                                continue;
+
+                        size_t offset = clipmap->staging.size();
+                        clipmap->staging.resize(offset + (size_t)size*size*size);
+                        block_texels(chunk, level, &clipmap->staging[offset]);
+                        ClipmapUpload upload;
+                        upload.texel = wrapped*size + glm::ivec3(0, 0, level*CLIPMAP_SIZE);
+                        upload.size = size;
+                        upload.offset = offset;
+                        clipmap->uploads.push_back(upload);
+
+                        block->coord = coord;
+                        block->chunk = index;
+                        block->version = version;
+                        block->valid = true;
+                        clipmap->uploaded_blocks++;
+                }
+        }
+        clipmap->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
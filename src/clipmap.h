@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+
+// nested levels, level L holds chunk mip L (2^L voxels per texel)
+#define CLIPMAP_LEVELS 4
+// texels per side of every level, so level L spans CLIPMAP_SIZE << L voxels
+#define CLIPMAP_SIZE 128
+
+// one chunk's texels of a level, copied into the texture at texel (the level's z offset included)
+typedef struct ClipmapUpload
+{
+        glm::ivec3 texel;
+        int size;
+        // into Clipmap::staging, size^3 bytes x fastest
+        size_t offset;
+}ClipmapUpload;
+
+// what a block of a level holds
+typedef struct ClipmapBlock
+{
+        glm::ivec3 coord;
+        // world index, -1 for air outside the world
+        int chunk;
+        unsigned int version;
+        bool valid;
+}ClipmapBlock;
+
+// the voxels around the camera as nested cubes of CLIPMAP_SIZE texels, one per level, stacked along z in
+// one 3D texture. every level is addressed toroidally: the cell c of level L lives at texel c mod
+// CLIPMAP_SIZE, so when a level's window moves by a chunk the chunks leaving it free exactly the texels
+// the entering ones need and only that boundary slice is written. windows move a whole chunk at a time,
+// so a chunk's block never wraps. edited chunks inside a window are written again too
+typedef struct Clipmap
+{
+        // first chunk of every level's window, it spans clipmap_chunks(L) chunks per axis
+        glm::ivec3 origin[CLIPMAP_LEVELS];
+        // what sits in every block of every level, indexed by the block's toroidal position
+        std::vector<ClipmapBlock> blocks[CLIPMAP_LEVELS];
+
+        // written by clipmap_update, for the render thread to copy into the texture
+        std::vector<ClipmapUpload> uploads;
+        std::vector<uint8_t> staging;
+
+        // over the last update
+        int uploaded_blocks;
+        double milliseconds;
+}Clipmap;
+
+// chunks per axis of level's window
+inline int clipmap_chunks(int level)
+{
+        return CLIPMAP_SIZE / (CHUNK_SIZE >> level);
+}
+
+// bytes of the texture, every level included
+inline size_t clipmap_texture_bytes()
+{
+        return (size_t)CLIPMAP_SIZE*CLIPMAP_SIZE*CLIPMAP_SIZE*CLIPMAP_LEVELS;
+}
+
+int clipmap_init(Clipmap* clipmap);
+void clipmap_destroy(Clipmap* clipmap);
+
+// recentres the windows on the camera and lists the blocks that entered a window or changed since they
+// were written. only reads the world, so the render thread runs it on a snapshot (whose mips the upload
+// has rebuilt), stale mips are built on the side
+void clipmap_update(Clipmap* clipmap, const World* world, glm::vec3 camera_voxel);
+
+// first texel of every level's window in its own cells, for the shader
+inline glm::ivec3 clipmap_level_origin(const Clipmap* clipmap, int level)
+{
+        return clipmap->origin[level] * (CHUNK_SIZE >> level);
+}
@@ -0,0 +1,129 @@
+#include "dedup.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+
+static double now_seconds()
+{
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// multiply xorshift over 8 byte words, four independent lanes so the multiplies overlap.
+// uniform is whether every byte equals the first
+static uint64_t material_hash(const uint8_t* material, bool* uniform)
+{
+        uint64_t splat = material[0] * 0x0101010101010101ull;
+        uint64_t lanes[4] = { 0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull, 0x2545f4914f6cdd1dull };
+        uint64_t differ = 0;
+        for (int i = 0 ; i < CHUNK_VOLUME ; i += 32)
+        {
+                for (int l = 0 ; l < 4 ; l++)
+                {
+                        uint64_t word;
+                        memcpy(&word, material + i + l*8, sizeof(word));
+                        differ |= word ^ splat;
+                        lanes[l] = (lanes[l] ^ word) * 0xff51afd7ed558ccdull;
+                        lanes[l] ^= lanes[l] >> 29;
+                }
+        }
+        *uniform = differ == 0;
+
+        uint64_t hash = 0;
+        for (int l = 0 ; l < 4 ; l++)
+        {
+                hash = (hash ^ lanes[l]) * 0xc4ceb9fe1a85ec53ull;
+                hash ^= hash >> 32;
+        }
+        return hash;
+}
+
+
+int chunk_dedup_init(ChunkDedup* dedup, const World* world)
+{
+        int count = world_chunk_count(world);
+        // no chunk is at this version yet, so the first pass hashes everything
+        dedup->version.assign(count, ~0u);
+        dedup->hash.assign(count, 0);
+        dedup->blocks.clear();
+        dedup->last_pass = 0.0;
+        dedup->stats = {};
+        return 0;
+}
+
+
+void chunk_dedup_destroy(ChunkDedup* dedup)
+{
+        dedup->version.clear();
+        dedup->hash.clear();
+        dedup->blocks.clear();
+}
+
+
+int chunk_dedup_world(ChunkDedup* dedup, World* world, bool force)
+{
+        double start = now_seconds();
+        if (!force && start - dedup->last_pass < CHUNK_DEDUP_SECONDS)
+                return 0;
+        dedup->last_pass = start;
+
+        // the table only points at blocks chunks hold right now, so it is built again rather than kept
+        // holding references of its own (which would make every sole owner copy its block on the next edit)
+        dedup->blocks.clear();
+        DedupStats stats = {};
+        int moved = 0;
+        for (int i = 0 ; i < world_chunk_count(world) ; i++)
+        {
+                Chunk* chunk = world->chunks[i];
+                // evicted by the chunk cache, its tag stays what it was
+                if (chunk == NULL || chunk->material == NULL)
+                        continue;
+                stats.chunks++;
+
+                if (dedup->version[i] != chunk->version)
+                {
+                        bool uniform;
+                        dedup->hash[i] = material_hash(chunk->material, &uniform);
+                        dedup->version[i] = chunk->version;
+                        if (world->tags)
+                                world->tags[i] = !uniform ? CHUNK_TAG_MIXED : chunk->material[0] ? CHUNK_TAG_SOLID : CHUNK_TAG_EMPTY;
+                }
+                if (world->tags)
+                {
+                        stats.empty += world->tags[i] == CHUNK_TAG_EMPTY;
+                        stats.solid += world->tags[i] == CHUNK_TAG_SOLID;
+                }
+
+                uint64_t hash = dedup->hash[i];
+                ChunkMaterial* match = NULL;
+                auto range = dedup->blocks.equal_range(hash);
+                for (auto it = range.first ; it != range.second && match == NULL ; ++it)
+                        if (it->second == chunk->material_block || memcmp(it->second->voxels, chunk->material, CHUNK_VOLUME) == 0)
+                                match = it->second;
+
+                if (match == NULL)
+                {
+                        dedup->blocks.insert({hash, chunk->material_block});
+                        continue;
+                }
+                stats.shared++;
+                if (match == chunk->material_block)
+                        continue;
+
+                // snapshots may be reading the chunk, so the block is swapped on a private copy of it
+                chunk = world_chunk_own(world, i);
+                if (chunk == NULL)
+                        continue;
+                chunk_material_share(chunk, match);
+                moved++;
+        }
+
+        stats.blocks = (int)dedup->blocks.size();
+        stats.bytes_unshared = (size_t)stats.chunks*CHUNK_VOLUME;
+        stats.bytes_resident = (size_t)stats.blocks*sizeof(ChunkMaterial);
+        stats.milliseconds = (now_seconds() - start) * 1000.0;
+        dedup->stats = stats;
+        return moved;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "chunk.h"
+
+// how often the world thread looks for chunks that became identical, edits in between just unshare
+#define CHUNK_DEDUP_SECONDS 5.0
+
+typedef struct DedupStats
+{
+        int chunks, empty, solid;
+        // distinct blocks, and the chunks that got away without one of their own
+        int blocks, shared;
+        // chunk material with a block per chunk, and what the distinct blocks take
+        size_t bytes_unshared, bytes_resident;
+        double milliseconds;
+}DedupStats;
+
+// content addressed chunk material: every chunk is hashed once per version, chunks with the same
+// voxels are pointed at one block (copy on write through chunk_material_write) and uniform chunks
+// are tagged in the chunk index so the renderers can skip the empty ones without reading them.
+// all air and all solid chunks end up sharing one block per material
+typedef struct ChunkDedup
+{
+        // chunk version and content hash of the last pass
+        std::vector<unsigned int> version;
+        std::vector<uint64_t> hash;
+        // distinct blocks by hash, rebuilt every pass from the chunks holding them
+        std::unordered_multimap<uint64_t, ChunkMaterial*> blocks;
+        // steady clock seconds
+        double last_pass;
+        DedupStats stats;
+}ChunkDedup;
+
+int chunk_dedup_init(ChunkDedup* dedup, const World* world);
+void chunk_dedup_destroy(ChunkDedup* dedup);
+
+// world thread, before chunk_store_publish: once CHUNK_DEDUP_SECONDS have passed (or when forced)
+// hashes the chunks edited since the last pass, updates their tags and shares identical blocks.
+// returns how many chunks were moved onto another block
+int chunk_dedup_world(ChunkDedup* dedup, World* world, bool force);
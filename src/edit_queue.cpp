@@ -0,0 +1,94 @@
+#include "edit_queue.h"
+
+#include <string.h>
+#include <chrono>
+
+
+void edit_queue_init(EditQueue* queue)
+{
+        for (unsigned int i = 0 ; i < EDIT_QUEUE_SIZE ; i++)
+                queue->slots[i].sequence.store(i, std::memory_order_relaxed);
+        queue->head.store(0, std::memory_order_relaxed);
+        queue->tail = 0;
+        queue->rejected.store(0, std::memory_order_relaxed);
+}
+
+
+bool edit_queue_push(EditQueue* queue, const Brush* brush)
+{
+        unsigned int position = queue->head.load(std::memory_order_relaxed);
+        while (true)
+        {
+                EditSlot* slot = &queue->slots[position & (EDIT_QUEUE_SIZE-1)];
+                int difference = (int)(slot->sequence.load(std::memory_order_acquire) - position);
+                if (difference == 0)
+                {
+                        // on failure position is reloaded with the current head
+                        if (queue->head.compare_exchange_weak(position, position+1, std::memory_order_relaxed))
+                        {
+                                slot->brush = *brush;
+                                slot->sequence.store(position+1, std::memory_order_release);
+                                return true;
+                        }
+                }
+                else if (difference < 0)
+                {
+                        // the consumer hasn't freed this slot from the previous lap yet
+                        queue->rejected.fetch_add(1, std::memory_order_relaxed);
+                        return false;
+                }
+                else
+                        position = queue->head.load(std::memory_order_relaxed);
+        }
+}
+
+
+bool edit_queue_pop(EditQueue* queue, Brush* brush)
+{
+        EditSlot* slot = &queue->slots[queue->tail & (EDIT_QUEUE_SIZE-1)];
+        if (slot->sequence.load(std::memory_order_acquire) != queue->tail+1)
+                return false;
+        *brush = slot->brush;
+        slot->sequence.store(queue->tail + EDIT_QUEUE_SIZE, std::memory_order_release);
+        queue->tail++;
+        return true;
+}
+
+
+static bool same_brush(const Brush* a, const Brush* b)
+{
+        return a->shape == b->shape && a->op == b->op && a->material == b->material
+            && a->center == b->center && a->extent == b->extent;
+}
+
+
+int edit_queue_drain(EditQueue* queue, World* world, EditStats* stats)
+{
+        auto start = std::chrono::steady_clock::now();
+        memset(stats, 0, sizeof(EditStats));
+
+        // only the world thread gets here, the dirty list keeps its capacity between drains
+        static BrushResult result;
+        Brush brush, previous = {};
+        int applied = 0;
+        // bounded so producers that keep pushing can't hold the tick up
+        while (stats->commands < EDIT_QUEUE_SIZE && edit_queue_pop(queue, &brush))
+        {
+                stats->commands++;
+                // applying a brush twice in a row changes nothing the second time
+                if (applied && same_brush(&brush, &previous))
+                {
+                        stats->coalesced++;
+                        continue;
+                }
+                brush_apply(world, &brush, &result);
+                stats->voxels += result.voxels;
+                stats->boxes += (int)result.dirty.size();
+                previous = brush;
+                applied++;
+        }
+
+        stats->rejected = queue->rejected.exchange(0, std::memory_order_relaxed);
+        stats->microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        return applied;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+
+#include "brush.h"
+
+// slots in the ring, a power of two. a full ring rejects the edit rather than blocking the producer
+#define EDIT_QUEUE_SIZE 1024
+
+// sequence == position: free for the producer claiming position.
+// sequence == position+1: written, ready for the consumer
+typedef struct EditSlot
+{
+        std::atomic<unsigned int> sequence;
+        Brush brush;
+}EditSlot;
+
+// bounded multi producer single consumer ring of brush edits. any thread (input, scripts, network)
+// pushes without taking a lock, the thread that owns the world drains it once per tick
+typedef struct EditQueue
+{
+        EditSlot slots[EDIT_QUEUE_SIZE];
+        // producers race for head with a compare exchange, only the consumer touches tail
+        alignas(64) std::atomic<unsigned int> head;
+        alignas(64) unsigned int tail;
+        std::atomic<int> rejected;
+}EditQueue;
+
+// what the last drain did
+typedef struct EditStats
+{
+        int commands, coalesced, rejected;
+        int voxels, boxes;
+        double microseconds;
+}EditStats;
+
+void edit_queue_init(EditQueue* queue);
+
+// any thread, false when the ring is full
+bool edit_queue_push(EditQueue* queue, const Brush* brush);
+// consumer only, false when nothing is ready
+bool edit_queue_pop(EditQueue* queue, Brush* brush);
+
+// world thread: applies everything queued so far. repeats of the same brush (a held button, a script
+// in a loop) are dropped, the rest only grow the chunk dirty boxes so a whole burst goes out as
+// one upload per chunk. returns the number of brushes applied
+int edit_queue_drain(EditQueue* queue, World* world, EditStats* stats);
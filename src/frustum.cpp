@@ -0,0 +1,175 @@
+#include "frustum.h"
+
+#include <chrono>
+
+#include <immintrin.h>
+
+
+void frustum_extract(Frustum* frustum, glm::mat4 view_projection)
+{
+        // glm is column major, m[column][row]
+        const glm::mat4& m = view_projection;
+        glm::vec4 row[4];
+        for (int i = 0 ; i < 4 ; i++)
+                row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+        frustum->planes[0] = row[3] + row[0];
+        frustum->planes[1] = row[3] - row[0];
+        frustum->planes[2] = row[3] + row[1];
+        frustum->planes[3] = row[3] - row[1];
+        frustum->planes[4] = row[3] + row[2];
+        frustum->planes[5] = row[3] - row[2];
+
+        for (int i = 0 ; i < 6 ; i++)
+                frustum->planes[i] /= glm::length(glm::vec3(frustum->planes[i]));
+}
+
+
+void chunk_bounds_build(ChunkBounds* bounds, const World* world)
+{
+        int count = world_chunk_count(world);
+        bounds->count = count;
+        bounds->min_x.resize(count);
+        bounds->min_y.resize(count);
+        bounds->min_z.resize(count);
+        bounds->max_x.resize(count);
+        bounds->max_y.resize(count);
+        bounds->max_z.resize(count);
+
+        float extent = CHUNK_SIZE*VOXEL_SIZE;
+        for (int z = 0 ; z < world->depth ; z++)
+        for (int y = 0 ; y < world->height ; y++)
+        for (int x = 0 ; x < world->width ; x++)
+        {
+                int i = world_chunk_index(world, x, y, z);
+                bounds->min_x[i] = x*extent;
+                bounds->min_y[i] = y*extent;
+                bounds->min_z[i] = z*extent;
+                bounds->max_x[i] = (x+1)*extent;
+                bounds->max_y[i] = (y+1)*extent;
+                bounds->max_z[i] = (z+1)*extent;
+        }
+}
+
+
+// for every plane only the box corner furthest along the normal matters. the sign of the
+// normal is the same for every box, so the corner is picked once per plane by choosing arrays
+static void plane_corners(const Frustum* frustum, const ChunkBounds* bounds, const float* corner[6][3])
+{
+        for (int p = 0 ; p < 6 ; p++)
+        {
+                corner[p][0] = frustum->planes[p].x > 0.0f ? bounds->max_x.data() : bounds->min_x.data();
+                corner[p][1] = frustum->planes[p].y > 0.0f ? bounds->max_y.data() : bounds->min_y.data();
+                corner[p][2] = frustum->planes[p].z > 0.0f ? bounds->max_z.data() : bounds->min_z.data();
+        }
+}
+
+
+static int cull_range_scalar(const Frustum* frustum, const float* corner[6][3], int begin, int end, int* visible)
+{
+        int count = 0;
+        for (int i = begin ; i < end ; i++)
+        {
+                bool inside = true;
+                for (int p = 0 ; p < 6 && inside ; p++)
+                {
+                        glm::vec4 plane = frustum->planes[p];
+                        inside = plane.x*corner[p][0][i] + plane.y*corner[p][1][i] + plane.z*corner[p][2][i] + plane.w >= 0.0f;
+                }
+                visible[count] = i;
+                count += inside;
+        }
+        return count;
+}
+
+
+int frustum_cull_scalar(const Frustum* frustum, const ChunkBounds* bounds, int* visible)
+{
+        const float* corner[6][3];
+        plane_corners(frustum, bounds, corner);
+        return cull_range_scalar(frustum, corner, 0, bounds->count, visible);
+}
+
+
+__attribute__((target("avx2,fma")))
+static int frustum_cull_avx2(const Frustum* frustum, const ChunkBounds* bounds, int* visible)
+{
+        const float* corner[6][3];
+        plane_corners(frustum, bounds, corner);
+
+        __m256 nx[6], ny[6], nz[6], d[6];
+        for (int p = 0 ; p < 6 ; p++)
+        {
+                nx[p] = _mm256_set1_ps(frustum->planes[p].x);
+                ny[p] = _mm256_set1_ps(frustum->planes[p].y);
+                nz[p] = _mm256_set1_ps(frustum->planes[p].z);
+                d[p] = _mm256_set1_ps(frustum->planes[p].w);
+        }
+
+        int count = 0;
+        int i = 0;
+        for ( ; i + 8 <= bounds->count ; i += 8)
+        {
+                // sign bit set means that box is outside some plane
+                __m256 outside = _mm256_setzero_ps();
+                for (int p = 0 ; p < 6 ; p++)
+                {
+                        __m256 distance = _mm256_fmadd_ps(nx[p], _mm256_loadu_ps(corner[p][0]+i), d[p]);
+                        distance = _mm256_fmadd_ps(ny[p], _mm256_loadu_ps(corner[p][1]+i), distance);
+                        distance = _mm256_fmadd_ps(nz[p], _mm256_loadu_ps(corner[p][2]+i), distance);
+                        outside = _mm256_or_ps(outside, distance);
+                }
+
+                unsigned int inside = ~_mm256_movemask_ps(outside) & 0xFF;
+                while (inside)
+                {
+                        visible[count++] = i + __builtin_ctz(inside);
+                        inside &= inside-1;
+                }
+        }
+
+        return count + cull_range_scalar(frustum, corner, i, bounds->count, visible+count);
+}
+
+
+int frustum_cull(const Frustum* frustum, const ChunkBounds* bounds, int* visible)
+{
+        static const bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        if (has_avx2)
+                return frustum_cull_avx2(frustum, bounds, visible);
+        return frustum_cull_scalar(frustum, bounds, visible);
+}
+
+
+void frustum_visible_chunks(const Frustum* frustum, const ChunkBounds* bounds, const World* world, VisibleChunks* visible)
+{
+        auto start = std::chrono::steady_clock::now();
+
+        visible->indices.resize(bounds->count);
+        visible->count = frustum_cull(frustum, bounds, visible->indices.data());
+
+        // chunks the chunk index knows are all air have nothing to draw
+        if (world->tags)
+        {
+                int kept = 0;
+                for (int i = 0 ; i < visible->count ; i++)
+                        if (world->tags[visible->indices[i]] != CHUNK_TAG_EMPTY)
+                                visible->indices[kept++] = visible->indices[i];
+                visible->count = kept;
+        }
+
+        visible->min = glm::ivec3(world->width, world->height, world->depth);
+        visible->max = glm::ivec3(0);
+        // coordinates come from the index so the chunks themselves are never touched
+        for (int i = 0 ; i < visible->count ; i++)
+        {
+                int index = visible->indices[i];
+                glm::ivec3 coord = glm::ivec3(index % world->width,
+                                              (index / world->width) % world->height,
+                                              index / (world->width*world->height));
+                visible->min = glm::min(visible->min, coord);
+                visible->max = glm::max(visible->max, coord+1);
+        }
+
+        visible->cull_microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+
+// plane equations (xyz normal pointing inside, w distance), normalized
+// order: left, right, bottom, top, near, far
+typedef struct Frustum
+{
+        glm::vec4 planes[6];
+}Frustum;
+
+// chunk aabbs in world units, structure of arrays so 8 boxes load with one instruction per field
+typedef struct ChunkBounds
+{
+        int count;
+        std::vector<float> min_x, min_y, min_z;
+        std::vector<float> max_x, max_y, max_z;
+}ChunkBounds;
+
+// what the renderers get to draw this frame
+typedef struct VisibleChunks
+{
+        std::vector<int> indices;
+        int count;
+        // union of the visible chunks, in chunk coordinates, max exclusive
+        glm::ivec3 min, max;
+        double cull_microseconds;
+}VisibleChunks;
+
+// gribb/hartmann: planes are sums and differences of the rows of projection * view
+void frustum_extract(Frustum* frustum, glm::mat4 view_projection);
+
+void chunk_bounds_build(ChunkBounds* bounds, const World* world);
+
+// writes the index of every box touching the frustum into visible (room for bounds->count), returns how many.
+// uses avx2 when the cpu has it
+int frustum_cull(const Frustum* frustum, const ChunkBounds* bounds, int* visible);
+int frustum_cull_scalar(const Frustum* frustum, const ChunkBounds* bounds, int* visible);
+
+// culls the world and fills visible with the result, leaving out the chunks tagged CHUNK_TAG_EMPTY
+void frustum_visible_chunks(const Frustum* frustum, const ChunkBounds* bounds, const World* world, VisibleChunks* visible);
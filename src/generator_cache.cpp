@@ -0,0 +1,105 @@
+#include "generator_cache.h"
+
+#include <string.h>
+
+
+int generator_cache_init(GeneratorCache* cache, unsigned int seed, int capacity)
+{
+        cache->seed = seed;
+        cache->capacity = capacity > 0 ? capacity : 1;
+        cache->entries.clear();
+        cache->index.clear();
+        cache->tick = 0;
+        cache->hits = 0;
+        cache->misses = 0;
+        return 0;
+}
+
+
+void generator_cache_destroy(GeneratorCache* cache)
+{
+        for (GeneratedChunk& entry : cache->entries)
+                chunk_destroy(entry.chunk);
+        cache->entries.clear();
+        cache->index.clear();
+}
+
+
+// the generated chunk at coord, cache->mutex held
+static const Chunk* generated(GeneratorCache* cache, glm::ivec3 coord)
+{
+        uint64_t key = chunk_coord_key(coord);
+        auto found = cache->index.find(key);
+        if (found != cache->index.end())
+        {
+                GeneratedChunk* entry = &cache->entries[found->second];
+                entry->used = ++cache->tick;
+                cache->hits++;
+                return entry->chunk;
+        }
+        cache->misses++;
+
+        int slot;
+        if ((int)cache->entries.size() < cache->capacity)
+        {
+                Chunk* chunk = chunk_create(coord);
+                if (chunk == NULL)
+                        return NULL;
+                slot = cache->entries.size();
+                cache->entries.push_back({0, 0, chunk});
+        }
+        else
+        {
+                // least recently used, a linear scan is nothing next to generating a chunk
+                slot = 0;
+                for (int i = 1 ; i < (int)cache->entries.size() ; i++)
+                        if (cache->entries[i].used < cache->entries[slot].used)
+                                slot = i;
+                cache->index.erase(cache->entries[slot].key);
+        }
+
+        GeneratedChunk* entry = &cache->entries[slot];
+        entry->key = key;
+        entry->used = ++cache->tick;
+        entry->chunk->coord = coord;
+        chunk_generate(entry->chunk, cache->seed);
+        cache->index[key] = slot;
+        return entry->chunk;
+}
+
+
+bool generator_cache_matches(GeneratorCache* cache, const Chunk* chunk)
+{
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        const ChunkMaterial* block = chunk->material_block;
+        if (block->tier == CHUNK_GENERATED)
+                return block->seed == cache->seed;
+        const Chunk* reference = generated(cache, chunk->coord);
+        if (reference == NULL)
+                return false;
+        if (reference->material_block == block)
+                return true;
+        if (chunk->material)
+                return memcmp(reference->material, chunk->material, CHUNK_VOLUME) == 0;
+
+        std::vector<uint8_t> scratch(CHUNK_VOLUME);
+        return memcmp(reference->material, chunk_material_read(chunk, scratch.data()), CHUNK_VOLUME) == 0;
+}
+
+
+void generator_cache_fill(GeneratorCache* cache, Chunk* chunk)
+{
+        {
+                std::lock_guard<std::mutex> lock(cache->mutex);
+                const Chunk* reference = generated(cache, chunk->coord);
+                if (reference == NULL)
+                {
+                        chunk_generate(chunk, cache->seed);
+                        return;
+                }
+                // the voxels are shared until either chunk is written
+                chunk_material_share(chunk, reference->material_block);
+                memcpy(chunk->occupancy, reference->occupancy, sizeof(chunk->occupancy));
+        }
+        chunk_mark_dirty(chunk, {glm::ivec3(0), glm::ivec3(CHUNK_SIZE)});
+}
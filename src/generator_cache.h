@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "chunk.h"
+
+// generated chunks kept around, enough for a few regions of the save plus what streaming revisits
+#define GENERATOR_CACHE_CHUNKS 64
+
+typedef struct GeneratedChunk
+{
+        uint64_t key;
+        // tick of the last lookup, the smallest is evicted
+        uint64_t used;
+        Chunk* chunk;
+}GeneratedChunk;
+
+// what chunk_generate makes of the world seed, for the most recently asked for coordinates.
+// unedited chunks never have to be stored: they compare equal to the generator and come back from
+// here (or from the generator on a miss) instead of the disk. any thread, one lock around everything
+typedef struct GeneratorCache
+{
+        unsigned int seed;
+        int capacity;
+        std::vector<GeneratedChunk> entries;
+        std::unordered_map<uint64_t, int> index;
+        uint64_t tick;
+        std::mutex mutex;
+
+        uint64_t hits, misses;
+}GeneratorCache;
+
+int generator_cache_init(GeneratorCache* cache, unsigned int seed, int capacity);
+void generator_cache_destroy(GeneratorCache* cache);
+
+// chunk->material against the generator output for chunk->coord
+bool generator_cache_matches(GeneratorCache* cache, const Chunk* chunk);
+// regenerates chunk (voxels, occupancy, a full dirty box) from the cache, like chunk_generate
+void generator_cache_fill(GeneratorCache* cache, Chunk* chunk);
@@ -0,0 +1,214 @@
+#include "gpu_cull.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+#include "frustum.h"
+#include "shader.h"
+
+
+int gpu_cull_init(GpuCull* cull, const World* world)
+{
+        cull->cull_shader = load_compute_shader("resources/cullCompute.glsl");
+        cull->hiz_shader = load_compute_shader("resources/hizCompute.glsl");
+        if (cull->cull_shader == (unsigned int)-1 || cull->hiz_shader == (unsigned int)-1)
+                return -1;
+
+        cull->chunk_count = world_chunk_count(world);
+
+        ChunkBounds bounds;
+        chunk_bounds_build(&bounds, world);
+        std::vector<glm::vec4> packed(cull->chunk_count*2);
+        for (int i = 0 ; i < cull->chunk_count ; i++)
+        {
+                packed[i*2] = glm::vec4(bounds.min_x[i], bounds.min_y[i], bounds.min_z[i], 0.0f);
+                packed[i*2+1] = glm::vec4(bounds.max_x[i], bounds.max_y[i], bounds.max_z[i], 0.0f);
+        }
+
+        glGenBuffers(1, &cull->bounds_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull->bounds_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, packed.size()*sizeof(glm::vec4), packed.data(), GL_STATIC_DRAW);
+
+        // one command per chunk is the worst case
+        glGenBuffers(1, &cull->command_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull->command_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, cull->chunk_count*4*sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+
+        glGenBuffers(1, &cull->count_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull->count_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glGenBuffers(GPU_CULL_READBACK, cull->readback);
+        for (int i = 0 ; i < GPU_CULL_READBACK ; i++)
+        {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, cull->readback[i]);
+                glBufferData(GL_COPY_WRITE_BUFFER, sizeof(unsigned int), NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glGenFramebuffers(1, &cull->framebuffer);
+        cull->color_texture = 0;
+        cull->depth_texture = 0;
+        cull->hiz_texture = 0;
+        cull->width = 0;
+        cull->height = 0;
+        cull->frame = 0;
+        cull->drawn = 0;
+        cull->has_history = false;
+        return 0;
+}
+
+
+static void destroy_targets(GpuCull* cull)
+{
+        if (cull->color_texture)
+        {
+                glDeleteTextures(1, &cull->color_texture);
+                glDeleteTextures(1, &cull->depth_texture);
+                glDeleteTextures(1, &cull->hiz_texture);
+        }
+        cull->color_texture = cull->depth_texture = cull->hiz_texture = 0;
+}
+
+
+void gpu_cull_destroy(GpuCull* cull)
+{
+        destroy_targets(cull);
+        glDeleteFramebuffers(1, &cull->framebuffer);
+        glDeleteBuffers(GPU_CULL_READBACK, cull->readback);
+        glDeleteBuffers(1, &cull->count_buffer);
+        glDeleteBuffers(1, &cull->command_buffer);
+        glDeleteBuffers(1, &cull->bounds_buffer);
+        glDeleteProgram(cull->hiz_shader);
+        glDeleteProgram(cull->cull_shader);
+}
+
+
+static void create_targets(GpuCull* cull, int width, int height)
+{
+        destroy_targets(cull);
+        cull->width = width;
+        cull->height = height;
+        cull->hiz_levels = (int)floor(log2((double)(width > height ? width : height))) + 1;
+
+        glGenTextures(1, &cull->color_texture);
+        glBindTexture(GL_TEXTURE_2D, cull->color_texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+
+        glGenTextures(1, &cull->depth_texture);
+        glBindTexture(GL_TEXTURE_2D, cull->depth_texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &cull->hiz_texture);
+        glBindTexture(GL_TEXTURE_2D, cull->hiz_texture);
+        glTexStorage2D(GL_TEXTURE_2D, cull->hiz_levels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, cull->framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cull->color_texture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, cull->depth_texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                printf("gpu cull framebuffer is incomplete.\n");
+
+        // the old pyramid no longer matches the screen
+        cull->has_history = false;
+}
+
+
+void gpu_cull_begin_frame(GpuCull* cull, int width, int height)
+{
+        if (width != cull->width || height != cull->height)
+                create_targets(cull, width, height);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, cull->framebuffer);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+
+void gpu_cull_dispatch(GpuCull* cull, const Camera* camera, unsigned int range_buffer)
+{
+        // pick up the count written a few frames ago, it has long finished by now
+        int slot = cull->frame % GPU_CULL_READBACK;
+        if (cull->frame >= GPU_CULL_READBACK)
+        {
+                unsigned int drawn = 0;
+                glBindBuffer(GL_COPY_READ_BUFFER, cull->readback[slot]);
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(unsigned int), &drawn);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                cull->drawn = drawn;
+        }
+
+        Frustum frustum;
+        frustum_extract(&frustum, camera->projection * camera->view);
+
+        unsigned int zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull->count_buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int), &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glUseProgram(cull->cull_shader);
+        set_shader_value_int("chunk_count", cull->chunk_count, cull->cull_shader);
+        set_shader_value_vec4_array("planes", frustum.planes, 6, cull->cull_shader);
+        set_shader_value_matrix4("previous_view_projection", cull->previous_view_projection, cull->cull_shader);
+        set_shader_value_int("use_hiz", cull->has_history, cull->cull_shader);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, cull->hiz_texture);
+        set_shader_value_int("hiz", 0, cull->cull_shader);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cull->bounds_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, range_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, cull->command_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, cull->count_buffer);
+
+        glDispatchCompute((cull->chunk_count + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, cull->count_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, cull->readback[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(unsigned int));
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        cull->frame++;
+}
+
+
+void gpu_cull_end_frame(GpuCull* cull, const Camera* camera)
+{
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, cull->framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, cull->width, cull->height, 0, 0, cull->width, cull->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glUseProgram(cull->hiz_shader);
+        set_shader_value_int("source", 0, cull->hiz_shader);
+        glActiveTexture(GL_TEXTURE0);
+
+        int width = cull->width, height = cull->height;
+        int source_width = width, source_height = height;
+        for (int level = 0 ; level < cull->hiz_levels ; level++)
+        {
+                glBindTexture(GL_TEXTURE_2D, level == 0 ? cull->depth_texture : cull->hiz_texture);
+                glBindImageTexture(0, cull->hiz_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+                set_shader_value_int("source_level", level-1, cull->hiz_shader);
+                set_shader_value_ivec2("source_size", glm::ivec2(source_width, source_height), cull->hiz_shader);
+
+                glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+                glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+                source_width = width;
+                source_height = height;
+                width = width > 1 ? width / 2 : 1;
+                height = height > 1 ? height / 2 : 1;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        cull->previous_view_projection = camera->projection * camera->view;
+        cull->has_history = true;
+}
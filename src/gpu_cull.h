@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "chunk.h"
+
+// draw counts are read back this many frames late, only for the title
+#define GPU_CULL_READBACK 4
+
+// gpu driven chunk visibility: a compute pass tests every chunk against the frustum and a
+// hi-z pyramid of the previous frame's depth and writes compacted indirect draws.
+// the scene is drawn into its own framebuffer so that depth can be sampled afterwards
+typedef struct GpuCull
+{
+        unsigned int cull_shader, hiz_shader;
+        unsigned int bounds_buffer, command_buffer, count_buffer;
+        unsigned int readback[GPU_CULL_READBACK];
+        int frame;
+        int chunk_count;
+
+        unsigned int framebuffer, color_texture, depth_texture, hiz_texture;
+        int width, height, hiz_levels;
+
+        glm::mat4 previous_view_projection;
+        bool has_history;
+
+        // how many chunks survived, a few frames old
+        int drawn;
+}GpuCull;
+
+int gpu_cull_init(GpuCull* cull, const World* world);
+void gpu_cull_destroy(GpuCull* cull);
+
+// binds and clears the scene framebuffer, (re)allocating it at width x height
+void gpu_cull_begin_frame(GpuCull* cull, int width, int height);
+// fills command_buffer/count_buffer from the per chunk first/count pairs in range_buffer
+void gpu_cull_dispatch(GpuCull* cull, const Camera* camera, unsigned int range_buffer);
+// presents the scene framebuffer and builds the pyramid next frame will test against
+void gpu_cull_end_frame(GpuCull* cull, const Camera* camera);
@@ -0,0 +1,43 @@
+#include "gpu_timer.h"
+
+
+void gpu_timer_init(GpuTimer* timer)
+{
+        glGenQueries(GPU_TIMER_LATENCY, timer->queries);
+        timer->frame = 0;
+        timer->milliseconds = 0.0;
+}
+
+
+void gpu_timer_destroy(GpuTimer* timer)
+{
+        glDeleteQueries(GPU_TIMER_LATENCY, timer->queries);
+}
+
+
+void gpu_timer_begin(GpuTimer* timer)
+{
+        unsigned int query = timer->queries[timer->frame % GPU_TIMER_LATENCY];
+
+        // the slot is about to be reused, pull its result first if it has one
+        if (timer->frame >= GPU_TIMER_LATENCY)
+        {
+                int available = 0;
+                glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available)
+                {
+                        GLuint64 elapsed = 0;
+                        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                        timer->milliseconds = elapsed / 1000000.0;
+                }
+        }
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+
+void gpu_timer_end(GpuTimer* timer)
+{
+        glEndQuery(GL_TIME_ELAPSED);
+        timer->frame++;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glad/gl.h>
+
+// results are read a few frames late so querying never stalls the pipeline
+#define GPU_TIMER_LATENCY 4
+
+typedef struct GpuTimer
+{
+        unsigned int queries[GPU_TIMER_LATENCY];
+        int frame;
+        // last resolved result in milliseconds
+        double milliseconds;
+}GpuTimer;
+
+void gpu_timer_init(GpuTimer* timer);
+void gpu_timer_destroy(GpuTimer* timer);
+
+// only one GL_TIME_ELAPSED query can be active at a time
+void gpu_timer_begin(GpuTimer* timer);
+void gpu_timer_end(GpuTimer* timer);
@@ -0,0 +1,101 @@
+#include "jobs.h"
+
+#include <algorithm>
+
+
+// pulls pieces until the range runs out
+static void run_pieces(JobPool* pool)
+{
+        while (true)
+        {
+                int begin = pool->next.fetch_add(pool->grain);
+                if (begin >= pool->count)
+                        return;
+                pool->function(begin, std::min(begin + pool->grain, pool->count));
+        }
+}
+
+
+static void job_worker(JobPool* pool)
+{
+        unsigned long seen = 0;
+        while (true)
+        {
+                {
+                        std::unique_lock<std::mutex> lock(pool->mutex);
+                        pool->wake.wait(lock, [pool, seen]{ return !pool->running || pool->generation != seen; });
+                        if (!pool->running)
+                                return;
+                        seen = pool->generation;
+                        pool->busy++;
+                }
+
+                run_pieces(pool);
+
+                {
+                        std::lock_guard<std::mutex> lock(pool->mutex);
+                        pool->busy--;
+                }
+                pool->done.notify_one();
+        }
+}
+
+
+int job_pool_init(JobPool* pool, int threads)
+{
+        if (threads <= 0)
+                threads = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+
+        pool->running = true;
+        pool->count = 0;
+        pool->grain = 1;
+        pool->next = 0;
+        pool->busy = 0;
+        pool->generation = 0;
+        for (int i = 0 ; i < threads ; i++)
+                pool->workers.push_back(std::thread(job_worker, pool));
+        return 0;
+}
+
+
+void job_pool_destroy(JobPool* pool)
+{
+        {
+                std::lock_guard<std::mutex> lock(pool->mutex);
+                pool->running = false;
+        }
+        pool->wake.notify_all();
+        for (std::thread& worker : pool->workers)
+                worker.join();
+        pool->workers.clear();
+}
+
+
+void job_pool_parallel_for(JobPool* pool, int count, int grain, std::function<void(int, int)> function)
+{
+        if (count <= 0)
+                return;
+        if (pool->workers.empty() || count <= grain)
+        {
+                function(0, count);
+                return;
+        }
+
+        {
+                // a worker that woke late for the previous range may still be on its way out
+                std::unique_lock<std::mutex> lock(pool->mutex);
+                pool->done.wait(lock, [pool]{ return pool->busy == 0; });
+                pool->function = function;
+                pool->count = count;
+                pool->grain = std::max(grain, 1);
+                pool->next = 0;
+                pool->generation++;
+        }
+        pool->wake.notify_all();
+
+        run_pieces(pool);
+
+        // a worker that never woke up for this generation is not counted, it finds nothing left once it does
+        std::unique_lock<std::mutex> lock(pool->mutex);
+        pool->done.wait(lock, [pool]{ return pool->busy == 0; });
+}
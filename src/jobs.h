@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads that split index ranges between them, the calling thread helps out
+typedef struct JobPool
+{
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake, done;
+        bool running;
+
+        // the range being worked on, generation changes every time a new one is posted
+        std::function<void(int, int)> function;
+        int count, grain;
+        std::atomic<int> next;
+        int busy;
+        unsigned long generation;
+}JobPool;
+
+// threads <= 0 uses one worker per hardware thread minus the caller
+int job_pool_init(JobPool* pool, int threads);
+void job_pool_destroy(JobPool* pool);
+
+// calls function(begin, end) over [0, count) in pieces of grain, returns once every piece is done.
+// not reentrant, one range at a time
+void job_pool_parallel_for(JobPool* pool, int count, int grain, std::function<void(int, int)> function);
@@ -0,0 +1,332 @@
+#include "journal.h"
+#include "rle.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+
+static size_t region_bytes(DirtyBox box)
+{
+        glm::ivec3 size = box.max - box.min;
+        return (size_t)size.x*size.z*sizeof(uint64_t) + (size_t)size.x*size.y*size.z;
+}
+
+
+int journal_init(Journal* journal, size_t memory_budget)
+{
+        journal->cursor = 0;
+        journal->memory_budget = memory_budget;
+        journal->memory_bytes = 0;
+        journal->spilled_bytes = 0;
+        journal->record_voxels = 0;
+        journal->raw_bytes = 0;
+        journal->encoded_bytes = 0;
+
+        journal->occupancy_xor = (uint64_t*) calloc(CHUNK_COLUMNS, sizeof(uint64_t));
+        journal->material_xor = (uint8_t*) calloc(CHUNK_VOLUME, 1);
+        if (journal->occupancy_xor == NULL || journal->material_xor == NULL)
+        {
+                printf("unable to allocate the edit journal\n");
+                free(journal->occupancy_xor);
+                free(journal->material_xor);
+                return -1;
+        }
+
+        // removed by the os once it is closed
+        journal->spill = tmpfile();
+        slot_pool_init(&journal->spill_pages, 0);
+        if (journal->spill == NULL)
+                printf("no spill file for the edit journal, old undo steps are dropped instead\n");
+        return 0;
+}
+
+
+static int spill_page_count(size_t size)
+{
+        return (int)((size + JOURNAL_SPILL_PAGE - 1) / JOURNAL_SPILL_PAGE);
+}
+
+
+// drops the delta of an entry, in memory or spilled
+static void entry_free(Journal* journal, JournalEntry* entry)
+{
+        if (entry->data)
+        {
+                journal->memory_bytes -= entry->size;
+                free(entry->data);
+                entry->data = NULL;
+        }
+        else if (entry->spill_offset >= 0)
+        {
+                slot_pool_free(&journal->spill_pages, entry->spill_offset / JOURNAL_SPILL_PAGE, spill_page_count(entry->size));
+                journal->spilled_bytes -= entry->size;
+                entry->spill_offset = -1;
+        }
+}
+
+
+void journal_destroy(Journal* journal)
+{
+        for (JournalEntry& entry : journal->entries)
+                entry_free(journal, &entry);
+        journal->entries.clear();
+        free(journal->occupancy_xor);
+        free(journal->material_xor);
+        journal->occupancy_xor = NULL;
+        journal->material_xor = NULL;
+        if (journal->spill)
+                fclose(journal->spill);
+        journal->spill = NULL;
+}
+
+
+void journal_begin(Journal* journal)
+{
+        journal->record.clear();
+        journal->record_voxels = 0;
+}
+
+
+void journal_chunk(Journal* journal, int chunk, DirtyBox box)
+{
+        static std::vector<uint8_t> raw;
+        raw.resize(region_bytes(box));
+
+        // gather the box out of the scratch xor and zero it behind us for the next chunk
+        uint8_t* out = raw.data();
+        int width = box.max.x - box.min.x;
+        for (int z = box.min.z ; z < box.max.z ; z++)
+        {
+                uint64_t* words = &journal->occupancy_xor[chunk_column_index(box.min.x, z)];
+                memcpy(out, words, width*sizeof(uint64_t));
+                memset(words, 0, width*sizeof(uint64_t));
+                out += width*sizeof(uint64_t);
+        }
+        for (int z = box.min.z ; z < box.max.z ; z++)
+        for (int y = box.min.y ; y < box.max.y ; y++)
+        {
+                uint8_t* bytes = &journal->material_xor[chunk_voxel_index(box.min.x, y, z)];
+                for (int x = 0 ; x < width ; x++)
+                        journal->record_voxels += bytes[x] != 0;
+                memcpy(out, bytes, width);
+                memset(bytes, 0, width);
+                out += width;
+        }
+
+        std::vector<uint8_t>& record = journal->record;
+        rle_put_varint(record, chunk);
+        for (int axis = 0 ; axis < 3 ; axis++)
+                record.push_back((uint8_t)box.min[axis]);
+        // max is 1..64, stored minus one to fit a byte
+        for (int axis = 0 ; axis < 3 ; axis++)
+                record.push_back((uint8_t)(box.max[axis] - 1));
+
+        static std::vector<uint8_t> stream;
+        stream.clear();
+        rle_encode(stream, raw.data(), raw.size());
+        rle_put_varint(record, stream.size());
+        record.insert(record.end(), stream.begin(), stream.end());
+
+        journal->raw_bytes += raw.size();
+}
+
+
+// moves the oldest deltas still in memory to the spill file until the journal fits its budget
+static void journal_spill(Journal* journal)
+{
+        for (JournalEntry& entry : journal->entries)
+        {
+                if (journal->memory_bytes <= journal->memory_budget)
+                        return;
+                if (entry.data == NULL)
+                        continue;
+                if (journal->spill == NULL)
+                        break;
+
+                // into pages dropped entries left, the file only grows when none are free
+                SlotPool* pages = &journal->spill_pages;
+                int count = spill_page_count(entry.size);
+                int first = slot_pool_alloc(pages, count);
+                if (first < 0)
+                {
+                        slot_pool_grow(pages, pages->capacity + std::max(count, pages->capacity));
+                        first = slot_pool_alloc(pages, count);
+                }
+                long offset = (long)first*JOURNAL_SPILL_PAGE;
+                if (fseek(journal->spill, offset, SEEK_SET) != 0 || fwrite(entry.data, 1, entry.size, journal->spill) != entry.size)
+                {
+                        printf("unable to spill the edit journal\n");
+                        slot_pool_free(pages, first, count);
+                        return;
+                }
+                journal->memory_bytes -= entry.size;
+                free(entry.data);
+                entry.data = NULL;
+                entry.spill_offset = offset;
+                journal->spilled_bytes += entry.size;
+        }
+
+        // nowhere to spill to, forget the oldest steps but always keep the newest
+        while (journal->memory_bytes > journal->memory_budget && journal->cursor > 1)
+        {
+                entry_free(journal, &journal->entries[0]);
+                journal->entries.erase(journal->entries.begin());
+                journal->cursor--;
+        }
+}
+
+
+void journal_end(Journal* journal)
+{
+        if (journal->record.empty())
+                return;
+
+        // a new step after some undos makes the undone ones unreachable
+        for (size_t i = journal->cursor ; i < journal->entries.size() ; i++)
+                entry_free(journal, &journal->entries[i]);
+        journal->entries.resize(journal->cursor);
+
+        JournalEntry entry = {};
+        entry.size = journal->record.size();
+        entry.data = (uint8_t*) malloc(entry.size);
+        if (entry.data == NULL)
+        {
+                printf("unable to allocate an undo step\n");
+                return;
+        }
+        memcpy(entry.data, journal->record.data(), entry.size);
+        entry.spill_offset = -1;
+        entry.voxels = journal->record_voxels;
+        journal->entries.push_back(entry);
+        journal->cursor++;
+        journal->memory_bytes += entry.size;
+        journal->encoded_bytes += entry.size;
+
+        if ((int)journal->entries.size() > JOURNAL_MAX_ENTRIES)
+        {
+                entry_free(journal, &journal->entries[0]);
+                journal->entries.erase(journal->entries.begin());
+                journal->cursor--;
+        }
+        journal_spill(journal);
+}
+
+
+// the chunk index, box and stream size a record starts with, false when they don't fit in [in, end)
+// or don't make sense for world (a spilled record read back from disk can be anything)
+static bool read_record_header(const uint8_t** in, const uint8_t* end, const World* world, size_t* index, DirtyBox* box, size_t* stream)
+{
+        if (!rle_get_varint(in, end, index) || *index >= (size_t)world_chunk_count(world) || end - *in < 6)
+                return false;
+        for (int axis = 0 ; axis < 3 ; axis++)
+        {
+                box->min[axis] = (*in)[axis];
+                box->max[axis] = (*in)[3 + axis] + 1;
+                if (box->min[axis] >= box->max[axis] || box->max[axis] > CHUNK_SIZE)
+                        return false;
+        }
+        *in += 6;
+        return rle_get_varint(in, end, stream) && *stream <= (size_t)(end - *in);
+}
+
+
+// xors the chunk records in [in, end) into the world. stops at the first record that can't be applied
+// and returns where it starts, end when every record was
+static const uint8_t* apply_records(World* world, const uint8_t* in, const uint8_t* end)
+{
+        static std::vector<uint8_t> raw;
+        while (in < end)
+        {
+                const uint8_t* record = in;
+                size_t index, stream;
+                DirtyBox box;
+                bool intact = read_record_header(&in, end, world, &index, &box, &stream);
+                if (intact)
+                        raw.assign(region_bytes(box), 0);
+                if (!intact || !rle_decode(in, in + stream, raw.data(), raw.size()))
+                {
+                        printf("corrupt undo step\n");
+                        return record;
+                }
+                in += stream;
+
+                Chunk* chunk = world_chunk_write(world, index);
+                if (chunk == NULL)
+                        return record;
+
+                const uint8_t* delta = raw.data();
+                int width = box.max.x - box.min.x;
+                for (int z = box.min.z ; z < box.max.z ; z++)
+                {
+                        uint64_t* words = &chunk->occupancy[chunk_column_index(box.min.x, z)];
+                        for (int x = 0 ; x < width ; x++)
+                        {
+                                uint64_t word;
+                                memcpy(&word, delta, sizeof(word));
+                                words[x] ^= word;
+                                delta += sizeof(word);
+                        }
+                }
+                for (int z = box.min.z ; z < box.max.z ; z++)
+                for (int y = box.min.y ; y < box.max.y ; y++)
+                {
+                        uint8_t* bytes = &chunk->material[chunk_voxel_index(box.min.x, y, z)];
+                        for (int x = 0 ; x < width ; x++)
+                                bytes[x] ^= delta[x];
+                        delta += width;
+                }
+
+                chunk_mark_dirty(chunk, box);
+        }
+        return end;
+}
+
+
+// xors the delta back into the world, which is both undo and redo. all or nothing: when a chunk
+// fails the ones before it are xored back, so the world is as it was
+static bool journal_apply(Journal* journal, World* world, const JournalEntry* entry)
+{
+        const uint8_t* data = entry->data;
+        static std::vector<uint8_t> loaded;
+        if (data == NULL)
+        {
+                loaded.resize(entry->size);
+                if (journal->spill == NULL
+                 || fseek(journal->spill, entry->spill_offset, SEEK_SET) != 0
+                 || fread(loaded.data(), 1, entry->size, journal->spill) != entry->size)
+                {
+                        printf("unable to read an undo step back from the spill file\n");
+                        return false;
+                }
+                data = loaded.data();
+        }
+
+        const uint8_t* end = data + entry->size;
+        const uint8_t* failed = apply_records(world, data, end);
+        if (failed == end)
+                return true;
+        // those records decoded once and their chunks are writable already, this only fails on a bug
+        if (apply_records(world, data, failed) != failed)
+                printf("unable to roll back a partly applied undo step\n");
+        return false;
+}
+
+
+bool journal_undo(Journal* journal, World* world)
+{
+        // the cursor only moves past a step that was applied in full
+        if (journal->cursor == 0 || !journal_apply(journal, world, &journal->entries[journal->cursor-1]))
+                return false;
+        journal->cursor--;
+        return true;
+}
+
+
+bool journal_redo(Journal* journal, World* world)
+{
+        if (journal->cursor == (int)journal->entries.size() || !journal_apply(journal, world, &journal->entries[journal->cursor]))
+                return false;
+        journal->cursor++;
+        return true;
+}
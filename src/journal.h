@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "chunk.h"
+#include "slot_pool.h"
+
+// undo steps kept at all, the oldest are forgotten past this
+#define JOURNAL_MAX_ENTRIES 256
+// encoded deltas kept in memory before the oldest entries go to the spill file
+#define JOURNAL_MEMORY_BUDGET (16u << 20)
+// the spill file is handed out in pages, the pages of a dropped entry are written again
+#define JOURNAL_SPILL_PAGE 4096
+
+// one undo step: the xor of every chunk it changed, before against after, inside its dirty box.
+// xor is its own inverse so the same delta both undoes and redoes the step
+typedef struct JournalEntry
+{
+        // NULL once spilled, the delta is then at spill_offset in the spill file (-1 while in memory)
+        uint8_t* data;
+        size_t size;
+        long spill_offset;
+        int voxels;
+}JournalEntry;
+
+// per chunk record inside an entry data:
+//   varint chunk index, min xyz and max xyz as bytes, varint stream size, stream
+// stream: the occupancy words of the columns in the box, then the material bytes in the box,
+// both xor deltas, run length encoded (see rle.h)
+typedef struct Journal
+{
+        // [0, cursor) can be undone, [cursor, size) redone
+        std::vector<JournalEntry> entries;
+        int cursor;
+
+        // spilled_bytes is what the spilled entries still held take, the file can be larger
+        size_t memory_budget, memory_bytes, spilled_bytes;
+        FILE* spill;
+        SlotPool spill_pages;
+
+        // the entry being recorded: xor of the chunk being edited, zeroed again after every chunk
+        std::vector<uint8_t> record;
+        int record_voxels;
+        uint64_t* occupancy_xor;
+        uint8_t* material_xor;
+
+        // over every entry recorded, to see what the encoding saves
+        size_t raw_bytes, encoded_bytes;
+}Journal;
+
+int journal_init(Journal* journal, size_t memory_budget);
+void journal_destroy(Journal* journal);
+
+// the editor calls these around one edit: xor the change of each chunk into occupancy_xor and
+// material_xor, then journal_chunk with the chunk's dirty box. ending an entry drops the redo steps
+void journal_begin(Journal* journal);
+void journal_chunk(Journal* journal, int chunk, DirtyBox box);
+void journal_end(Journal* journal);
+
+// replay the delta of the previous/next step through world_chunk_write and the chunk dirty boxes,
+// like any other edit. false when there is nothing to undo/redo or the step couldn't be applied,
+// the world and the cursor are then left as they were
+bool journal_undo(Journal* journal, World* world);
+bool journal_redo(Journal* journal, World* world);
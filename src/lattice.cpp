@@ -0,0 +1,284 @@
+#include "lattice.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+
+#include "lod.h"
+#include "shader.h"
+
+typedef struct LatticeVertex
+{
+        float x, y, z;
+        unsigned int face;
+}LatticeVertex;
+
+
+// counter clockwise seen from the side the face points at, same convention as the mesher
+static void emit_slice(std::vector<LatticeVertex>* vertices, int face, int depth, glm::ivec3 size)
+{
+        int axis = face >> 1;
+        int u_axis = (axis+1) % 3, v_axis = (axis+2) % 3;
+
+        glm::vec3 origin(0.0f), u(0.0f), v(0.0f);
+        origin[axis] = depth;
+        u[u_axis] = size[u_axis];
+        v[v_axis] = size[v_axis];
+        if (face & 1)
+        {
+                glm::vec3 t = u;
+                u = v;
+                v = t;
+        }
+
+        glm::vec3 corners[4] = { origin, origin+u, origin+u+v, origin+v };
+        static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int i = 0 ; i < 6 ; i++)
+        {
+                glm::vec3 p = corners[order[i]];
+                vertices->push_back({p.x, p.y, p.z, (unsigned int)face});
+        }
+}
+
+
+int lattice_renderer_init(LatticeRenderer* renderer, const World* world)
+{
+        renderer->shader = load_shader("resources/latticeVertex.glsl","resources/latticeFragment.glsl");
+        if (renderer->shader == (unsigned int)-1 || renderer->shader == 0)
+                return -1;
+
+        renderer->size = glm::ivec3(world->width, world->height, world->depth) * CHUNK_SIZE;
+
+        // voxel slice s has its positive face on plane s+1 and its negative face on plane s
+        std::vector<LatticeVertex> vertices;
+        renderer->slice_count = 0;
+        for (int face = 0 ; face < 6 ; face++)
+        {
+                int slices = renderer->size[face >> 1];
+                renderer->first_slice[face] = renderer->slice_count;
+                renderer->face_slices[face] = slices;
+                for (int s = 0 ; s < slices ; s++)
+                        emit_slice(&vertices, face, (face & 1) ? s : s+1, renderer->size);
+                renderer->slice_count += slices;
+        }
+
+        std::vector<DrawArraysIndirectCommand> commands(renderer->slice_count);
+        for (int i = 0 ; i < renderer->slice_count ; i++)
+                commands[i] = { 6, 1, (unsigned int)i*6, 0 };
+        renderer->command_count = commands.size();
+        renderer->cull_slices = true;
+        renderer->lod_distance = LATTICE_LOD_DISTANCE;
+        renderer->min_lod = 0;
+        renderer->commands.reserve(renderer->slice_count);
+        renderer->command_distance.reserve(renderer->slice_count);
+
+        glGenVertexArrays(1, &renderer->vao);
+        glGenBuffers(1, &renderer->vbo);
+        glGenBuffers(1, &renderer->indirect_buffer);
+
+        glBindVertexArray(renderer->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(LatticeVertex), vertices.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(LatticeVertex),(void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribIPointer(1,1,GL_UNSIGNED_INT,sizeof(LatticeVertex),(void*)(3*sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirect_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size()*sizeof(DrawArraysIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glGenQueries(LATTICE_QUERY_LATENCY*2, &renderer->stat_queries[0][0]);
+        renderer->stat_frame = 0;
+        renderer->shaded_per_pixel = 0.0;
+        renderer->written_per_pixel = 0.0;
+
+        renderer->vertices_submitted = 0;
+        renderer->vram_bytes = vertices.size()*sizeof(LatticeVertex) + commands.size()*sizeof(DrawArraysIndirectCommand);
+
+        printf("lattice: %d slices, %zu vertices\n", renderer->slice_count, vertices.size());
+        return 0;
+}
+
+
+void lattice_renderer_destroy(LatticeRenderer* renderer)
+{
+        glDeleteQueries(LATTICE_QUERY_LATENCY*2, &renderer->stat_queries[0][0]);
+        glDeleteBuffers(1, &renderer->indirect_buffer);
+        glDeleteBuffers(1, &renderer->vbo);
+        glDeleteVertexArrays(1, &renderer->vao);
+        glDeleteProgram(renderer->shader);
+}
+
+
+// coarsest level every visible chunk is drawn at or below, the fragment shader picks the same level per chunk
+static int nearest_lod(const LatticeRenderer* renderer, const VisibleChunks* visible, glm::vec3 eye)
+{
+        glm::ivec3 chunks = renderer->size / CHUNK_SIZE;
+        int lod = CHUNK_MIP_LEVELS-1;
+        for (int i = 0 ; i < visible->count && lod > 0 ; i++)
+        {
+                int index = visible->indices[i];
+                glm::vec3 chunk_min = glm::vec3(index % chunks.x, (index / chunks.x) % chunks.y, index / (chunks.x*chunks.y)) * (float)CHUNK_SIZE;
+                glm::vec3 outside = glm::max(glm::max(chunk_min - eye, eye - chunk_min - (float)CHUNK_SIZE), 0.0f);
+                lod = glm::min(lod, lod_from_distance(glm::length(outside), renderer->lod_distance));
+        }
+        return lod;
+}
+
+
+// picks the slices whose front face points at the camera and orders them nearest first,
+// so the depth test rejects everything hidden behind the first faces drawn
+static void select_slices(LatticeRenderer* renderer, const VisibleChunks* visible, const Camera* camera)
+{
+        glm::vec3 eye = camera->position / VOXEL_SIZE;
+        glm::vec3 size = glm::vec3(renderer->size);
+        renderer->min_lod = nearest_lod(renderer, visible, eye);
+        int lod_mask = (1 << renderer->min_lod) - 1;
+
+        renderer->commands.clear();
+        renderer->command_distance.clear();
+        for (int face = 0 ; face < 6 ; face++)
+        {
+                int axis = face >> 1;
+                bool positive = (face & 1) == 0;
+                int u_axis = (axis+1) % 3, v_axis = (axis+2) % 3;
+
+                // a positive face on plane p is seen from p < eye only, a negative one from p > eye only
+                int first = 0, last = renderer->face_slices[face];
+                if (positive)
+                        last = glm::clamp((int)ceilf(eye[axis]) - 1, 0, last);
+                else
+                        first = glm::clamp((int)floorf(eye[axis]) + 1, 0, last);
+
+                // nothing outside the visible chunks can produce a fragment
+                first = glm::max(first, visible->min[axis]*CHUNK_SIZE);
+                last = glm::min(last, visible->max[axis]*CHUNK_SIZE);
+
+                for (int s = first ; s < last ; s++)
+                {
+                        float plane = positive ? s+1 : s;
+                        if (((int)plane & lod_mask) != 0)
+                                continue;
+
+                        // skip planes that lie entirely behind the camera
+                        bool in_front = false;
+                        for (int corner = 0 ; corner < 4 && !in_front ; corner++)
+                        {
+                                glm::vec3 p;
+                                p[axis] = plane;
+                                p[u_axis] = (corner & 1) ? size[u_axis] : 0.0f;
+                                p[v_axis] = (corner & 2) ? size[v_axis] : 0.0f;
+                                in_front = glm::dot(p - eye, camera->front) > 0.0f;
+                        }
+                        if (!in_front)
+                                continue;
+
+                        unsigned int slice = renderer->first_slice[face] + s;
+                        renderer->commands.push_back({ 6, 1, slice*6, 0 });
+                        renderer->command_distance.push_back(fabsf(eye[axis] - plane));
+                }
+        }
+
+        std::vector<int> order(renderer->commands.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [renderer](int a, int b) {
+                return renderer->command_distance[a] < renderer->command_distance[b];
+        });
+
+        std::vector<DrawArraysIndirectCommand> sorted(order.size());
+        for (size_t i = 0 ; i < order.size() ; i++)
+                sorted[i] = renderer->commands[order[i]];
+        renderer->commands.swap(sorted);
+}
+
+
+static void read_stats(LatticeRenderer* renderer, const Camera* camera)
+{
+        if (renderer->stat_frame < LATTICE_QUERY_LATENCY)
+                return;
+        unsigned int* queries = renderer->stat_queries[renderer->stat_frame % LATTICE_QUERY_LATENCY];
+
+        int available = 0;
+        glGetQueryObjectiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+                return;
+
+        GLuint64 shaded = 0, written = 0;
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &shaded);
+        glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &written);
+
+        double pixels = glm::max(camera->resolution.x*camera->resolution.y, 1.0f);
+        renderer->shaded_per_pixel = shaded / pixels;
+        renderer->written_per_pixel = written / pixels;
+}
+
+
+void lattice_renderer_draw(LatticeRenderer* renderer, const VisibleChunks* visible, const Camera* camera, unsigned int voxel_texture, const unsigned int slab_textures[3])
+{
+        glUseProgram(renderer->shader);
+        set_shader_value_matrix4("view", camera->view, renderer->shader);
+        set_shader_value_matrix4("projection", camera->projection, renderer->shader);
+        set_shader_value_float("voxel_size", VOXEL_SIZE, renderer->shader);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, voxel_texture);
+        set_shader_value_int("VOXELS", 0, renderer->shader);
+
+        static const char* slab_names[3] = { "SLAB_X", "SLAB_Y", "SLAB_Z" };
+        for (int axis = 0 ; axis < 3 ; axis++)
+        {
+                glActiveTexture(GL_TEXTURE1 + axis);
+                glBindTexture(GL_TEXTURE_2D, slab_textures[axis]);
+                set_shader_value_int(slab_names[axis], 1 + axis, renderer->shader);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        set_shader_value_ivec3("world_size", renderer->size, renderer->shader);
+        set_shader_value_vec3("eye", camera->position / VOXEL_SIZE, renderer->shader);
+        set_shader_value_float("lod_distance", renderer->lod_distance, renderer->shader);
+
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirect_buffer);
+        if (renderer->cull_slices)
+        {
+                select_slices(renderer, visible, camera);
+                renderer->command_count = renderer->commands.size();
+                glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, renderer->command_count*sizeof(DrawArraysIndirectCommand), renderer->commands.data());
+        }
+        else
+        {
+                // every slice in build order, the layout the buffer was created with
+                renderer->min_lod = 0;
+                renderer->command_count = renderer->slice_count;
+                renderer->commands.resize(renderer->slice_count);
+                for (int i = 0 ; i < renderer->slice_count ; i++)
+                        renderer->commands[i] = { 6, 1, (unsigned int)i*6, 0 };
+                glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, renderer->slice_count*sizeof(DrawArraysIndirectCommand), renderer->commands.data());
+        }
+
+        read_stats(renderer, camera);
+        unsigned int* queries = renderer->stat_queries[renderer->stat_frame % LATTICE_QUERY_LATENCY];
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, queries[0]);
+        glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+
+        glBindVertexArray(renderer->vao);
+        glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)0, renderer->command_count, 0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glEndQuery(GL_SAMPLES_PASSED);
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+        renderer->stat_frame++;
+
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_DEPTH_TEST);
+
+        renderer->vertices_submitted = renderer->command_count*6;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "camera.h"
+#include "chunk.h"
+#include "frustum.h"
+
+// matches the layout glMultiDrawArraysIndirect reads
+typedef struct DrawArraysIndirectCommand
+{
+        unsigned int count;
+        unsigned int instance_count;
+        unsigned int first;
+        unsigned int base_instance;
+}DrawArraysIndirectCommand;
+
+// overdraw queries are read back this many frames late
+#define LATTICE_QUERY_LATENCY 4
+// distance in voxels where chunks drop to mip level 1, every doubling of it drops one more level
+#define LATTICE_LOD_DISTANCE 128.0f
+
+// global lattice: one quad spanning the whole world per voxel slice, per face direction.
+// the geometry never changes, the fragment shader decides per texel whether a face exists
+typedef struct LatticeRenderer
+{
+        unsigned int shader, vao, vbo, indirect_buffer;
+
+        // world size in voxels
+        glm::ivec3 size;
+        // slices are stored face by face, face f owns [first_slice[f], first_slice[f]+face_slices[f])
+        int first_slice[6], face_slices[6];
+        int slice_count;
+
+        // when set only slices whose front face can be seen are drawn, nearest first
+        bool cull_slices;
+        std::vector<DrawArraysIndirectCommand> commands;
+        std::vector<float> command_distance;
+
+        // level of the nearest visible chunk, planes that are not a multiple of its cell size are never drawn
+        float lod_distance;
+        int min_lod;
+
+        int command_count;
+        int vertices_submitted;
+        size_t vram_bytes;
+
+        // fragment shader invocations and samples written per screen pixel
+        unsigned int stat_queries[LATTICE_QUERY_LATENCY][2];
+        int stat_frame;
+        double shaded_per_pixel, written_per_pixel;
+}LatticeRenderer;
+
+int lattice_renderer_init(LatticeRenderer* renderer, const World* world);
+void lattice_renderer_destroy(LatticeRenderer* renderer);
+
+// occupancy comes from the per axis bit slabs, the voxel texture is only read for the material of visible texels
+// slices outside the union of the visible chunks are skipped
+void lattice_renderer_draw(LatticeRenderer* renderer, const VisibleChunks* visible, const Camera* camera, unsigned int voxel_texture, const unsigned int slab_textures[3]);
@@ -0,0 +1,147 @@
+#include "lod.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+uint64_t lod_compact_even_bits(uint64_t bits)
+{
+        bits &= 0x5555555555555555ull;
+        bits = (bits | (bits >> 1)) & 0x3333333333333333ull;
+        bits = (bits | (bits >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+        bits = (bits | (bits >> 4)) & 0x00FF00FF00FF00FFull;
+        bits = (bits | (bits >> 8)) & 0x0000FFFF0000FFFFull;
+        bits = (bits | (bits >> 16)) & 0x00000000FFFFFFFFull;
+        return bits;
+}
+
+
+// 2x2 columns OR together, then neighbouring bits along y
+static void reduce_occupancy(const uint64_t* source, int source_size, uint64_t* destination)
+{
+        int size = source_size/2;
+        for (int z = 0 ; z < size ; z++)
+        {
+                for (int x = 0 ; x < size ; x++)
+                {
+                        uint64_t c = source[(2*x) + (2*z)*source_size]
+                                   | source[(2*x+1) + (2*z)*source_size]
+                                   | source[(2*x) + (2*z+1)*source_size]
+                                   | source[(2*x+1) + (2*z+1)*source_size];
+                        destination[x + z*size] = lod_compact_even_bits(c | (c >> 1));
+                }
+        }
+}
+
+
+// most common solid material of the 8 children, ties go to the first one seen
+static uint8_t majority(const uint8_t children[8])
+{
+        uint64_t packed;
+        memcpy(&packed, children, 8);
+        // the common case inside terrain, one material throughout
+        if (packed == children[0]*0x0101010101010101ull)
+                return children[0];
+
+        uint8_t best = 0;
+        int best_count = 0;
+        for (int i = 0 ; i < 8 ; i++)
+        {
+                if (children[i] == 0 || children[i] == best)
+                        continue;
+                int count = 0;
+                for (int j = i ; j < 8 ; j++)
+                        count += children[j] == children[i];
+                if (count > best_count)
+                {
+                        best = children[i];
+                        best_count = count;
+                }
+        }
+        return best;
+}
+
+
+// walks the destination x fastest so both levels are read and written in memory order
+static void reduce_material(const uint8_t* source, int source_size, const uint64_t* occupancy, uint8_t* destination)
+{
+        int size = source_size/2;
+        int source_slice = source_size*source_size;
+        for (int z = 0 ; z < size ; z++)
+        {
+                for (int y = 0 ; y < size ; y++)
+                {
+                        const uint8_t* row = &source[2*y*source_size + 2*z*source_slice];
+                        uint8_t* out = &destination[y*size + z*size*size];
+                        for (int x = 0 ; x < size ; x++)
+                        {
+                                // empty by the OR reduced occupancy, nothing to vote on
+                                if (((occupancy[x + z*size] >> y) & 1) == 0)
+                                {
+                                        out[x] = 0;
+                                        continue;
+                                }
+
+                                const uint8_t* cell = row + 2*x;
+                                uint8_t children[8] = {
+                                        cell[0], cell[1],
+                                        cell[source_size], cell[source_size+1],
+                                        cell[source_slice], cell[source_slice+1],
+                                        cell[source_slice+source_size], cell[source_slice+source_size+1]
+                                };
+                                out[x] = majority(children);
+                        }
+                }
+        }
+}
+
+
+void lod_build_mips(const uint64_t* occupancy, const uint8_t* material, uint64_t* occupancy_mips, uint8_t* material_mips)
+{
+        for (int level = 1 ; level < CHUNK_MIP_LEVELS ; level++)
+        {
+                uint64_t* occupancy_level = occupancy_mips + chunk_mip_column_offset(level);
+                uint8_t* material_level = material_mips + chunk_mip_offset(level);
+
+                reduce_occupancy(occupancy, chunk_mip_size(level-1), occupancy_level);
+                reduce_material(material, chunk_mip_size(level-1), occupancy_level, material_level);
+
+                occupancy = occupancy_level;
+                material = material_level;
+        }
+}
+
+
+void chunk_build_mips(Chunk* chunk)
+{
+        lod_build_mips(chunk->occupancy, chunk->material, chunk->occupancy_mips, chunk->material_mips);
+        chunk->mips_version = chunk->version;
+}
+
+
+const uint8_t* chunk_material_mips_read(const Chunk* chunk, uint8_t* scratch)
+{
+        if (chunk->mips_version == chunk->version)
+                return chunk->material_mips;
+        uint64_t occupancy_mips[CHUNK_MIP_COLUMNS];
+        // an evicted chunk is unpacked first
+        uint8_t* voxels = chunk->material ? NULL : (uint8_t*) malloc(CHUNK_VOLUME);
+        if (chunk->material == NULL && voxels == NULL)
+        {
+                memset(scratch, 0, CHUNK_MIP_BYTES);
+                return scratch;
+        }
+        lod_build_mips(chunk->occupancy, chunk_material_read(chunk, voxels), occupancy_mips, scratch);
+        free(voxels);
+        return scratch;
+}
+
+
+int lod_from_distance(float distance, float lod_distance)
+{
+        if (distance < lod_distance)
+                return 0;
+        int level = (int)floorf(log2f(distance / lod_distance)) + 1;
+        return level < CHUNK_MIP_LEVELS-1 ? level : CHUNK_MIP_LEVELS-1;
+}
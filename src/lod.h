@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "chunk.h"
+
+// mip level L of a chunk has CHUNK_SIZE >> L cells per side.
+// occupancy columns keep their x + z*size layout with bit y, material keeps x fastest
+
+inline int chunk_mip_size(int level)
+{
+        return CHUNK_SIZE >> level;
+}
+
+// offset of level (>= 1) into Chunk::material_mips
+inline int chunk_mip_offset(int level)
+{
+        int offset = 0;
+        for (int l = 1 ; l < level ; l++)
+                offset += chunk_mip_size(l)*chunk_mip_size(l)*chunk_mip_size(l);
+        return offset;
+}
+
+// offset of level (>= 1) into Chunk::occupancy_mips
+inline int chunk_mip_column_offset(int level)
+{
+        int offset = 0;
+        for (int l = 1 ; l < level ; l++)
+                offset += chunk_mip_size(l)*chunk_mip_size(l);
+        return offset;
+}
+
+// keeps every other bit (0, 2, 4 ..) and packs them into the low half
+uint64_t lod_compact_even_bits(uint64_t bits);
+
+// both mip chains of a level 0 chunk, into CHUNK_MIP_COLUMNS words and CHUNK_MIP_BYTES bytes
+void lod_build_mips(const uint64_t* occupancy, const uint8_t* material, uint64_t* occupancy_mips, uint8_t* material_mips);
+// rebuilds both mip chains from level 0 and stamps them with the chunk version
+void chunk_build_mips(Chunk* chunk);
+// the material mips of chunk, built into scratch (CHUNK_MIP_BYTES) when they are stale, without touching
+// the chunk. any thread, for readers of a snapshot
+const uint8_t* chunk_material_mips_read(const Chunk* chunk, uint8_t* scratch);
+
+// level a chunk at `distance` voxels from the camera should be drawn at, lod_distance is where level 1 starts
+int lod_from_distance(float distance, float lod_distance);
@@ -12,199 +12,229 @@
 #include "glm/gtc/type_ptr.hpp"
 
 #include <fstream>
+#include <atomic>
 #include <filesystem>
+#include <mutex>
+
+#include "bitslab.h"
+#include "brick_atlas.h"
+#include "brush.h"
+#include "camera.h"
+#include "chunk.h"
+#include "chunk_cache.h"
+#include "clipmap.h"
+#include "dedup.h"
+#include "edit_queue.h"
+#include "frustum.h"
+#include "gpu_cull.h"
+#include "gpu_timer.h"
+#include "journal.h"
+#include "lattice.h"
+#include "mesh_renderer.h"
+#include "present.h"
+#include "raycast.h"
+#include "save.h"
+#include "shader.h"
+#include "simulation.h"
+#include "snapshot.h"
+#include "upload.h"
 
-typedef struct Camera
-{
-        const float near = 0.01,far = 100;
-        const float fov = 70.0f,sensitivity = 0.05f;
-        glm::vec2 resolution;
-        float speed = 0.25f;
-        float yaw=0.0f, pitch=0.0f, roll=0.0f;
-        glm::vec3 position = glm::vec3(0.0f,0.0f,-3.0f);
-        glm::vec3 direction, front, up, right;
-        glm::mat4 view = glm::mat4(1.0f);
-        glm::mat4 projection = glm::mat4(1.0f);
-}Camera;
-
-
-// free out!
-int read_file(const char * path, char** out)
-{
-        std::ifstream file (path);
-        if (file.is_open())
-        {
-                long long file_size = std::filesystem::file_size(path);
-                
-                *out = (char*) malloc((file_size+1)*sizeof(char));
-                for (long long i = 0 ; i < file_size; i++)
-                {
-                        char c;
-                        file.get(c);
-                        *(*out+i) = c;
-                }
-                // terminating byte because final character isn't one?
-                *(*out+file_size) = '\0';
-                file.close();
-        }
-        else
-        {
-                printf("Unable to read file at: %s\n",path);
-                file.close();
-                return -1;
-        }
-        return 0;
-}
 
-int write_file(const char *)
-{
-        return 0;
-}
+float vertex_data[] = {
+        // VERTEX           UV
+        -1.0f, -1.0f, 0.0f, 1.0f,1.0f,
+        -1.0f,  1.0f, 0.0f, 1.0f,0.0f,
+         1.0f,  1.0f, 0.0f, 0.0f,0.0f,
 
-void set_shader_value_float(const char * loc, float value, unsigned int shader_program)
-{
-        int location = glGetUniformLocation(shader_program, loc);
-        if (location == -1)
-                return;//printf("Unable to locate uniform %s in shader %d\n",loc,shader_program);
-        else
-                glUniform1f(location, value);
-}
+         1.0f,  1.0f, 0.0f, 0.0f,0.0f,
+         1.0f, -1.0f, 0.0f, 0.0f,1.0f,
+        -1.0f, -1.0f, 0.0f, 1.0f,1.0f
+};
 
 
-void set_shader_value_vec2(const char * loc, glm::vec2 value, unsigned int shader_program)
+// Update the framebuffer size to the window size 
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-        int location = glGetUniformLocation(shader_program, loc);
-        if (location == -1)
-                return;//printf("Unable to locate uniform %s in shader %d\n",loc,shader_program);
-        else
-                glUniform2f(location, value.x, value.y);
+        glViewport(0,0,width,height);
 }
 
 
-void set_shader_value_vec3(const char * loc, glm::vec3 value, unsigned int shader_program)
-{
-        int location = glGetUniformLocation(shader_program, loc);
-        if (location == -1)
-                return;
-        else
-                glUniform3f(location, value.x, value.y, value.z);
-}
+// global client camera, its position and orientation come from the simulation every frame
+struct Camera camera;
+struct Simulation simulation;
 
 
-void set_shader_value_float_array(const char * loc, float* value, int size, unsigned int shader_program)
+// which renderer draws the world, switched at runtime with the number keys
+enum RenderMode
 {
-        int location = glGetUniformLocation(shader_program, loc);
-        if (location == -1)
-                return;//printf("Unable to locate uniform %s in shader %d\n",loc,shader_program);
-        else
-                glUniform1fv(location,size,value);
-}
-
-
-void set_shader_value_matrix4(const char * loc, glm::mat4 value, unsigned int shader_program)
+        RENDER_RAY_MARCH,
+        RENDER_MESH,
+        RENDER_LATTICE,
+        RENDER_MODE_COUNT
+};
+const char* render_mode_names[RENDER_MODE_COUNT] = { "ray march", "mesh", "lattice" };
+int render_mode = RENDER_RAY_MARCH;
+// C toggles camera facing slice culling for the lattice so its overdraw can be compared
+bool lattice_cull = true;
+// G moves chunk visibility for the mesh renderer onto the gpu (frustum + hi-z compute pass)
+bool gpu_culling = false;
+// K has the ray marcher read the camera centred clipmap instead of the world sized texture where it can
+bool clipmap_enabled = true;
+// P has it read the brick atlas through the page table instead of the world sized texture
+bool atlas_enabled = true;
+// V cycles vsync/uncapped/frame limited presentation, F the number of frames the cpu may queue ahead
+int present_mode = PRESENT_VSYNC;
+int frames_in_flight = 2;
+// B cycles the brush shape, [ and ] change its radius. mouse buttons edit at the pick:
+// left subtracts, right adds, middle paints
+int brush_shape = BRUSH_SPHERE;
+int brush_radius = 8;
+// edits from any thread go through here, the simulation thread drains it every tick
+EditQueue edit_queue;
+// ctrl+z / ctrl+y steps taken since the last tick, negative undoes
+std::atomic<int> journal_pending(0);
+// voxel under the crosshair as of the last frame, what an edit acts on
+RayHit pick = {};
+bool picked = false;
+
+// what the world thread did, for the window title
+typedef struct WorldTickStats
 {
-        int location = glGetUniformLocation(shader_program, loc);
-        if (location == -1)
-                return;//printf("Unable to locate uniform %s in shader %d\n",loc,shader_program);
-        else
-                glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
-}
-
-
-unsigned int load_shader(const char* vertex_shaderPath, const char* fragment_shaderPath)
+        // what the last drain that did anything did
+        EditStats edits;
+        int undo_cursor, undo_entries;
+        size_t undo_bytes, undo_spilled;
+        DedupStats dedup;
+        ChunkCacheStats cache;
+}WorldTickStats;
+
+// the live world belongs to the simulation thread, which edits, uploads, evicts and publishes it on every
+// tick (see world_tick_run). the frame loop only ever reads snapshots, so mutex just guards the handoff
+// below and neither side holds it while it works: a slow frame doesn't hold ticks or edits up
+typedef struct WorldTick
 {
-        // VERTEX
-        char * vertex_source;
-        int vertex_file = read_file(vertex_shaderPath, &vertex_source);
-        if (vertex_file != 0)
-        {
-                printf("unable to compile shader. vertex shader couldn't be found.\n");
-                return -1;
-        }
-	
-	    unsigned int vertex_shader;
-	    vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-	    glShaderSource(vertex_shader, 1, (const char* const *)&vertex_source, NULL);
-	    glCompileShader(vertex_shader);
-
-	    int vertex_success;
-	    char vertex_info_log[512];
-	    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &vertex_success);
-	    if(!vertex_success)
-	    {
-	    	glGetShaderInfoLog(vertex_shader, 512, NULL, vertex_info_log);
-	    	printf("ERROR::SHADER::VERTEX::COMPILATION_FAILED: %s\n",vertex_info_log);
-	    }
-	    free(vertex_source);
-
-        // FRAGMENT
-
-        char * fragment_source;
-        int fragment_file = read_file(fragment_shaderPath, &fragment_source);
-        if (fragment_file != 0)
+        std::mutex mutex;
+        World* world;
+        Journal* journal;
+        SaveWorker* saver;
+        bool saving;
+        UploadWorker* uploader;
+        ChunkDedup* dedup;
+        ChunkCache* cache;
+        ChunkStore* store;
+
+        // from the frame loop: the camera and, unless gpu culling keeps it on the gpu, what it drew last.
+        // visible_fresh until a tick swaps visible out for cache_visible
+        glm::vec3 camera_voxel;
+        VisibleChunks visible;
+        bool visible_known, visible_fresh;
+        // to the frame loop, as of the last tick
+        WorldTickStats stats;
+
+        // tick only
+        VisibleChunks cache_visible;
+}WorldTick;
+
+
+// every queued edit and undo/redo step lands in the chunk dirty boxes, the log reads them before the
+// upload consumes them. then the world goes out as the snapshot the next frame draws
+void world_tick_run(void* user)
+{
+        WorldTick* tick = (WorldTick*)user;
+        glm::vec3 camera_voxel;
+        bool visible_known;
         {
-                printf("unable to compile shader. fragment shader couldn't be found.\n");
-                return -1;
+                std::lock_guard<std::mutex> lock(tick->mutex);
+                camera_voxel = tick->camera_voxel;
+                visible_known = tick->visible_known;
+                if (tick->visible_fresh)
+                        std::swap(tick->visible, tick->cache_visible);
+                tick->visible_fresh = false;
         }
 
-	    unsigned int fragment_shader;
-	    fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	    glShaderSource(fragment_shader, 1, (const char* const *)&fragment_source, NULL);
-	    glCompileShader(fragment_shader);
-	    
-	    int fragment_success;
-	    char fragment_info_log[512];
-	    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &fragment_success);
-	    if(!fragment_success)
-	    {
-	    	glGetShaderInfoLog(fragment_shader, 512, NULL, fragment_info_log);
-	    	printf("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED: %s\n",fragment_info_log);
-	    }
-	    free(fragment_source);
-
-	    //SHADER PROGRAM
-	    unsigned int shader = glCreateProgram();
-	    glAttachShader(shader, vertex_shader);
-	    glAttachShader(shader, fragment_shader);
-	    glLinkProgram(shader);
-
-	    int shader_success;
-	    char shader_info_log[512];
-	    glGetProgramiv(shader, GL_LINK_STATUS, &shader_success);
-	    if(!shader_success)
-	    {
-	    	glGetProgramInfoLog(shader, 512, NULL, shader_info_log);
-	    	printf("ERROR::SHADER::PROGRAM::COMPILATION_FAILED: %s\n",shader_info_log);
-	    }
-	    
-	    glDeleteShader(vertex_shader);
-	    glDeleteShader(fragment_shader);
-
-	    return shader;
+        EditStats drained;
+        bool drain = edit_queue_drain(&edit_queue, tick->world, &drained) || drained.rejected;
+        int pending = journal_pending.exchange(0);
+        while (pending < 0 && journal_undo(tick->journal, tick->world))
+                pending++;
+        while (pending > 0 && journal_redo(tick->journal, tick->world))
+                pending--;
+        if (tick->saving)
+                save_log_dirty(tick->saver, tick->world);
+
+        upload_dirty_chunks(tick->uploader, tick->world);
+        chunk_dedup_world(tick->dedup, tick->world, false);
+        chunk_cache_update(tick->cache, tick->world, camera_voxel, visible_known ? &tick->cache_visible : NULL);
+        // after the upload so edited chunks go out with their mips rebuilt
+        chunk_store_publish(tick->store, tick->world);
+        if (tick->saving)
+                save_checkpoint(tick->saver, false);
+
+        std::lock_guard<std::mutex> lock(tick->mutex);
+        if (drain)
+                tick->stats.edits = drained;
+        tick->stats.undo_cursor = tick->journal->cursor;
+        tick->stats.undo_entries = (int)tick->journal->entries.size();
+        tick->stats.undo_bytes = tick->journal->memory_bytes;
+        tick->stats.undo_spilled = tick->journal->spilled_bytes;
+        tick->stats.dedup = tick->dedup->stats;
+        tick->stats.cache = tick->cache->stats;
 }
 
 
-float vertex_data[] = {
-        // VERTEX           UV
-        -1.0f, -1.0f, 0.0f, 1.0f,1.0f,
-        -1.0f,  1.0f, 0.0f, 1.0f,0.0f,
-         1.0f,  1.0f, 0.0f, 0.0f,0.0f,
-
-         1.0f,  1.0f, 0.0f, 0.0f,0.0f,
-         1.0f, -1.0f, 0.0f, 0.0f,1.0f,
-        -1.0f, -1.0f, 0.0f, 1.0f,1.0f
-};
-
-
-// Update the framebuffer size to the window size 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-        glViewport(0,0,width,height);
+        if (action != GLFW_PRESS)
+                return;
+        if (key >= GLFW_KEY_1 && key < GLFW_KEY_1 + RENDER_MODE_COUNT)
+                render_mode = key - GLFW_KEY_1;
+        if (key == GLFW_KEY_C)
+                lattice_cull = !lattice_cull;
+        if (key == GLFW_KEY_G)
+                gpu_culling = !gpu_culling;
+        if (key == GLFW_KEY_K)
+                clipmap_enabled = !clipmap_enabled;
+        if (key == GLFW_KEY_P)
+                atlas_enabled = !atlas_enabled;
+        if (key == GLFW_KEY_V)
+                present_mode = (present_mode + 1) % PRESENT_MODE_COUNT;
+        if (key == GLFW_KEY_F)
+                frames_in_flight = frames_in_flight % PRESENT_MAX_FRAMES_IN_FLIGHT + 1;
+        if (key == GLFW_KEY_Z && (mods & GLFW_MOD_CONTROL))
+                journal_pending--;
+        if (key == GLFW_KEY_Y && (mods & GLFW_MOD_CONTROL))
+                journal_pending++;
+        if (key == GLFW_KEY_B)
+                brush_shape = (brush_shape + 1) % BRUSH_SHAPE_COUNT;
+        if (key == GLFW_KEY_LEFT_BRACKET && brush_radius > 1)
+                brush_radius /= 2;
+        if (key == GLFW_KEY_RIGHT_BRACKET && brush_radius < CHUNK_SIZE)
+                brush_radius *= 2;
 }
 
 
-// global client camera
-struct Camera camera;
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+        if (action != GLFW_PRESS || !picked)
+                return;
+
+        Brush brush = {};
+        if (button == GLFW_MOUSE_BUTTON_LEFT)
+                brush.op = BRUSH_SUBTRACT;
+        else if (button == GLFW_MOUSE_BUTTON_RIGHT)
+                brush.op = BRUSH_ADD;
+        else if (button == GLFW_MOUSE_BUTTON_MIDDLE)
+                brush.op = BRUSH_PAINT;
+        else
+                return;
+        brush.shape = brush_shape;
+        brush.extent = glm::vec3((float)brush_radius);
+        brush.material = brush.op == BRUSH_PAINT ? 1 : 3;
+        // adding grows from the face that was hit instead of the voxel itself
+        glm::ivec3 voxel = brush.op == BRUSH_ADD ? pick.voxel + pick.normal : pick.voxel;
+        brush.center = glm::vec3(voxel) + 0.5f;
+        edit_queue_push(&edit_queue, &brush);
+}
 
 
 void camera_process(GLFWwindow* window, struct Camera* camera)
@@ -244,46 +274,100 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
         x_offset *= camera.sensitivity;
         y_offset *= camera.sensitivity;
 
-        camera.yaw += x_offset;
-        camera.pitch -= y_offset;
-
-        if (camera.pitch > 89.0f)
-                camera.pitch = 89.0f;
-        if (camera.pitch < -89.0f)
-                camera.pitch = -89.0f;
-        
-        camera.direction.x = cos(glm::radians(camera.yaw)) * cos(glm::radians(camera.pitch));
-        camera.direction.y = sin(glm::radians(camera.pitch));
-        camera.direction.z = sin(glm::radians(camera.yaw)) * cos(glm::radians(camera.pitch));
+        // applied (and the pitch clamped) by the next simulation tick
+        simulation_look(&simulation, x_offset, -y_offset);
 }
 
 
-void input_process(GLFWwindow* window, struct Camera* camera, float frame_delta)
+// movement is only sampled here, the simulation thread integrates it at a fixed rate
+void input_process(GLFWwindow* window)
 {
         if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
                 glfwSetWindowShouldClose(window, true);
-        if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-                camera->position += camera->speed * frame_delta * camera->front;
-        if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-                camera->position -= camera->speed * frame_delta * camera->front;
-        if(glfwGetKey(window, GLFW_KEY_A))
-                camera->position -= glm::normalize(glm::cross(camera->front, camera->up)) * camera->speed * frame_delta;
-        if(glfwGetKey(window, GLFW_KEY_D))
-                camera->position += glm::normalize(glm::cross(camera->front, camera->up)) * camera->speed * frame_delta;
-        if(glfwGetKey(window, GLFW_KEY_LEFT_SHIFT))
-                camera->position -= camera->up * camera->speed * frame_delta;
-        if(glfwGetKey(window, GLFW_KEY_SPACE))
-                camera->position += camera->up * camera->speed * frame_delta;
-        if(glfwGetKey(window, GLFW_KEY_LEFT_CONTROL))
-                camera->speed = 2.0f;
-        else
-                camera->speed = 1.0f;
+        simulation_sample_input(&simulation, window);
 }
 
 
+// one texel per voxel holding its material, 0 is air.
+// mip levels are the chunk mips (majority vote material, 0 only where the whole cell is air)
 void chunk_texture(unsigned int * texture_id, int* texture_size, int width, int height, int depth)
 {
         printf("%d %d %d\n",width, height, depth);
+
+        glGenTextures(1, texture_id);
+        glBindTexture(GL_TEXTURE_3D, *texture_id);
+        glTexStorage3D(GL_TEXTURE_3D, CHUNK_MIP_LEVELS, GL_R8UI, width, height, depth);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        *texture_size = 0;
+        for (int level = 0 ; level < CHUNK_MIP_LEVELS ; level++)
+                *texture_size += (width >> level)*(height >> level)*(depth >> level);
+}
+
+
+// the chunk index for the ray marcher, a ChunkTag per chunk
+void chunk_tag_texture(unsigned int* texture_id, int width, int height, int depth)
+{
+        glGenTextures(1, texture_id);
+        glBindTexture(GL_TEXTURE_3D, *texture_id);
+        glTexStorage3D(GL_TEXTURE_3D, 1, GL_R8UI, width, height, depth);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+
+// every clipmap level stacked along z, see clipmap.h
+void clipmap_texture(unsigned int* texture_id)
+{
+        glGenTextures(1, texture_id);
+        glBindTexture(GL_TEXTURE_3D, *texture_id);
+        glTexStorage3D(GL_TEXTURE_3D, 1, GL_R8UI, CLIPMAP_SIZE, CLIPMAP_SIZE, CLIPMAP_SIZE*CLIPMAP_LEVELS);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+
+// chunk sized bricks with their mips, and the page table saying which brick (if any) holds each chunk.
+// see brick_atlas.h
+void brick_atlas_textures(unsigned int* atlas_id, unsigned int* pages_id, glm::ivec3 slots, int width, int height, int depth)
+{
+        glGenTextures(1, atlas_id);
+        glBindTexture(GL_TEXTURE_3D, *atlas_id);
+        glTexStorage3D(GL_TEXTURE_3D, CHUNK_MIP_LEVELS, GL_R8UI, slots.x*CHUNK_SIZE, slots.y*CHUNK_SIZE, slots.z*CHUNK_SIZE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, pages_id);
+        glBindTexture(GL_TEXTURE_3D, *pages_id);
+        glTexStorage3D(GL_TEXTURE_3D, 1, GL_R16UI, width, height, depth);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+
+// per axis bit sliced occupancy, filled by the upload worker
+void slab_textures(unsigned int texture_ids[3], int* texture_size, glm::ivec3 world_size)
+{
+        glGenTextures(3, texture_ids);
+        *texture_size = 0;
+        for (int axis = 0 ; axis < 3 ; axis++)
+        {
+                glm::ivec2 size = bitslab_texture_size(world_size, axis);
+                glBindTexture(GL_TEXTURE_2D, texture_ids[axis]);
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, size.x, size.y);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                *texture_size += size.x*size.y*sizeof(uint32_t);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 
@@ -293,7 +377,7 @@ int main(int argc, char* argv[])
 		        return -1;
 
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
 
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -315,6 +399,8 @@ int main(int argc, char* argv[])
 
         glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
         glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
 
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -346,44 +432,240 @@ int main(int argc, char* argv[])
         if (shader == -1 || shader == 0)
             return -1;
 
-        int lattice_width=10,lattice_height=5,lattice_depth=10;
-        int chunk_data_size = lattice_width*lattice_height*lattice_depth;
-        printf("chunk data size: %d\n",chunk_data_size);
-        int* chunk_data = (int*) malloc(chunk_data_size*sizeof(int));
-        printf("size of chunk_data: %zu\n",chunk_data_size*sizeof(int));
-
-        for (int i = 0 ; i < chunk_data_size ; i++)
+        // the lattice is measured in chunks
+        int lattice_width=4,lattice_height=2,lattice_depth=4;
+        // a save carries on the world it was made for
+        unsigned int seed = rand();
+        save_read_seed("save", &seed);
+        World world = {};
+        if (world_create(&world, lattice_width, lattice_height, lattice_depth, seed) != 0)
         {
-                *(chunk_data+i) = rand()%2;
+                printf("unable to allocate the world.\n");
+                return -1;
+        }
+        // other threads read the world through snapshots, edits copy the chunks they touch
+        ChunkStore chunk_store;
+        SaveWorker saver;
+        // --region-images has checkpoints write uncompressed chunk images, which load without decoding
+        int save_format = SAVE_FORMAT_COMPRESSED;
+        // --ram-budget and --vram-budget (in MB) bound the resident chunk material and the mesh vertex buffer
+        size_t ram_budget = CHUNK_CACHE_RAM_BUDGET, vram_budget = MESH_VRAM_BUDGET;
+        for (int i = 1 ; i < argc ; i++)
+        {
+                if (strcmp(argv[i], "--region-images") == 0)
+                        save_format = SAVE_FORMAT_IMAGES;
+                else if (strcmp(argv[i], "--ram-budget") == 0 && i+1 < argc)
+                        ram_budget = (size_t)atoi(argv[++i]) << 20;
+                else if (strcmp(argv[i], "--vram-budget") == 0 && i+1 < argc)
+                        vram_budget = (size_t)atoi(argv[++i]) << 20;
         }
+        // only chunks that differ from the terrain generator are stored, the rest comes back from it
+        GeneratorCache generator;
+        generator_cache_init(&generator, world.seed, GENERATOR_CACHE_CHUNKS);
+        bool saving = save_open(&saver, "save", &world, &chunk_store, save_format, &generator) == 0;
+        if (!saving)
+                printf("saving is off for this session\n");
+        if (chunk_store_init(&chunk_store, &world) != 0)
+                return -1;
+        // the mesher, culling, pick and the textures all read the world through this reader's snapshots
+        int render_reader = snapshot_reader_register(&chunk_store);
+        if (render_reader < 0)
+                return -1;
+        Journal journal;
+        if (journal_init(&journal, JOURNAL_MEMORY_BUDGET) != 0)
+                return -1;
+        world.journal = &journal;
+        int chunk_data_size = world_chunk_count(&world);
+        printf("chunk data size: %d\n",chunk_data_size);
+        printf("size of chunk_data: %zu\n",chunk_data_size*(sizeof(Chunk)+sizeof(ChunkMaterial)));
+        // uniform and identical chunks share their material from here on
+        ChunkDedup dedup;
+        chunk_dedup_init(&dedup, &world);
+        chunk_dedup_world(&dedup, &world, true);
+        printf("chunk dedup: %d empty %d solid %d shared, material %zuKB instead of %zuKB\n", dedup.stats.empty, dedup.stats.solid,
+               dedup.stats.shared, dedup.stats.bytes_resident/1024, dedup.stats.bytes_unshared/1024);
+        // chunks away from the camera give up their material once it passes the budget
+        ChunkCache chunk_cache;
+        chunk_cache_init(&chunk_cache, &world, ram_budget, CHUNK_CACHE_PACKED_BUDGET, &generator);
 
         unsigned int texture;
         int texture_size;
-        chunk_texture(&texture, &texture_size, lattice_width, lattice_height, lattice_depth);
+        chunk_texture(&texture, &texture_size, lattice_width*CHUNK_SIZE, lattice_height*CHUNK_SIZE, lattice_depth*CHUNK_SIZE);
+
+        glm::ivec3 world_size = glm::ivec3(lattice_width, lattice_height, lattice_depth) * CHUNK_SIZE;
+        unsigned int slabs[3];
+        int slabs_size;
+        slab_textures(slabs, &slabs_size, world_size);
+
+        unsigned int tag_texture;
+        chunk_tag_texture(&tag_texture, lattice_width, lattice_height, lattice_depth);
+        // what the texture holds, it is only written when a tag changes
+        std::vector<uint8_t> uploaded_tags(chunk_data_size, 0xff);
+
+        unsigned int clipmap_texture_id;
+        clipmap_texture(&clipmap_texture_id);
+        Clipmap clipmap;
+        clipmap_init(&clipmap);
+
+        // a slot for every chunk, uniform ones leave theirs free
+        BrickAtlas atlas;
+        glm::ivec3 atlas_slots = glm::ivec3(lattice_width, lattice_height, lattice_depth);
+        if (brick_atlas_init(&atlas, &world, atlas_slots) != 0)
+                return -1;
+        unsigned int atlas_texture, page_texture;
+        brick_atlas_textures(&atlas_texture, &page_texture, atlas_slots, lattice_width, lattice_height, lattice_depth);
+
+        unsigned int occupancy_buffer;
+        glGenBuffers(1, &occupancy_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, occupancy_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)chunk_data_size*CHUNK_COLUMNS*sizeof(uint64_t), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        // the upload context has to see fully created objects
+        glFinish();
+
+        UploadTargets upload_targets = { texture, occupancy_buffer, { slabs[0], slabs[1], slabs[2] }, world_size };
+        UploadWorker uploader;
+        if (upload_worker_init(&uploader, window, upload_targets) != 0)
+                return -1;
+        UploadMetrics upload_metrics = {};
+
+        // chunks still exactly as an image region holds them go from disk to the gpu through the staging
+        // buffer, the save thread only touches saved_version once a checkpoint is queued
+        if (saving)
+        {
+                std::vector<int> loaded;
+                for (int i = 0 ; i < chunk_data_size ; i++)
+                        if (world.chunks[i]->dirty && world.chunks[i]->version == saver.saved_version[i])
+                                loaded.push_back(i);
+                JobPool pool;
+                job_pool_init(&pool, 0);
+                RegionReader reader;
+                if (region_reader_init(&reader, "save", &pool, REGION_READER_URING) == 0)
+                {
+                        int streamed = upload_region_images(&uploader, &reader, &world, loaded);
+                        if (streamed)
+                                printf("%d chunks uploaded straight from the region files\n", streamed);
+                        region_reader_destroy(&reader);
+                }
+                job_pool_destroy(&pool);
+        }
 
         glBindTexture(GL_TEXTURE_3D, texture);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, occupancy_buffer);
+
+        MeshRenderer mesh_renderer;
+        if (mesh_renderer_init(&mesh_renderer, &world, vram_budget) != 0)
+                return -1;
+
+        LatticeRenderer lattice_renderer;
+        if (lattice_renderer_init(&lattice_renderer, &world) != 0)
+                return -1;
+
+        GpuTimer gpu_timer;
+        gpu_timer_init(&gpu_timer);
+
+        ChunkBounds chunk_bounds;
+        chunk_bounds_build(&chunk_bounds, &world);
+        Frustum frustum;
+        VisibleChunks visible = {};
+
+        GpuCull gpu_cull;
+        if (gpu_cull_init(&gpu_cull, &world) != 0)
+                return -1;
 
         double previous_frame_time,current_frame_time,fps_frame_delta = 0.0f;
         unsigned int frame_count = 0;
 
-        double previous_time = 0.0f;
-
-        //glfwSwapInterval(0);
+        Present present;
+        present_init(&present, window);
 
         printf("vao: %d vbo: %d shader: %d vbo_size: %zu\n",vao,vbo,shader,vbo_size);
 
         glm::vec3 sun_light = glm::vec3(0.0f,5.0f,6.0f);
 
+        edit_queue_init(&edit_queue);
+        WorldTick world_tick;
+        world_tick.world = &world;
+        world_tick.journal = &journal;
+        world_tick.saver = &saver;
+        world_tick.saving = saving;
+        world_tick.uploader = &uploader;
+        world_tick.dedup = &dedup;
+        world_tick.cache = &chunk_cache;
+        world_tick.store = &chunk_store;
+        world_tick.camera_voxel = camera.position / VOXEL_SIZE;
+        world_tick.visible_known = false;
+        world_tick.visible_fresh = false;
+        world_tick.stats = {};
+        world_tick.stats.dedup = dedup.stats;
+        world_tick.stats.cache = chunk_cache.stats;
+        // the world is the simulation thread's from here on
+        simulation_init(&simulation, &camera, world_tick_run, &world_tick);
+
         while(!glfwWindowShouldClose(window))
         {
+                present.mode = present_mode;
+                present.frames_in_flight = frames_in_flight;
+                present_begin_frame(&present);
+                // the only place the frame meets the tick: the camera and last frame's visible list (still
+                // the newest known) go to the cache, the stats of the last tick come back
+                WorldTickStats tick_stats;
+                {
+                        std::lock_guard<std::mutex> lock(world_tick.mutex);
+                        world_tick.camera_voxel = camera.position / VOXEL_SIZE;
+                        world_tick.visible_known = !gpu_culling;
+                        if (!gpu_culling)
+                        {
+                                std::swap(world_tick.visible, visible);
+                                world_tick.visible_fresh = true;
+                        }
+                        tick_stats = world_tick.stats;
+                }
+                const EditStats& edit_stats = tick_stats.edits;
+
                 // calculate FPS
                 current_frame_time = glfwGetTime();
                 fps_frame_delta = current_frame_time - previous_frame_time;
                 frame_count++;
                 if (fps_frame_delta >= 1.0 / 30.0)
                 {
-                        char title[74];
-                        sprintf(title, "time: %f fps: %f yaw: %f pitch: %f roll: %f", (fps_frame_delta/frame_count) * 1000, (1.0f/fps_frame_delta) * frame_count, camera.yaw, camera.pitch, camera.roll);
+                        char title[1024];
+                        SaveMetrics save = {};
+                        if (saving)
+                                save_metrics(&saver, &save);
+                        // vram of the ray marcher is the voxel texture, clipmap and brick atlas plus the occupancy columns
+                        size_t vram = (size_t)texture_size + clipmap_texture_bytes() + brick_atlas_texture_bytes(&atlas)
+                                    + (size_t)chunk_data_size*CHUNK_COLUMNS*sizeof(uint64_t);
+                        int vertices = 6;
+                        char extra[64] = "";
+                        if (render_mode == RENDER_MESH)
+                        {
+                                vram = mesh_renderer.vram_bytes;
+                                vertices = mesh_renderer.quads*6;
+                        }
+                        else if (render_mode == RENDER_LATTICE)
+                        {
+                                vram = texture_size + slabs_size + lattice_renderer.vram_bytes;
+                                vertices = lattice_renderer.vertices_submitted;
+                                snprintf(extra, sizeof(extra), " cull: %d lod: %d shaded/px: %.2f written/px: %.2f",
+                                         lattice_renderer.cull_slices, lattice_renderer.min_lod, lattice_renderer.shaded_per_pixel, lattice_renderer.written_per_pixel);
+                        }
+                        snprintf(title, sizeof(title), "%s time: %f fps: %f gpu: %.3fms vram: %zuKB vertices: %d%s chunks: %d/%d cull: %.1fus mesh build: %.2fms upload queue: %d bytes/frame: %zu sim: %.0fhz dropped: %d present: %s/%d latency: %.2fms fence wait: %.2fms pick: %d %d %d face %d brush: %s r%d edits: %d/%d dropped %d voxels %d boxes %d %.1fus undo: %d/%d %zuKB spilled %zuKB save: %.2fms max %.2fms amplification %.1fx dedup: %zuKB/%zuKB empty %d ram: %zuMB/%zuMB used %d%s packed %zuKB spilled %zuKB clipmap: %s %d blocks %zuKB %.2fms atlas: %s %d/%d slots %d missing %d moves",
+                                 render_mode_names[render_mode], (fps_frame_delta/frame_count) * 1000, (1.0f/fps_frame_delta) * frame_count,
+                                 gpu_timer.milliseconds, vram/1024, vertices, extra, gpu_culling ? gpu_cull.drawn : visible.count, chunk_data_size, visible.cull_microseconds, mesh_renderer.build_milliseconds,
+                                 upload_metrics.queue_depth, upload_metrics.bytes_per_frame,
+                                 simulation.ticks.exchange(0) / fps_frame_delta, simulation.dropped.exchange(0),
+                                 present_mode_names[present.mode], present.frames_in_flight, present.latency_milliseconds, present.fence_wait_milliseconds,
+                                 picked ? pick.voxel.x : -1, picked ? pick.voxel.y : -1, picked ? pick.voxel.z : -1, picked ? pick.face : -1,
+                                 brush_shape_names[brush_shape], brush_radius, edit_stats.commands - edit_stats.coalesced, edit_stats.commands,
+                                 edit_stats.rejected, edit_stats.voxels, edit_stats.boxes, edit_stats.microseconds,
+                                 tick_stats.undo_cursor, tick_stats.undo_entries, tick_stats.undo_bytes/1024, tick_stats.undo_spilled/1024,
+                                 save.latency_milliseconds, save.latency_max_milliseconds, save.write_amplification,
+                                 tick_stats.dedup.bytes_resident/1024, tick_stats.dedup.bytes_unshared/1024, tick_stats.dedup.empty,
+                                 tick_stats.cache.resident_bytes >> 20, chunk_cache.ram_budget >> 20, tick_stats.cache.used,
+                                 tick_stats.cache.by_distance ? " by distance" : "", tick_stats.cache.packed_bytes/1024, tick_stats.cache.spilled_bytes/1024,
+                                 clipmap_enabled ? "on" : "off", clipmap.uploaded_blocks, clipmap.staging.size()/1024, clipmap.milliseconds,
+                                 atlas_enabled ? "on" : "off", atlas.pool.used, atlas.pool.capacity, atlas.missing, (int)atlas.moves.size());
                         glfwSetWindowTitle(window, title);
                         previous_frame_time = current_frame_time;
                         frame_count = 0;
@@ -392,39 +674,199 @@ int main(int argc, char* argv[])
                 glClearColor(0.4f,0.5f,0.6f,1.0f);
 		        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-                input_process(window, &camera, glfwGetTime()-previous_time);
-
-                previous_time = glfwGetTime();
+                // the ticks since the last frame queued the uploads of their edits (see world_tick_run),
+                // whatever the upload thread has finished is swapped in. the draws below wait on the gpu for
+                // every upload issued so far
+                upload_worker_collect(&uploader);
+                upload_worker_metrics(&uploader, &upload_metrics);
 
+                // the frame reads the snapshot the last tick published, never the live world
+                const WorldSnapshot* snapshot = snapshot_acquire(&chunk_store, render_reader);
+                const World* view = &snapshot->world;
+                if (memcmp(uploaded_tags.data(), view->tags, chunk_data_size) != 0)
+                {
+                        memcpy(uploaded_tags.data(), view->tags, chunk_data_size);
+                        glBindTexture(GL_TEXTURE_3D, tag_texture);
+                        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, view->width, view->height, view->depth, GL_RED_INTEGER, GL_UNSIGNED_BYTE, view->tags);
+                        glBindTexture(GL_TEXTURE_3D, texture);
+                }
+                // only the slices entering a window as the camera crosses chunks, and chunks edited inside one
+                if (clipmap_enabled)
+                {
+                        clipmap_update(&clipmap, view, camera.position / VOXEL_SIZE);
+                        glBindTexture(GL_TEXTURE_3D, clipmap_texture_id);
+                        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                        for (const ClipmapUpload& upload : clipmap.uploads)
+                                glTexSubImage3D(GL_TEXTURE_3D, 0, upload.texel.x, upload.texel.y, upload.texel.z, upload.size, upload.size, upload.size,
+                                                GL_RED_INTEGER, GL_UNSIGNED_BYTE, &clipmap.staging[upload.offset]);
+                        glBindTexture(GL_TEXTURE_3D, texture);
+                }
+                // new and edited bricks, then the moves packing the atlas, then the pages pointing at them
+                if (atlas_enabled)
+                {
+                        brick_atlas_update(&atlas, view, BRICK_ATLAS_MOVES_PER_FRAME);
+                        glBindTexture(GL_TEXTURE_3D, atlas_texture);
+                        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                        for (const BrickUpload& upload : atlas.uploads)
+                        {
+                                glm::ivec3 origin = brick_atlas_slot_origin(&atlas, upload.slot);
+                                const uint8_t* brick = &atlas.staging[upload.offset];
+                                for (int level = 0 ; level < CHUNK_MIP_LEVELS ; level++)
+                                {
+                                        int size = chunk_mip_size(level);
+                                        glm::ivec3 texel = origin >> level;
+                                        glTexSubImage3D(GL_TEXTURE_3D, level, texel.x, texel.y, texel.z, size, size, size, GL_RED_INTEGER, GL_UNSIGNED_BYTE,
+                                                        level ? brick + CHUNK_VOLUME + chunk_mip_offset(level) : brick);
+                                }
+                        }
+                        for (const BrickMove& move : atlas.moves)
+                        {
+                                glm::ivec3 from = brick_atlas_slot_origin(&atlas, move.from), to = brick_atlas_slot_origin(&atlas, move.to);
+                                for (int level = 0 ; level < CHUNK_MIP_LEVELS ; level++)
+                                {
+                                        int size = chunk_mip_size(level);
+                                        glCopyImageSubData(atlas_texture, GL_TEXTURE_3D, level, from.x >> level, from.y >> level, from.z >> level,
+                                                           atlas_texture, GL_TEXTURE_3D, level, to.x >> level, to.y >> level, to.z >> level, size, size, size);
+                                }
+                        }
+                        if (atlas.pages_changed)
+                        {
+                                glBindTexture(GL_TEXTURE_3D, page_texture);
+                                glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, view->width, view->height, view->depth, GL_RED_INTEGER, GL_UNSIGNED_SHORT, atlas.pages.data());
+                                atlas.pages_changed = false;
+                        }
+                        glBindTexture(GL_TEXTURE_3D, texture);
+                }
+                // the camera is latched as late as possible, right before culling and drawing use it
+                input_process(window);
+                simulation_interpolate(&simulation, glfwGetTime(), &camera);
                 camera_process(window, &camera);
+                picked = raycast(view, camera.position / VOXEL_SIZE, camera.front, 256.0f, &pick);
 
-                glUseProgram(shader);
-                
-                set_shader_value_float("TIME", glfwGetTime(), shader);
-                set_shader_value_vec2("RESOLUTION", camera.resolution, shader);
+                if (gpu_culling)
+                {
+                        // the cpu doesn't look at single chunks at all, the lattice just gets the whole world
+                        visible.count = 0;
+                        visible.min = glm::ivec3(0);
+                        visible.max = glm::ivec3(view->width, view->height, view->depth);
+                        visible.cull_microseconds = 0.0;
+                }
+                else
+                {
+                        frustum_extract(&frustum, camera.projection * camera.view);
+                        frustum_visible_chunks(&frustum, &chunk_bounds, view, &visible);
+                }
 
-                set_shader_value_vec3("light", sun_light, shader);
+                gpu_timer_begin(&gpu_timer);
+                if (render_mode == RENDER_MESH)
+                {
+                        mesh_renderer_update(&mesh_renderer, view, gpu_culling ? NULL : &visible);
+                        if (gpu_culling)
+                        {
+                                int framebuffer_width, framebuffer_height;
+                                glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+                                gpu_cull_begin_frame(&gpu_cull, framebuffer_width, framebuffer_height);
+                                gpu_cull_dispatch(&gpu_cull, &camera, mesh_renderer.range_buffer);
+                                mesh_renderer_draw_indirect(&mesh_renderer, &camera, texture,
+                                                            gpu_cull.command_buffer, gpu_cull.count_buffer, chunk_data_size);
+                                gpu_cull_end_frame(&gpu_cull, &camera);
+                        }
+                        else
+                                mesh_renderer_draw(&mesh_renderer, view, &visible, &camera, texture);
+                }
+                else if (render_mode == RENDER_LATTICE)
+                {
+                        lattice_renderer.cull_slices = lattice_cull;
+                        lattice_renderer_draw(&lattice_renderer, &visible, &camera, texture, slabs);
+                }
+                else
+                {
+                        glUseProgram(shader);
                 
-                set_shader_value_float("yaw", glm::radians(camera.yaw), shader);
-                set_shader_value_float("pitch", glm::radians(camera.pitch), shader);
-                set_shader_value_float("roll", glm::radians(camera.roll), shader);
-                set_shader_value_vec3("camera_front", camera.front, shader);
-                set_shader_value_vec3("camera_up", camera.up, shader);
-                set_shader_value_vec3("camera_right", camera.right, shader);
-                set_shader_value_vec3("camera_position", camera.position, shader);
-                set_shader_value_float("fov", glm::radians(camera.fov), shader);
-                set_shader_value_float("near", camera.near, shader);
-                set_shader_value_float("far", camera.far, shader);
+                        set_shader_value_float("TIME", glfwGetTime(), shader);
+                        set_shader_value_vec2("RESOLUTION", camera.resolution, shader);
+
+                        set_shader_value_vec3("light", sun_light, shader);
                 
-                glBindVertexArray(vao);
-                glDrawArrays(GL_TRIANGLES, 0, vbo_size);
+                        set_shader_value_float("yaw", glm::radians(camera.yaw), shader);
+                        set_shader_value_float("pitch", glm::radians(camera.pitch), shader);
+                        set_shader_value_float("roll", glm::radians(camera.roll), shader);
+                        set_shader_value_vec3("camera_front", camera.front, shader);
+                        set_shader_value_vec3("camera_up", camera.up, shader);
+                        set_shader_value_vec3("camera_right", camera.right, shader);
+                        set_shader_value_vec3("camera_position", camera.position, shader);
+                        set_shader_value_float("fov", glm::radians(camera.fov), shader);
+                        set_shader_value_float("near", camera.near, shader);
+                        set_shader_value_float("far", camera.far, shader);
+
+                        glActiveTexture(GL_TEXTURE0);
+                        glBindTexture(GL_TEXTURE_3D, texture);
+                        set_shader_value_int("VOXELS", 0, shader);
+                        glActiveTexture(GL_TEXTURE1);
+                        glBindTexture(GL_TEXTURE_3D, tag_texture);
+                        set_shader_value_int("CHUNK_TAGS", 1, shader);
+                        glActiveTexture(GL_TEXTURE2);
+                        glBindTexture(GL_TEXTURE_3D, clipmap_texture_id);
+                        set_shader_value_int("CLIPMAP", 2, shader);
+                        set_shader_value_int("use_clipmap", clipmap_enabled, shader);
+                        glActiveTexture(GL_TEXTURE3);
+                        glBindTexture(GL_TEXTURE_3D, atlas_texture);
+                        set_shader_value_int("ATLAS", 3, shader);
+                        glActiveTexture(GL_TEXTURE4);
+                        glBindTexture(GL_TEXTURE_3D, page_texture);
+                        set_shader_value_int("PAGES", 4, shader);
+                        set_shader_value_ivec3("atlas_slots", atlas.slots, shader);
+                        set_shader_value_int("use_atlas", atlas_enabled, shader);
+                        for (int level = 0 ; level < CLIPMAP_LEVELS ; level++)
+                        {
+                                char name[32];
+                                snprintf(name, sizeof(name), "clipmap_origin[%d]", level);
+                                set_shader_value_ivec3(name, clipmap_level_origin(&clipmap, level), shader);
+                        }
+                        glActiveTexture(GL_TEXTURE0);
+                        set_shader_value_ivec3("world_size", world_size, shader);
+                        set_shader_value_float("voxel_size", VOXEL_SIZE, shader);
                 
-                glfwSwapBuffers(window);
+                        glBindVertexArray(vao);
+                        glDrawArrays(GL_TRIANGLES, 0, vbo_size);
+                }
+                gpu_timer_end(&gpu_timer);
+                snapshot_release(&chunk_store, render_reader);
+
+                // a pyramid from frames ago would cull against the wrong view
+                if (render_mode != RENDER_MESH || !gpu_culling)
+                        gpu_cull.has_history = false;
 
-		        glfwPollEvents();
+                present_end_frame(&present);
 	    }
 
-        free(chunk_data);
+        simulation_destroy(&simulation);
+        present_destroy(&present);
+        gpu_timer_destroy(&gpu_timer);
+        gpu_cull_destroy(&gpu_cull);
+        lattice_renderer_destroy(&lattice_renderer);
+        mesh_renderer_destroy(&mesh_renderer);
+        upload_worker_destroy(&uploader);
+        if (saving)
+                save_close(&saver);
+        generator_cache_destroy(&generator);
+        world.journal = NULL;
+        journal_destroy(&journal);
+        chunk_store_destroy(&chunk_store, &world);
+        chunk_dedup_destroy(&dedup);
+        world_destroy(&world);
+        chunk_cache_destroy(&chunk_cache);
+        clipmap_destroy(&clipmap);
+        brick_atlas_destroy(&atlas);
+
+        glDeleteTextures(3, slabs);
+        glDeleteTextures(1, &texture);
+        glDeleteTextures(1, &tag_texture);
+        glDeleteTextures(1, &clipmap_texture_id);
+        glDeleteTextures(1, &atlas_texture);
+        glDeleteTextures(1, &page_texture);
+        glDeleteBuffers(1, &occupancy_buffer);
 
         glfwTerminate();
 
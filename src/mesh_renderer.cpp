@@ -0,0 +1,262 @@
+#include "mesh_renderer.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <GLFW/glfw3.h>
+
+#include "mesher.h"
+#include "shader.h"
+
+
+int mesh_renderer_init(MeshRenderer* renderer, const World* world, size_t vram_budget)
+{
+        renderer->shader = load_shader("resources/meshVertex.glsl","resources/meshFragment.glsl");
+        if (renderer->shader == (unsigned int)-1 || renderer->shader == 0)
+                return -1;
+
+        int chunk_count = world_chunk_count(world);
+        renderer->chunk_vertices.assign(chunk_count, std::vector<uint32_t>());
+        // never matches a real version so everything is meshed on the first update
+        renderer->meshed_version.assign(chunk_count, ~0u);
+        renderer->first.assign(chunk_count, 0);
+        renderer->count.assign(chunk_count, 0);
+        renderer->page_first.assign(chunk_count, -1);
+        renderer->used.assign(chunk_count, 0);
+        renderer->frame = 0;
+        renderer->build_milliseconds = 0.0;
+        renderer->quads = 0;
+        renderer->evicted = 0;
+        renderer->uploaded = 0;
+
+        size_t page_bytes = MESH_PAGE_VERTICES*sizeof(uint32_t);
+        int page_count = (int)(vram_budget / page_bytes);
+        slot_pool_init(&renderer->pages, page_count);
+        renderer->vbo_capacity = (size_t)page_count*page_bytes;
+        renderer->vram_bytes = renderer->vbo_capacity + chunk_count*(sizeof(glm::ivec4) + 2*sizeof(unsigned int));
+
+        glGenVertexArrays(1, &renderer->vao);
+        glGenBuffers(1, &renderer->vbo);
+
+        glBindVertexArray(renderer->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+        glBufferData(GL_ARRAY_BUFFER, renderer->vbo_capacity, NULL, GL_DYNAMIC_DRAW);
+        glVertexAttribIPointer(0,1,GL_UNSIGNED_INT,sizeof(uint32_t),(void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+        std::vector<glm::ivec4> origins(chunk_count, glm::ivec4(0));
+        for (int i = 0 ; i < chunk_count ; i++)
+                if (world->chunks[i])
+                        origins[i] = glm::ivec4(world->chunks[i]->coord*CHUNK_SIZE, 0);
+
+        glGenBuffers(1, &renderer->origin_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderer->origin_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, chunk_count*sizeof(glm::ivec4), origins.data(), GL_STATIC_DRAW);
+
+        glGenBuffers(1, &renderer->range_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderer->range_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, chunk_count*2*sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        return 0;
+}
+
+
+void mesh_renderer_destroy(MeshRenderer* renderer)
+{
+        glDeleteBuffers(1, &renderer->origin_buffer);
+        glDeleteBuffers(1, &renderer->range_buffer);
+        glDeleteBuffers(1, &renderer->vbo);
+        glDeleteVertexArrays(1, &renderer->vao);
+        glDeleteProgram(renderer->shader);
+}
+
+
+static int pages_for(size_t vertices)
+{
+        return (int)((vertices + MESH_PAGE_VERTICES - 1) / MESH_PAGE_VERTICES);
+}
+
+
+static void release_pages(MeshRenderer* renderer, int i)
+{
+        if (renderer->page_first[i] >= 0)
+                slot_pool_free(&renderer->pages, renderer->page_first[i], pages_for(renderer->chunk_vertices[i].size()));
+        renderer->page_first[i] = -1;
+        renderer->count[i] = 0;
+}
+
+
+// pages for the mesh of chunk i, taken from the meshes not drawn for the longest when the pool is full.
+// -1 when even that doesn't free a long enough run
+static int acquire_pages(MeshRenderer* renderer, int i, int pages)
+{
+        int first = slot_pool_alloc(&renderer->pages, pages);
+        if (first >= 0)
+                return first;
+
+        std::vector<int> order;
+        for (int c = 0 ; c < (int)renderer->page_first.size() ; c++)
+                if (c != i && renderer->page_first[c] >= 0 && renderer->used[c] != renderer->frame)
+                        order.push_back(c);
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return renderer->used[a] < renderer->used[b]; });
+        for (int c : order)
+        {
+                release_pages(renderer, c);
+                renderer->evicted++;
+                first = slot_pool_alloc(&renderer->pages, pages);
+                if (first >= 0)
+                        return first;
+        }
+        return -1;
+}
+
+
+void mesh_renderer_update(MeshRenderer* renderer, const World* world, const VisibleChunks* visible)
+{
+        int chunk_count = world_chunk_count(world);
+        std::vector<bool> remesh(chunk_count, false);
+        bool changed = false;
+        uint64_t frame = ++renderer->frame;
+        renderer->evicted = 0;
+        renderer->uploaded = 0;
+
+        if (visible == NULL)
+                std::fill(renderer->used.begin(), renderer->used.end(), frame);
+        else
+                for (int v = 0 ; v < visible->count ; v++)
+                        renderer->used[visible->indices[v]] = frame;
+
+        for (int i = 0 ; i < chunk_count ; i++)
+        {
+                const Chunk* chunk = world->chunks[i];
+                unsigned int version = chunk ? chunk->version : 0;
+                if (version == renderer->meshed_version[i])
+                        continue;
+                renderer->meshed_version[i] = version;
+                remesh[i] = true;
+                changed = true;
+                if (chunk == NULL)
+                        continue;
+
+                static const glm::ivec3 offsets[6] = {
+                        {1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1}
+                };
+                for (int n = 0 ; n < 6 ; n++)
+                {
+                        int neighbour = world_chunk_find(world, chunk->coord + offsets[n]);
+                        if (neighbour >= 0)
+                                remesh[neighbour] = true;
+                }
+        }
+
+        double start = glfwGetTime();
+        if (changed)
+        {
+                // chunks go in index order, x fastest, so most of the neighbourhood carries over
+                ChunkNeighbourhood neighbourhood = {};
+                renderer->quads = 0;
+                for (int i = 0 ; i < chunk_count ; i++)
+                {
+                        if (remesh[i])
+                        {
+                                release_pages(renderer, i);
+                                renderer->chunk_vertices[i].clear();
+                                mesh_chunk(world, i, &renderer->chunk_vertices[i], &neighbourhood);
+                        }
+                        renderer->quads += renderer->chunk_vertices[i].size() / 6;
+                }
+        }
+
+        // remeshed chunks, and the ones that lost their pages and are wanted again
+        bool uploaded = false;
+        glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+        for (int i = 0 ; i < chunk_count ; i++)
+        {
+                size_t vertices = renderer->chunk_vertices[i].size();
+                if (renderer->page_first[i] >= 0 || vertices == 0 || renderer->used[i] != frame)
+                        continue;
+                int first = acquire_pages(renderer, i, pages_for(vertices));
+                if (first < 0)
+                        continue;
+                renderer->page_first[i] = first;
+                renderer->first[i] = first*MESH_PAGE_VERTICES;
+                renderer->count[i] = (int)vertices;
+                glBufferSubData(GL_ARRAY_BUFFER, (size_t)renderer->first[i]*sizeof(uint32_t),
+                                vertices*sizeof(uint32_t), renderer->chunk_vertices[i].data());
+                renderer->uploaded++;
+                uploaded = true;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (changed)
+                renderer->build_milliseconds = (glfwGetTime() - start) * 1000.0;
+        if (!changed && !uploaded && renderer->evicted == 0)
+                return;
+
+        std::vector<unsigned int> ranges(chunk_count*2);
+        for (int i = 0 ; i < chunk_count ; i++)
+        {
+                ranges[i*2] = renderer->first[i];
+                ranges[i*2+1] = renderer->count[i];
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderer->range_buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, ranges.size()*sizeof(unsigned int), ranges.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+static void begin_draw(MeshRenderer* renderer, const Camera* camera, unsigned int voxel_texture)
+{
+        glUseProgram(renderer->shader);
+        set_shader_value_matrix4("view", camera->view, renderer->shader);
+        set_shader_value_matrix4("projection", camera->projection, renderer->shader);
+        set_shader_value_float("voxel_size", VOXEL_SIZE, renderer->shader);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, voxel_texture);
+        set_shader_value_int("VOXELS", 0, renderer->shader);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, renderer->origin_buffer);
+
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glBindVertexArray(renderer->vao);
+}
+
+
+static void end_draw()
+{
+        glBindVertexArray(0);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_DEPTH_TEST);
+}
+
+
+void mesh_renderer_draw(MeshRenderer* renderer, const World* world, const VisibleChunks* visible, const Camera* camera, unsigned int voxel_texture)
+{
+        begin_draw(renderer, camera, voxel_texture);
+        for (int v = 0 ; v < visible->count ; v++)
+        {
+                int i = visible->indices[v];
+                if (world->chunks[i] == NULL || renderer->count[i] == 0)
+                        continue;
+                // base instance picks the chunk origin, same as the gpu generated draws
+                glDrawArraysInstancedBaseInstance(GL_TRIANGLES, renderer->first[i], renderer->count[i], 1, i);
+        }
+        end_draw();
+}
+
+
+void mesh_renderer_draw_indirect(MeshRenderer* renderer, const Camera* camera, unsigned int voxel_texture,
+                                 unsigned int command_buffer, unsigned int count_buffer, int max_draws)
+{
+        begin_draw(renderer, camera, voxel_texture);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+        glBindBuffer(GL_PARAMETER_BUFFER, count_buffer);
+        glMultiDrawArraysIndirectCount(GL_TRIANGLES, (void*)0, 0, max_draws, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        end_draw();
+}
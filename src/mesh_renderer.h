@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "camera.h"
+#include "chunk.h"
+#include "frustum.h"
+#include "slot_pool.h"
+
+// vertices of one page of the vertex buffer, chunk meshes take whole runs of pages
+#define MESH_PAGE_VERTICES 8192
+// size of the vertex buffer, allocated once
+#define MESH_VRAM_BUDGET (64u << 20)
+
+// renders the world from greedy meshes, kept around to measure the lattice renderer against.
+// the vertex buffer is a fixed pool of pages: a remeshed chunk swaps its pages for new ones and only its
+// own vertices are uploaded. once the pool is full the meshes not drawn for the longest lose their pages,
+// and are uploaded again from the cpu copy when they are visible again
+typedef struct MeshRenderer
+{
+        unsigned int shader, vao, vbo;
+        size_t vbo_capacity;
+        SlotPool pages;
+        // first page of every chunk mesh, -1 while it isn't on the gpu
+        std::vector<int> page_first;
+        // frame each chunk was last drawn
+        std::vector<uint64_t> used;
+        uint64_t frame;
+
+        // per chunk ivec4 origin (read through gl_BaseInstance) and uvec2 first/count,
+        // so draws can also be generated on the gpu
+        unsigned int origin_buffer, range_buffer;
+
+        // cpu side copy of every chunk mesh, the gpu buffer is rebuilt from these
+        std::vector<std::vector<uint32_t>> chunk_vertices;
+        std::vector<unsigned int> meshed_version;
+        // in vertices, count is 0 while the mesh isn't on the gpu
+        std::vector<int> first, count;
+
+        // stats of the last rebuild
+        double build_milliseconds;
+        int quads;
+        size_t vram_bytes;
+        // meshes that lost their pages, and were uploaded again, over the last update
+        int evicted, uploaded;
+}MeshRenderer;
+
+// vram_budget is the size of the vertex buffer
+int mesh_renderer_init(MeshRenderer* renderer, const World* world, size_t vram_budget);
+void mesh_renderer_destroy(MeshRenderer* renderer);
+
+// remeshes every chunk whose version changed (and its neighbours, their border faces depend on it) and
+// makes sure the visible ones (every one when visible is NULL) are on the gpu
+void mesh_renderer_update(MeshRenderer* renderer, const World* world, const VisibleChunks* visible);
+// only the chunks in visible are drawn
+void mesh_renderer_draw(MeshRenderer* renderer, const World* world, const VisibleChunks* visible, const Camera* camera, unsigned int voxel_texture);
+// draws from commands written on the gpu, draw_count is read from count_buffer
+void mesh_renderer_draw_indirect(MeshRenderer* renderer, const Camera* camera, unsigned int voxel_texture,
+                                 unsigned int command_buffer, unsigned int count_buffer, int max_draws);
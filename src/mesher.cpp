@@ -0,0 +1,146 @@
+#include "mesher.h"
+
+#include <string.h>
+
+
+static const uint64_t* neighbour_columns(const World* world, ChunkNeighbourhood* neighbourhood, const Chunk* chunk, glm::ivec3 offset)
+{
+        glm::ivec3 c = chunk->coord + offset;
+        int index = neighbourhood ? chunk_neighbourhood_find(neighbourhood, &world->map, c) : world_chunk_find(world, c);
+        if (index < 0 || world->chunks[index] == NULL)
+                return NULL;
+        return world->chunks[index]->occupancy;
+}
+
+
+// corners are emitted counter clockwise when seen from the side the face points to,
+// u x v has to equal the face normal for positive faces
+static void emit_quad(std::vector<uint32_t>* vertices, int face, glm::ivec3 origin, glm::ivec3 u, glm::ivec3 v)
+{
+        if (face & 1)
+        {
+                glm::ivec3 t = u;
+                u = v;
+                v = t;
+        }
+        glm::ivec3 corners[4] = { origin, origin+u, origin+u+v, origin+v };
+        static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int i = 0 ; i < 6 ; i++)
+        {
+                glm::ivec3 p = corners[order[i]];
+                vertices->push_back(mesh_vertex(p.x, p.y, p.z, face));
+        }
+}
+
+
+// merges one face slice, rows are consumed as they are merged
+static int greedy_plane(std::vector<uint32_t>* vertices, uint64_t plane[CHUNK_SIZE], int face, int slice)
+{
+        int quads = 0;
+        for (int row = 0 ; row < CHUNK_SIZE ; row++)
+        {
+                while (plane[row])
+                {
+                        int start = __builtin_ctzll(plane[row]);
+                        uint64_t rest = plane[row] >> start;
+                        int width = rest == ~0ull ? CHUNK_SIZE-start : __builtin_ctzll(~rest);
+                        uint64_t mask = width == CHUNK_SIZE ? ~0ull : ((1ull << width)-1) << start;
+
+                        int height = 1;
+                        while (row+height < CHUNK_SIZE && (plane[row+height] & mask) == mask)
+                        {
+                                plane[row+height] &= ~mask;
+                                height++;
+                        }
+                        plane[row] &= ~mask;
+
+                        // plane position is the far side of the voxel for positive faces
+                        int depth = slice + ((face & 1) ? 0 : 1);
+                        switch (face >> 1)
+                        {
+                        case 0: // rows z, bits y
+                                emit_quad(vertices, face, glm::ivec3(depth, start, row),
+                                          glm::ivec3(0, width, 0), glm::ivec3(0, 0, height));
+                                break;
+                        case 1: // rows z, bits x
+                                emit_quad(vertices, face, glm::ivec3(start, depth, row),
+                                          glm::ivec3(0, 0, height), glm::ivec3(width, 0, 0));
+                                break;
+                        case 2: // rows x, bits y
+                                emit_quad(vertices, face, glm::ivec3(row, start, depth),
+                                          glm::ivec3(height, 0, 0), glm::ivec3(0, width, 0));
+                                break;
+                        }
+                        quads++;
+                }
+        }
+        return quads;
+}
+
+
+int mesh_chunk(const World* world, int chunk_index, std::vector<uint32_t>* vertices, ChunkNeighbourhood* neighbourhood)
+{
+        const Chunk* chunk = world->chunks[chunk_index];
+        if (chunk == NULL)
+                return 0;
+        const uint64_t* columns = chunk->occupancy;
+
+        // centred on the chunk itself, its six neighbours are then all in it
+        if (neighbourhood)
+                chunk_neighbourhood_move(neighbourhood, &world->map, chunk->coord);
+        const uint64_t* pos_x = neighbour_columns(world, neighbourhood, chunk, glm::ivec3(1,0,0));
+        const uint64_t* neg_x = neighbour_columns(world, neighbourhood, chunk, glm::ivec3(-1,0,0));
+        const uint64_t* pos_y = neighbour_columns(world, neighbourhood, chunk, glm::ivec3(0,1,0));
+        const uint64_t* neg_y = neighbour_columns(world, neighbourhood, chunk, glm::ivec3(0,-1,0));
+        const uint64_t* pos_z = neighbour_columns(world, neighbourhood, chunk, glm::ivec3(0,0,1));
+        const uint64_t* neg_z = neighbour_columns(world, neighbourhood, chunk, glm::ivec3(0,0,-1));
+
+        // planes[face][slice][row]
+        static thread_local uint64_t planes[6][CHUNK_SIZE][CHUNK_SIZE];
+        memset(planes, 0, sizeof(planes));
+
+        for (int z = 0 ; z < CHUNK_SIZE ; z++)
+        {
+                for (int x = 0 ; x < CHUNK_SIZE ; x++)
+                {
+                        int i = chunk_column_index(x,z);
+                        uint64_t column = columns[i];
+                        if (column == 0)
+                                continue;
+
+                        uint64_t right = x+1 < CHUNK_SIZE ? columns[i+1] : pos_x ? pos_x[chunk_column_index(0,z)] : 0;
+                        uint64_t left = x > 0 ? columns[i-1] : neg_x ? neg_x[chunk_column_index(CHUNK_SIZE-1,z)] : 0;
+                        uint64_t front = z+1 < CHUNK_SIZE ? columns[i+CHUNK_SIZE] : pos_z ? pos_z[chunk_column_index(x,0)] : 0;
+                        uint64_t back = z > 0 ? columns[i-CHUNK_SIZE] : neg_z ? neg_z[chunk_column_index(x,CHUNK_SIZE-1)] : 0;
+                        uint64_t above = pos_y ? pos_y[i] & 1 : 0;
+                        uint64_t below = neg_y ? neg_y[i] >> 63 : 0;
+
+                        planes[FACE_POS_X][x][z] = column & ~right;
+                        planes[FACE_NEG_X][x][z] = column & ~left;
+                        planes[FACE_POS_Z][z][x] = column & ~front;
+                        planes[FACE_NEG_Z][z][x] = column & ~back;
+
+                        // y faces run along the column so they need transposing into x rows
+                        uint64_t up = column & ~((column >> 1) | (above << 63));
+                        uint64_t down = column & ~((column << 1) | below);
+                        while (up)
+                        {
+                                int y = __builtin_ctzll(up);
+                                planes[FACE_POS_Y][y][z] |= 1ull << x;
+                                up &= up-1;
+                        }
+                        while (down)
+                        {
+                                int y = __builtin_ctzll(down);
+                                planes[FACE_NEG_Y][y][z] |= 1ull << x;
+                                down &= down-1;
+                        }
+                }
+        }
+
+        int quads = 0;
+        for (int face = 0 ; face < 6 ; face++)
+                for (int slice = 0 ; slice < CHUNK_SIZE ; slice++)
+                        quads += greedy_plane(vertices, planes[face][slice], face, slice);
+        return quads;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "chunk.h"
+
+// faces are ordered axis*2 + (0 positive, 1 negative)
+enum Face
+{
+        FACE_POS_X, FACE_NEG_X,
+        FACE_POS_Y, FACE_NEG_Y,
+        FACE_POS_Z, FACE_NEG_Z
+};
+
+// a mesh vertex is packed into 32 bits: x 7, y 7, z 7 (0..CHUNK_SIZE inclusive) then face 3
+inline uint32_t mesh_vertex(int x, int y, int z, int face)
+{
+        return x | (y << 7) | (z << 14) | (face << 21);
+}
+
+// binary greedy mesher. faces are culled a column at a time with shifts and masks
+// against the neighbouring columns (and neighbouring chunks at the borders), then
+// every face slice is merged into rectangles by scanning its rows with ctz.
+// appends 6 vertices per quad and returns the number of quads. neighbour chunks are found through
+// neighbourhood when it isn't NULL, keep it across calls meshing nearby chunks in a row
+int mesh_chunk(const World* world, int chunk_index, std::vector<uint32_t>* vertices, ChunkNeighbourhood* neighbourhood);
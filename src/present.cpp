@@ -0,0 +1,109 @@
+#include "present.h"
+
+#include <math.h>
+#include <chrono>
+#include <thread>
+
+const char* present_mode_names[PRESENT_MODE_COUNT] = { "vsync", "uncapped", "limited" };
+
+
+void present_init(Present* present, GLFWwindow* window)
+{
+        present->window = window;
+        present->mode = PRESENT_VSYNC;
+        present->applied_mode = -1;
+        present->frames_in_flight = 2;
+        for (int i = 0 ; i < PRESENT_MAX_FRAMES_IN_FLIGHT ; i++)
+                present->fences[i] = 0;
+        present->frame = 0;
+        present->next_frame_time = glfwGetTime();
+
+        glGenQueries(PRESENT_QUERY_LATENCY, present->present_queries);
+        present->latency_milliseconds = 0.0;
+        present->fence_wait_milliseconds = 0.0;
+}
+
+
+void present_destroy(Present* present)
+{
+        for (int i = 0 ; i < PRESENT_MAX_FRAMES_IN_FLIGHT ; i++)
+                if (present->fences[i])
+                        glDeleteSync(present->fences[i]);
+        glDeleteQueries(PRESENT_QUERY_LATENCY, present->present_queries);
+}
+
+
+// sleeps most of the way and spins the last millisecond, sleep granularity is too coarse on its own
+static void wait_until(double time)
+{
+        double remaining = time - glfwGetTime();
+        if (remaining > 0.002)
+                std::this_thread::sleep_for(std::chrono::duration<double>(remaining - 0.001));
+        while (glfwGetTime() < time)
+                ;
+}
+
+
+static void read_latency(Present* present, int slot)
+{
+        unsigned int query = present->present_queries[slot];
+        int available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+                return;
+
+        GLuint64 presented = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &presented);
+        present->latency_milliseconds = (double)((GLint64)presented - present->input_timestamp[slot]) / 1000000.0;
+}
+
+
+void present_begin_frame(Present* present)
+{
+        if (present->applied_mode != present->mode)
+        {
+                glfwSwapInterval(present->mode == PRESENT_VSYNC ? 1 : 0);
+                present->applied_mode = present->mode;
+                present->next_frame_time = glfwGetTime();
+        }
+
+        if (present->mode == PRESENT_LIMITED)
+        {
+                wait_until(present->next_frame_time);
+                // a missed deadline starts a new schedule instead of rushing the next frames
+                present->next_frame_time = fmax(present->next_frame_time + 1.0 / PRESENT_LIMIT_FPS, glfwGetTime());
+        }
+
+        // frame - frames_in_flight has to be off the gpu before the cpu gets further ahead.
+        // the ring holds the maximum so the limit can change at any time
+        double wait_start = glfwGetTime();
+        if (present->frame >= present->frames_in_flight)
+        {
+                GLsync fence = present->fences[(present->frame - present->frames_in_flight) % PRESENT_MAX_FRAMES_IN_FLIGHT];
+                if (fence)
+                        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+        present->fence_wait_milliseconds = (glfwGetTime() - wait_start) * 1000.0;
+
+        glfwPollEvents();
+
+        int slot = present->frame % PRESENT_QUERY_LATENCY;
+        if (present->frame >= PRESENT_QUERY_LATENCY)
+                read_latency(present, slot);
+        glGetInteger64v(GL_TIMESTAMP, &present->input_timestamp[slot]);
+}
+
+
+void present_end_frame(Present* present)
+{
+        glfwSwapBuffers(present->window);
+
+        // lands once the gpu is through the frame and the swap, counted from when its input was polled
+        glQueryCounter(present->present_queries[present->frame % PRESENT_QUERY_LATENCY], GL_TIMESTAMP);
+
+        GLsync* fence = &present->fences[present->frame % PRESENT_MAX_FRAMES_IN_FLIGHT];
+        if (*fence)
+                glDeleteSync(*fence);
+        *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        present->frame++;
+}
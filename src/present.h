@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+// frames the cpu may run ahead of the gpu, and how many latency results are kept in flight
+#define PRESENT_MAX_FRAMES_IN_FLIGHT 3
+#define PRESENT_QUERY_LATENCY 4
+// target of the frame limited mode
+#define PRESENT_LIMIT_FPS 60.0
+
+enum PresentMode
+{
+        PRESENT_VSYNC,
+        PRESENT_UNCAPPED,
+        PRESENT_LIMITED,
+        PRESENT_MODE_COUNT
+};
+
+extern const char* present_mode_names[PRESENT_MODE_COUNT];
+
+// owns swapping: swap interval, frame limiting, a fence per frame in flight
+// and the input to present latency of every frame
+typedef struct Present
+{
+        GLFWwindow* window;
+        int mode;
+        // applied mode, the swap interval only changes when mode does
+        int applied_mode;
+        int frames_in_flight;
+
+        GLsync fences[PRESENT_MAX_FRAMES_IN_FLIGHT];
+        long frame;
+        double next_frame_time;
+
+        // gpu clock when input was last polled, and a timestamp query written after each swap
+        GLint64 input_timestamp[PRESENT_QUERY_LATENCY];
+        unsigned int present_queries[PRESENT_QUERY_LATENCY];
+
+        // last resolved result
+        double latency_milliseconds;
+        // time the cpu spent blocked on the frames in flight limit last frame
+        double fence_wait_milliseconds;
+}Present;
+
+void present_init(Present* present, GLFWwindow* window);
+void present_destroy(Present* present);
+
+// blocks until a new frame may start (limiter and frames in flight), then polls input.
+// everything sampled after this is as fresh as it gets for the frame
+void present_begin_frame(Present* present);
+// swaps and fences the frame
+void present_end_frame(Present* present);
@@ -0,0 +1,256 @@
+#include "ray_batch.h"
+
+#include <stddef.h>
+#include <chrono>
+
+#include <immintrin.h>
+
+#include "lod.h"
+#include "raycast.h"
+
+
+void ray_batch_clear(RayBatch* batch)
+{
+        batch->rays.clear();
+        batch->hits.clear();
+}
+
+
+void ray_batch_add_segment(RayBatch* batch, glm::vec3 from, glm::vec3 to)
+{
+        glm::vec3 direction = to - from;
+        batch->rays.push_back({ from, direction, glm::length(direction) });
+}
+
+
+static void set_hit(RayBatch* batch, int ray)
+{
+        // rays of one word can finish on different threads
+        __atomic_fetch_or(&batch->hits[ray / 64], 1ull << (ray % 64), __ATOMIC_RELAXED);
+}
+
+
+// counting sort on the chunk holding the origin, origins outside the world go to the nearest chunk
+static void sort_by_origin_chunk(RayBatch* batch, const World* world)
+{
+        int chunks = world_chunk_count(world);
+        glm::ivec3 last = glm::ivec3(world->width, world->height, world->depth) - 1;
+
+        std::vector<int> keys(batch->rays.size());
+        batch->chunk_start.assign(chunks + 1, 0);
+        for (size_t i = 0 ; i < batch->rays.size() ; i++)
+        {
+                glm::ivec3 coord = glm::clamp(glm::ivec3(glm::floor(batch->rays[i].origin * (1.0f/CHUNK_SIZE))), glm::ivec3(0), last);
+                keys[i] = world_chunk_index(world, coord.x, coord.y, coord.z);
+                batch->chunk_start[keys[i] + 1]++;
+        }
+        for (int c = 0 ; c < chunks ; c++)
+                batch->chunk_start[c + 1] += batch->chunk_start[c];
+
+        std::vector<int> cursor(batch->chunk_start.begin(), batch->chunk_start.end() - 1);
+        batch->order.resize(batch->rays.size());
+        for (size_t i = 0 ; i < batch->rays.size() ; i++)
+                batch->order[cursor[keys[i]]++] = i;
+}
+
+
+static void trace_scalar(RayBatch* batch, const World* world, int first, int count)
+{
+        RayHit hit;
+        for (int i = first ; i < first + count ; i++)
+        {
+                int ray = batch->order[i];
+                const RayQuery* query = &batch->rays[ray];
+                if (raycast(world, query->origin, query->direction, query->max_distance, &hit))
+                        set_hit(batch, ray);
+        }
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i lane_mask(int bits)
+{
+        __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), select), select);
+}
+
+
+static_assert(offsetof(Chunk, mips_version) == offsetof(Chunk, version) + sizeof(unsigned int), "the packet loads both versions at once");
+
+
+// finishes one lane with the scalar walk, from the cell where the packet left it
+static void finish_lane(RayBatch* batch, const World* world, RayWalk* walk, int ray, glm::ivec3 cell, float t)
+{
+        RayHit hit;
+        raycast_seek(walk, cell * RAY_PACKET_CELL, RAY_PACKET_CELL, t, -1);
+        if (raycast_walk(world, walk, &hit))
+                set_hit(batch, ray);
+}
+
+
+// every lane walks the mip level RAY_PACKET_LEVEL grid in lockstep, testing its cell with a gather from
+// the occupancy mips of whatever chunk it is in. empty space is crossed RAY_PACKET_CELL voxels a step;
+// a lane that reaches an occupied cell (or a chunk with stale mips) leaves the packet and is finished
+// by the scalar walk from there
+__attribute__((target("avx2")))
+static void trace_packet_avx2(RayBatch* batch, const World* world, int first, int count)
+{
+        alignas(32) int cell[3][RAY_PACKET_SIZE], step[3][RAY_PACKET_SIZE];
+        alignas(32) float t_max[3][RAY_PACKET_SIZE], t_delta[3][RAY_PACKET_SIZE];
+        alignas(32) float t[RAY_PACKET_SIZE], limit[RAY_PACKET_SIZE];
+        RayWalk walks[RAY_PACKET_SIZE];
+        int active = 0;
+        for (int lane = 0 ; lane < RAY_PACKET_SIZE ; lane++)
+        {
+                RayWalk& walk = walks[lane];
+                const RayQuery* query = lane < count ? &batch->rays[batch->order[first + lane]] : NULL;
+                bool valid = query && glm::length(query->direction) > 0.0f &&
+                             raycast_begin(&walk, world, query->origin, query->direction, query->max_distance);
+                for (int a = 0 ; a < 3 ; a++)
+                {
+                        cell[a][lane] = valid ? walk.voxel[a] >> RAY_PACKET_LEVEL : 0;
+                        step[a][lane] = valid ? walk.step[a] : 0;
+                        t_max[a][lane] = INFINITY;
+                        t_delta[a][lane] = INFINITY;
+                        if (valid && walk.step[a] != 0)
+                        {
+                                float boundary = (cell[a][lane] + (walk.step[a] > 0 ? 1 : 0)) * RAY_PACKET_CELL;
+                                t_max[a][lane] = (boundary - walk.origin[a]) * walk.inverse[a];
+                                t_delta[a][lane] = walk.t_delta[a] * RAY_PACKET_CELL;
+                        }
+                }
+                t[lane] = valid ? walk.t : 0.0f;
+                limit[lane] = valid ? walk.t_limit : -1.0f;
+                active |= valid << lane;
+        }
+
+        __m256i vx = _mm256_load_si256((const __m256i*)cell[0]);
+        __m256i vy = _mm256_load_si256((const __m256i*)cell[1]);
+        __m256i vz = _mm256_load_si256((const __m256i*)cell[2]);
+        __m256i sx = _mm256_load_si256((const __m256i*)step[0]);
+        __m256i sy = _mm256_load_si256((const __m256i*)step[1]);
+        __m256i sz = _mm256_load_si256((const __m256i*)step[2]);
+        __m256 tx = _mm256_load_ps(t_max[0]), ty = _mm256_load_ps(t_max[1]), tz = _mm256_load_ps(t_max[2]);
+        __m256 dx = _mm256_load_ps(t_delta[0]), dy = _mm256_load_ps(t_delta[1]), dz = _mm256_load_ps(t_delta[2]);
+        __m256 vt = _mm256_load_ps(t), vlimit = _mm256_load_ps(limit);
+
+        // everything below is in cells, 1 << shift per chunk side
+        const int shift = 6 - RAY_PACKET_LEVEL;
+        glm::ivec3 size = glm::ivec3(world->width, world->height, world->depth) << shift;
+        __m256i size_x = _mm256_set1_epi32(size.x), size_y = _mm256_set1_epi32(size.y), size_z = _mm256_set1_epi32(size.z);
+        __m256i minus_one = _mm256_set1_epi32(-1);
+        __m256i row = _mm256_set1_epi32(world->width), slice = _mm256_set1_epi32(world->width*world->height);
+        __m256i low_bits = _mm256_set1_epi32((1 << shift) - 1);
+        __m256i level_base = _mm256_set1_epi32(offsetof(Chunk, occupancy_mips) + chunk_mip_column_offset(RAY_PACKET_LEVEL)*sizeof(uint64_t));
+        __m256i one = _mm256_set1_epi64x(1);
+        const long long* chunks = (const long long*)world->chunks;
+        const long long* memory = NULL;
+
+        while (active)
+        {
+                __m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(vx, minus_one), _mm256_cmpgt_epi32(size_x, vx)),
+                                                  _mm256_and_si256(_mm256_cmpgt_epi32(vy, minus_one), _mm256_cmpgt_epi32(size_y, vy)));
+                inside = _mm256_and_si256(inside, _mm256_and_si256(_mm256_cmpgt_epi32(vz, minus_one), _mm256_cmpgt_epi32(size_z, vz)));
+                active &= _mm256_movemask_ps(_mm256_castsi256_ps(inside)) & _mm256_movemask_ps(_mm256_cmp_ps(vt, vlimit, _CMP_LE_OQ));
+                if (!active)
+                        break;
+
+                // chunk pointer, then the mip column word and the mips stamp inside it
+                __m256i chunk = _mm256_add_epi32(_mm256_srli_epi32(vx, shift),
+                                _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(vy, shift), row), _mm256_mullo_epi32(_mm256_srli_epi32(vz, shift), slice)));
+                __m256i column = _mm256_slli_epi32(_mm256_add_epi32(_mm256_and_si256(vx, low_bits),
+                                                                    _mm256_slli_epi32(_mm256_and_si256(vz, low_bits), shift)), 3);
+                column = _mm256_add_epi32(column, level_base);
+                __m256i local_y = _mm256_and_si256(vy, low_bits);
+                __m256i mask = lane_mask(active);
+
+                int occupied = 0;
+                for (int half = 0 ; half < 2 ; half++)
+                {
+                        __m128i chunk_half = half ? _mm256_extracti128_si256(chunk, 1) : _mm256_castsi256_si128(chunk);
+                        __m128i mask_half = half ? _mm256_extracti128_si256(mask, 1) : _mm256_castsi256_si128(mask);
+                        __m128i column_half = half ? _mm256_extracti128_si256(column, 1) : _mm256_castsi256_si128(column);
+                        __m128i y_half = half ? _mm256_extracti128_si256(local_y, 1) : _mm256_castsi256_si128(local_y);
+
+                        __m256i mask64 = _mm256_cvtepi32_epi64(mask_half);
+                        __m256i pointer = _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), chunks, chunk_half, mask64, 8);
+                        // missing chunks are air
+                        mask64 = _mm256_andnot_si256(_mm256_cmpeq_epi64(pointer, _mm256_setzero_si256()), mask64);
+
+                        // version and mips_version in one 64 bit load, stale mips count as occupied
+                        __m256i versions = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), memory,
+                                        _mm256_add_epi64(pointer, _mm256_set1_epi64x(offsetof(Chunk, version))), mask64, 1);
+                        __m256i stale = _mm256_xor_si256(_mm256_srli_epi64(versions, 32), _mm256_and_si256(versions, _mm256_set1_epi64x(0xFFFFFFFF)));
+                        stale = _mm256_andnot_si256(_mm256_cmpeq_epi64(stale, _mm256_setzero_si256()), mask64);
+
+                        __m256i address = _mm256_add_epi64(pointer, _mm256_cvtepi32_epi64(column_half));
+                        __m256i word = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), memory, address, mask64, 1);
+                        __m256i bit = _mm256_and_si256(_mm256_srlv_epi64(word, _mm256_cvtepi32_epi64(y_half)), one);
+                        __m256i lanes = _mm256_or_si256(_mm256_cmpeq_epi64(bit, one), stale);
+                        occupied |= _mm256_movemask_pd(_mm256_castsi256_pd(lanes)) << (half*4);
+                }
+                occupied &= active;
+                if (occupied)
+                {
+                        _mm256_store_ps(t, vt);
+                        _mm256_store_si256((__m256i*)cell[0], vx);
+                        _mm256_store_si256((__m256i*)cell[1], vy);
+                        _mm256_store_si256((__m256i*)cell[2], vz);
+                        active &= ~occupied;
+                        while (occupied)
+                        {
+                                int lane = __builtin_ctz(occupied);
+                                glm::ivec3 lane_cell(cell[0][lane], cell[1][lane], cell[2][lane]);
+                                finish_lane(batch, world, &walks[lane], batch->order[first + lane], lane_cell, t[lane]);
+                                occupied &= occupied-1;
+                        }
+                }
+
+                // same tie breaking as raycast_reference
+                __m256 x_lt_y = _mm256_cmp_ps(tx, ty, _CMP_LT_OQ);
+                __m256 mx = _mm256_and_ps(x_lt_y, _mm256_cmp_ps(tx, tz, _CMP_LT_OQ));
+                __m256 my = _mm256_andnot_ps(x_lt_y, _mm256_cmp_ps(ty, tz, _CMP_LT_OQ));
+                __m256 mz = _mm256_andnot_ps(_mm256_or_ps(mx, my), _mm256_castsi256_ps(minus_one));
+
+                vt = _mm256_blendv_ps(_mm256_blendv_ps(tz, ty, my), tx, mx);
+                vx = _mm256_add_epi32(vx, _mm256_and_si256(sx, _mm256_castps_si256(mx)));
+                vy = _mm256_add_epi32(vy, _mm256_and_si256(sy, _mm256_castps_si256(my)));
+                vz = _mm256_add_epi32(vz, _mm256_and_si256(sz, _mm256_castps_si256(mz)));
+                tx = _mm256_add_ps(tx, _mm256_and_ps(dx, mx));
+                ty = _mm256_add_ps(ty, _mm256_and_ps(dy, my));
+                tz = _mm256_add_ps(tz, _mm256_and_ps(dz, mz));
+        }
+}
+
+
+void ray_batch_trace(RayBatch* batch, const World* world, JobPool* pool)
+{
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+
+        auto start = std::chrono::steady_clock::now();
+        sort_by_origin_chunk(batch, world);
+        batch->hits.assign((batch->rays.size() + 63) / 64, 0);
+        auto sorted = std::chrono::steady_clock::now();
+
+        int rays = batch->rays.size();
+        int packets = (rays + RAY_PACKET_SIZE-1) / RAY_PACKET_SIZE;
+        auto trace = [batch, world, rays](int begin, int end) {
+                for (int p = begin ; p < end ; p++)
+                {
+                        int first = p*RAY_PACKET_SIZE;
+                        int count = glm::min(RAY_PACKET_SIZE, rays - first);
+                        if (has_avx2)
+                                trace_packet_avx2(batch, world, first, count);
+                        else
+                                trace_scalar(batch, world, first, count);
+                }
+        };
+        if (pool)
+                job_pool_parallel_for(pool, packets, RAY_BATCH_GRAIN, trace);
+        else
+                trace(0, packets);
+
+        auto end = std::chrono::steady_clock::now();
+        batch->sort_microseconds = std::chrono::duration<double, std::micro>(sorted - start).count();
+        batch->trace_microseconds = std::chrono::duration<double, std::micro>(end - sorted).count();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "jobs.h"
+
+// rays go through the avx2 path eight at a time, crossing empty space one mip cell per step
+#define RAY_PACKET_SIZE 8
+#define RAY_PACKET_LEVEL 2
+#define RAY_PACKET_CELL (1 << RAY_PACKET_LEVEL)
+// packets handed to a worker at once
+#define RAY_BATCH_GRAIN 16
+
+// in voxel units, like raycast()
+typedef struct RayQuery
+{
+        glm::vec3 origin, direction;
+        float max_distance;
+}RayQuery;
+
+// many independent hit/miss queries (sightlines, occlusion) resolved together
+typedef struct RayBatch
+{
+        std::vector<RayQuery> rays;
+        // bit i % 64 of hits[i / 64] is set when ray i hits a solid voxel within its max_distance
+        std::vector<uint64_t> hits;
+
+        // ray indices sorted by the chunk their origin is in, so a packet walks the same columns
+        std::vector<int> order;
+        std::vector<int> chunk_start;
+
+        double sort_microseconds, trace_microseconds;
+}RayBatch;
+
+void ray_batch_clear(RayBatch* batch);
+// line of sight from `from` to `to`: a hit means something solid is in between
+void ray_batch_add_segment(RayBatch* batch, glm::vec3 from, glm::vec3 to);
+
+inline bool ray_batch_hit(const RayBatch* batch, int ray)
+{
+        return (batch->hits[ray / 64] >> (ray % 64)) & 1;
+}
+
+// resolves every ray in the batch, spread over the pool (NULL runs on the calling thread).
+// uses avx2 packets when the cpu has them, raycast() per ray otherwise
+void ray_batch_trace(RayBatch* batch, const World* world, JobPool* pool);
@@ -0,0 +1,280 @@
+#include "raycast.h"
+
+#include <math.h>
+
+#include "lod.h"
+
+
+bool raycast_begin(RayWalk* walk, const World* world, glm::vec3 origin, glm::vec3 direction, float max_distance)
+{
+        walk->size = glm::ivec3(world->width, world->height, world->depth) * CHUNK_SIZE;
+        walk->origin = origin;
+        walk->direction = glm::normalize(direction);
+
+        glm::vec3 inverse = walk->inverse = 1.0f / walk->direction;
+        glm::vec3 t0 = -origin * inverse;
+        glm::vec3 t1 = (glm::vec3(walk->size) - origin) * inverse;
+        glm::vec3 t_near = glm::min(t0, t1), t_far = glm::max(t0, t1);
+        // a zero component is inf/nan on both sides, only the origin decides that axis
+        for (int i = 0 ; i < 3 ; i++)
+        {
+                if (walk->direction[i] == 0.0f)
+                {
+                        if (origin[i] < 0.0f || origin[i] >= walk->size[i])
+                                return false;
+                        t_near[i] = -INFINITY;
+                        t_far[i] = INFINITY;
+                }
+        }
+
+        float enter = glm::max(glm::max(t_near.x, t_near.y), t_near.z);
+        float leave = glm::min(glm::min(t_far.x, t_far.y), t_far.z);
+        walk->t_limit = glm::min(leave, max_distance);
+        if (enter > walk->t_limit || leave < 0.0f)
+                return false;
+
+        walk->t = glm::max(enter, 0.0f);
+        walk->axis = -1;
+        if (enter > 0.0f)
+                walk->axis = t_near.x == enter ? 0 : t_near.y == enter ? 1 : 2;
+
+        glm::vec3 start = origin + walk->direction * walk->t;
+        for (int i = 0 ; i < 3 ; i++)
+        {
+                walk->step[i] = walk->direction[i] > 0.0f ? 1 : walk->direction[i] < 0.0f ? -1 : 0;
+                walk->voxel[i] = glm::clamp((int)floorf(start[i]), 0, walk->size[i]-1);
+                if (i == walk->axis)
+                        walk->voxel[i] = walk->step[i] > 0 ? 0 : walk->size[i]-1;
+
+                if (walk->step[i] == 0)
+                {
+                        walk->t_max[i] = INFINITY;
+                        walk->t_delta[i] = INFINITY;
+                }
+                else
+                {
+                        float boundary = walk->voxel[i] + (walk->step[i] > 0 ? 1 : 0);
+                        walk->t_max[i] = (boundary - origin[i]) * inverse[i];
+                        walk->t_delta[i] = fabsf(inverse[i]);
+                }
+        }
+        return true;
+}
+
+
+static bool ray_inside(const RayWalk* walk)
+{
+        return walk->voxel.x >= 0 && walk->voxel.y >= 0 && walk->voxel.z >= 0 &&
+               walk->voxel.x < walk->size.x && walk->voxel.y < walk->size.y && walk->voxel.z < walk->size.z;
+}
+
+
+static const Chunk* ray_chunk(const World* world, glm::ivec3 voxel)
+{
+        glm::ivec3 coord = voxel / CHUNK_SIZE;
+        return world->chunks[world_chunk_index(world, coord.x, coord.y, coord.z)];
+}
+
+
+static void ray_hit(const RayWalk* walk, const Chunk* chunk, glm::ivec3 voxel, int axis, float t, RayHit* hit)
+{
+        glm::ivec3 local = voxel - chunk->coord*CHUNK_SIZE;
+        hit->voxel = voxel;
+        hit->distance = t;
+        hit->material = chunk_material_get(chunk, chunk_voxel_index(local.x, local.y, local.z));
+        hit->normal = glm::ivec3(0);
+        hit->face = -1;
+        if (axis >= 0)
+        {
+                // entered moving along +axis means the face seen is the negative one
+                hit->normal[axis] = -walk->step[axis];
+                hit->face = axis*2 + (walk->step[axis] > 0 ? 1 : 0);
+        }
+}
+
+
+// largest empty mip cell around the voxel, 0 when the voxel's 2x2x2 cell holds something
+static int empty_level(const Chunk* chunk, glm::ivec3 local)
+{
+        int level = 0;
+        for (int l = 1 ; l < CHUNK_MIP_LEVELS ; l++)
+        {
+                glm::ivec3 cell = local >> l;
+                uint64_t column = chunk->occupancy_mips[chunk_mip_column_offset(l) + cell.x + cell.z*chunk_mip_size(l)];
+                if ((column >> cell.y) & 1)
+                        break;
+                level = l;
+        }
+        return level;
+}
+
+
+// moves the walk to the first voxel past the cube [min, min+size), false if that is beyond t_limit
+static bool skip_cell(RayWalk* walk, glm::ivec3 min, int size)
+{
+        float exit = INFINITY;
+        int a = 0;
+        for (int i = 0 ; i < 3 ; i++)
+        {
+                if (walk->step[i] == 0)
+                        continue;
+                float boundary = walk->step[i] > 0 ? min[i] + size : min[i];
+                float t = (boundary - walk->origin[i]) * walk->inverse[i];
+                if (t < exit)
+                {
+                        exit = t;
+                        a = i;
+                }
+        }
+        if (exit > walk->t_limit)
+                return false;
+
+        // inside the world the position is never negative, truncating is flooring
+        glm::vec3 position = walk->origin + walk->direction * exit;
+        for (int i = 0 ; i < 3 ; i++)
+        {
+                if (i == a)
+                        walk->voxel[i] = walk->step[i] > 0 ? min[i] + size : min[i] - 1;
+                else
+                        walk->voxel[i] = glm::clamp((int)position[i], min[i], min[i] + size - 1);
+
+                if (walk->step[i] != 0)
+                {
+                        float boundary = walk->voxel[i] + (walk->step[i] > 0 ? 1 : 0);
+                        walk->t_max[i] = (boundary - walk->origin[i]) * walk->inverse[i];
+                }
+        }
+        walk->t = exit;
+        walk->axis = a;
+        return true;
+}
+
+
+bool raycast_reference(const World* world, glm::vec3 origin, glm::vec3 direction, float max_distance, RayHit* hit)
+{
+        RayWalk walk;
+        if (!raycast_begin(&walk, world, origin, direction, max_distance))
+                return false;
+
+        while (walk.t <= walk.t_limit && ray_inside(&walk))
+        {
+                const Chunk* chunk = ray_chunk(world, walk.voxel);
+                glm::ivec3 local = walk.voxel - glm::ivec3(walk.voxel / CHUNK_SIZE)*CHUNK_SIZE;
+                if (chunk && chunk_solid(chunk, local.x, local.y, local.z))
+                {
+                        ray_hit(&walk, chunk, walk.voxel, walk.axis, walk.t, hit);
+                        return true;
+                }
+
+                int a = walk.t_max.x < walk.t_max.y ? (walk.t_max.x < walk.t_max.z ? 0 : 2) : (walk.t_max.y < walk.t_max.z ? 1 : 2);
+                walk.t = walk.t_max[a];
+                walk.voxel[a] += walk.step[a];
+                walk.t_max[a] += walk.t_delta[a];
+                walk.axis = a;
+        }
+        return false;
+}
+
+
+void raycast_seek(RayWalk* walk, glm::ivec3 min, int size, float t, int axis)
+{
+        glm::vec3 position = walk->origin + walk->direction * t;
+        for (int i = 0 ; i < 3 ; i++)
+        {
+                walk->voxel[i] = glm::clamp((int)position[i], min[i], min[i] + size - 1);
+                if (walk->step[i] != 0)
+                {
+                        float boundary = walk->voxel[i] + (walk->step[i] > 0 ? 1 : 0);
+                        walk->t_max[i] = (boundary - walk->origin[i]) * walk->inverse[i];
+                }
+        }
+        walk->t = t;
+        walk->axis = axis;
+}
+
+
+bool raycast(const World* world, glm::vec3 origin, glm::vec3 direction, float max_distance, RayHit* hit)
+{
+        RayWalk walk;
+        if (!raycast_begin(&walk, world, origin, direction, max_distance))
+                return false;
+        return raycast_walk(world, &walk, hit);
+}
+
+
+bool raycast_walk(const World* world, RayWalk* walk_state, RayHit* hit)
+{
+        RayWalk& walk = *walk_state;
+        while (walk.t <= walk.t_limit && ray_inside(&walk))
+        {
+                const Chunk* chunk = ray_chunk(world, walk.voxel);
+                glm::ivec3 local = walk.voxel & (CHUNK_SIZE-1);
+                if (chunk == NULL)
+                {
+                        if (!skip_cell(&walk, walk.voxel - local, CHUNK_SIZE))
+                                return false;
+                        continue;
+                }
+
+                // empty space first: the or reduced mips clear whole cubes in one step while they are current
+                if (chunk->mips_version == chunk->version)
+                {
+                        int level = empty_level(chunk, local);
+                        if (level > 0)
+                        {
+                                int size = 1 << level;
+                                if (!skip_cell(&walk, walk.voxel - (local & (size-1)), size))
+                                        return false;
+                                continue;
+                        }
+                }
+
+                uint64_t column = chunk->occupancy[chunk_column_index(local.x, local.z)];
+
+                // y steps the ray takes before it leaves this column sideways (or runs out of length)
+                float leave = glm::min(glm::min(walk.t_max.x, walk.t_max.z), walk.t_limit);
+                int steps = 0;
+                if (walk.t_max.y < leave)
+                        steps = (int)glm::min((leave - walk.t_max.y) / walk.t_delta.y + 1.0f, (float)CHUNK_SIZE);
+                int room = walk.step.y > 0 ? CHUNK_SIZE-1 - local.y : local.y;
+                int last = local.y + walk.step.y*glm::min(steps, room);
+
+                int low = glm::min(local.y, last), high = glm::max(local.y, last);
+                uint64_t mask = (~0ull >> (63 - high)) & (~0ull << low);
+                uint64_t bits = column & mask;
+                if (bits)
+                {
+                        int y = walk.step.y > 0 ? __builtin_ctzll(bits) : 63 - __builtin_clzll(bits);
+                        int k = abs(y - local.y);
+                        glm::ivec3 voxel = walk.voxel;
+                        voxel.y += y - local.y;
+                        if (k == 0)
+                                ray_hit(&walk, chunk, voxel, walk.axis, walk.t, hit);
+                        else
+                                ray_hit(&walk, chunk, voxel, 1, walk.t_max.y + (k-1)*walk.t_delta.y, hit);
+                        return true;
+                }
+
+                if (steps > room)
+                {
+                        // the empty stretch runs into the next chunk up or down
+                        int moved = room + 1;
+                        walk.t = walk.t_max.y + (moved-1)*walk.t_delta.y;
+                        walk.voxel.y += walk.step.y*moved;
+                        walk.t_max.y += moved*walk.t_delta.y;
+                        walk.axis = 1;
+                        continue;
+                }
+
+                walk.voxel.y += walk.step.y*steps;
+                walk.t_max.y += steps*walk.t_delta.y;
+                int a = walk.t_max.x < walk.t_max.z ? 0 : 2;
+                if (walk.t_max[a] > walk.t_limit)
+                        return false;
+                walk.t = walk.t_max[a];
+                walk.voxel[a] += walk.step[a];
+                walk.t_max[a] += walk.t_delta[a];
+                walk.axis = a;
+        }
+        return false;
+}
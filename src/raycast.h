@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+
+// everything is in voxel units: world space divided by VOXEL_SIZE
+typedef struct RayHit
+{
+        glm::ivec3 voxel;
+        // face the ray entered the voxel through (a Face from mesher.h), -1 when the origin is inside it
+        int face;
+        glm::ivec3 normal;
+        float distance;
+        uint8_t material;
+}RayHit;
+
+// amanatides/woo state, t is where the ray entered voxel through `axis` (-1 if it started inside it)
+typedef struct RayWalk
+{
+        glm::ivec3 size;
+        glm::vec3 origin, direction, inverse;
+        glm::ivec3 voxel, step;
+        glm::vec3 t_max, t_delta;
+        float t, t_limit;
+        int axis;
+}RayWalk;
+
+// clips the ray to the world box and sets up the walk, false if it never enters it within max_distance
+bool raycast_begin(RayWalk* walk, const World* world, glm::vec3 origin, glm::vec3 direction, float max_distance);
+
+// first solid voxel along the ray within max_distance (direction is normalized here). walks the occupancy
+// columns: the whole stretch of a column the ray crosses is tested with one mask, so empty stretches
+// cost one step instead of one per voxel. empty cubes of up to a chunk are skipped through the
+// occupancy mips of chunks whose mips are current (see lod.h)
+bool raycast(const World* world, glm::vec3 origin, glm::vec3 direction, float max_distance, RayHit* hit);
+
+// the walk raycast() does after raycast_begin, for callers that set the walk up (or moved it) themselves
+bool raycast_walk(const World* world, RayWalk* walk, RayHit* hit);
+// moves the walk to distance t, where the ray is inside the cube [min, min+size) having entered it through axis
+void raycast_seek(RayWalk* walk, glm::ivec3 min, int size, float t, int axis);
+
+// one voxel per step, same results, kept to check and measure raycast against
+bool raycast_reference(const World* world, glm::vec3 origin, glm::vec3 direction, float max_distance, RayHit* hit);
@@ -0,0 +1,442 @@
+#include "region_reader.h"
+#include "chunk_image.h"
+#include "rle.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <algorithm>
+#include <atomic>
+
+const char* region_reader_backend_names[] = { "io_uring", "pread" };
+
+
+// one read into the staging buffer or straight into its destination. a short read is resubmitted for the rest
+typedef struct IoRead
+{
+        int fd;
+        uint8_t* buffer;
+        uint32_t size, done;
+        uint64_t offset;
+        // 0 once everything arrived, -errno otherwise
+        int result;
+        // the request it is for, and whether the buffer still has to be run length decoded into its material
+        int target;
+        bool decode;
+}IoRead;
+
+
+static void ring_teardown(RegionRing* ring)
+{
+        if (ring->sqes)
+                munmap(ring->sqes, ring->entries*sizeof(io_uring_sqe));
+        if (ring->cq_map && ring->cq_map != ring->sq_map)
+                munmap(ring->cq_map, ring->cq_map_size);
+        if (ring->sq_map)
+                munmap(ring->sq_map, ring->sq_map_size);
+        if (ring->fd >= 0)
+                close(ring->fd);
+        *ring = {};
+        ring->fd = -1;
+}
+
+
+static void* ring_map(int fd, size_t size, off_t offset)
+{
+        void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return map == MAP_FAILED ? NULL : map;
+}
+
+
+// no liburing, the rings are mapped by hand
+static int ring_setup(RegionRing* ring, unsigned int entries)
+{
+        *ring = {};
+        io_uring_params params = {};
+        ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (ring->fd < 0)
+                return -1;
+
+        ring->entries = params.sq_entries;
+        ring->sq_map_size = params.sq_off.array + params.sq_entries*sizeof(unsigned int);
+        ring->cq_map_size = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+        // since 5.4 both rings live in one mapping
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+                ring->sq_map_size = ring->cq_map_size = std::max(ring->sq_map_size, ring->cq_map_size);
+
+        ring->sq_map = ring_map(ring->fd, ring->sq_map_size, IORING_OFF_SQ_RING);
+        ring->cq_map = single ? ring->sq_map : ring_map(ring->fd, ring->cq_map_size, IORING_OFF_CQ_RING);
+        ring->sqes = (io_uring_sqe*) ring_map(ring->fd, ring->entries*sizeof(io_uring_sqe), IORING_OFF_SQES);
+        if (ring->sq_map == NULL || ring->cq_map == NULL || ring->sqes == NULL)
+        {
+                int error = errno;
+                ring_teardown(ring);
+                errno = error;
+                return -1;
+        }
+
+        uint8_t* sq = (uint8_t*)ring->sq_map;
+        uint8_t* cq = (uint8_t*)ring->cq_map;
+        ring->sq_head = (unsigned int*)(sq + params.sq_off.head);
+        ring->sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+        ring->sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+        ring->sq_array = (unsigned int*)(sq + params.sq_off.array);
+        ring->cq_head = (unsigned int*)(cq + params.cq_off.head);
+        ring->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+        ring->cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+        ring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        return 0;
+}
+
+
+// keeps up to a ring's worth of reads in flight. every io_uring_enter submits what was queued and
+// waits for at least one completion, whatever completed is then handed to the job pool while the
+// kernel keeps working on the rest
+static void run_ring(RegionReader* reader, IoRead* reads, int count, const std::function<void(int)>& complete)
+{
+        RegionRing* ring = &reader->ring;
+        std::vector<int> again, finished;
+        int next = 0;
+        unsigned int in_flight = 0;
+
+        while (next < count || !again.empty() || in_flight > 0)
+        {
+                // in_flight never passes the submission ring, and the completion ring is twice that
+                unsigned int tail = *ring->sq_tail;
+                while (in_flight < ring->entries && (next < count || !again.empty()))
+                {
+                        int index;
+                        if (!again.empty())
+                        {
+                                index = again.back();
+                                again.pop_back();
+                        }
+                        else
+                                index = next++;
+
+                        IoRead* read = &reads[index];
+                        unsigned int slot = tail & *ring->sq_mask;
+                        io_uring_sqe* sqe = &ring->sqes[slot];
+                        memset(sqe, 0, sizeof(*sqe));
+                        sqe->opcode = IORING_OP_READ;
+                        sqe->fd = read->fd;
+                        sqe->addr = (uint64_t)(uintptr_t)(read->buffer + read->done);
+                        sqe->len = read->size - read->done;
+                        sqe->off = read->offset + read->done;
+                        sqe->user_data = index;
+                        ring->sq_array[slot] = slot;
+                        tail++;
+                        in_flight++;
+                }
+                __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+                // anything the kernel hasn't consumed yet, including leftovers of an interrupted enter
+                unsigned int submit = tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+                int entered = (int)syscall(__NR_io_uring_enter, ring->fd, submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+                reader->syscalls++;
+                if (entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                {
+                        printf("io_uring_enter failed: %s\n", strerror(errno));
+                        for (int i = 0 ; i < count ; i++)
+                                if (reads[i].result == 0 && reads[i].done < reads[i].size)
+                                {
+                                        reads[i].result = -EIO;
+                                        complete(i);
+                                }
+                        return;
+                }
+
+                finished.clear();
+                unsigned int head = *ring->cq_head;
+                unsigned int end = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+                for ( ; head != end ; head++)
+                {
+                        const io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+                        int index = (int)cqe->user_data;
+                        IoRead* read = &reads[index];
+                        in_flight--;
+                        if (cqe->res == -EAGAIN || cqe->res == -EINTR)
+                                again.push_back(index);
+                        else if (cqe->res < 0)
+                        {
+                                read->result = cqe->res;
+                                finished.push_back(index);
+                        }
+                        else if (cqe->res == 0)
+                        {
+                                // the file is shorter than its header said
+                                read->result = -EIO;
+                                finished.push_back(index);
+                        }
+                        else
+                        {
+                                read->done += cqe->res;
+                                if (read->done < read->size)
+                                        again.push_back(index);
+                                else
+                                        finished.push_back(index);
+                        }
+                }
+                __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+                job_pool_parallel_for(reader->pool, (int)finished.size(), 1, [&](int begin, int end)
+                {
+                        for (int i = begin ; i < end ; i++)
+                                complete(finished[i]);
+                });
+        }
+}
+
+
+// blocking reads spread over the io threads, each completes its own read
+static void run_pread(RegionReader* reader, IoRead* reads, int count, const std::function<void(int)>& complete)
+{
+        std::atomic<uint64_t> syscalls(0);
+        job_pool_parallel_for(&reader->io, count, 1, [&](int begin, int end)
+        {
+                for (int i = begin ; i < end ; i++)
+                {
+                        IoRead* read = &reads[i];
+                        while (read->done < read->size)
+                        {
+                                ssize_t got = pread(read->fd, read->buffer + read->done, read->size - read->done, read->offset + read->done);
+                                syscalls++;
+                                if (got < 0 && errno == EINTR)
+                                        continue;
+                                if (got <= 0)
+                                {
+                                        read->result = got < 0 ? -errno : -EIO;
+                                        break;
+                                }
+                                read->done += got;
+                        }
+                        complete(i);
+                }
+        });
+        reader->syscalls += syscalls;
+}
+
+
+static void run_reads(RegionReader* reader, std::vector<IoRead>& reads, const std::function<void(int)>& complete)
+{
+        for (IoRead& read : reads)
+        {
+                read.done = 0;
+                read.result = 0;
+                reader->bytes += read.size;
+        }
+        reader->reads += reads.size();
+        if (reader->backend == REGION_READER_URING)
+                run_ring(reader, reads.data(), (int)reads.size(), complete);
+        else
+                run_pread(reader, reads.data(), (int)reads.size(), complete);
+}
+
+
+int region_reader_init(RegionReader* reader, const char* directory, JobPool* pool, int backend)
+{
+        snprintf(reader->directory, sizeof(reader->directory), "%s", directory);
+        reader->pool = pool;
+        reader->backend = backend;
+        reader->reads = 0;
+        reader->syscalls = 0;
+        reader->bytes = 0;
+        reader->ring = {};
+        reader->ring.fd = -1;
+
+        if (backend == REGION_READER_URING && ring_setup(&reader->ring, REGION_READER_DEPTH) != 0)
+        {
+                printf("io_uring unavailable (%s), reading regions with preads\n", strerror(errno));
+                reader->backend = REGION_READER_PREAD;
+        }
+        if (reader->backend == REGION_READER_PREAD)
+                return job_pool_init(&reader->io, REGION_READER_THREADS);
+        return 0;
+}
+
+
+void region_reader_forget(RegionReader* reader)
+{
+        for (auto& entry : reader->regions)
+                if (entry.second.fd >= 0)
+                        close(entry.second.fd);
+        reader->regions.clear();
+}
+
+
+void region_reader_destroy(RegionReader* reader)
+{
+        region_reader_forget(reader);
+        if (reader->backend == REGION_READER_URING)
+                ring_teardown(&reader->ring);
+        else
+                job_pool_destroy(&reader->io);
+}
+
+
+static bool chunk_region(glm::ivec3 chunk, glm::ivec3* region, int* slot)
+{
+        if (chunk.x < 0 || chunk.y < 0 || chunk.z < 0)
+                return false;
+        *region = chunk / SAVE_REGION_CHUNKS;
+        glm::ivec3 local = chunk % SAVE_REGION_CHUNKS;
+        *slot = local.x + local.y*SAVE_REGION_CHUNKS + local.z*SAVE_REGION_CHUNKS*SAVE_REGION_CHUNKS;
+        return true;
+}
+
+
+// the payload offsets of a region whose header just arrived, if it is one
+static void region_validate(RegionFile* file, glm::ivec3 region)
+{
+        const SaveRegionHeader* header = &file->header;
+        bool images = header->version == SAVE_REGION_VERSION_IMAGES;
+        struct stat info;
+        if (header->magic != SAVE_REGION_MAGIC || (header->version != SAVE_REGION_VERSION && !images)
+         || header->x != region.x || header->y != region.y || header->z != region.z
+         || fstat(file->fd, &info) != 0)
+                return;
+
+        uint64_t offset = save_region_payload_offset(header->version);
+        for (int slot = 0 ; slot < SAVE_REGION_SLOTS ; slot++)
+        {
+                if (images && header->sizes[slot] != 0 && header->sizes[slot] != CHUNK_IMAGE_BYTES)
+                        return;
+                file->offsets[slot] = offset;
+                offset += header->sizes[slot];
+        }
+        file->valid = offset == (uint64_t)info.st_size;
+}
+
+
+int region_reader_read(RegionReader* reader, RegionRead* reads, int count)
+{
+        // region files this batch is the first to touch
+        std::vector<IoRead> headers;
+        std::vector<RegionFile*> opened;
+        std::vector<glm::ivec3> opened_regions;
+        for (int i = 0 ; i < count ; i++)
+        {
+                reads[i].status = REGION_READ_MISSING;
+                glm::ivec3 region;
+                int slot;
+                if (!chunk_region(reads[i].chunk, &region, &slot))
+                        continue;
+                uint64_t key = chunk_coord_key(region);
+                if (reader->regions.count(key))
+                        continue;
+
+                // elements of an unordered_map stay put, the reads below can point into them
+                RegionFile* file = &reader->regions[key];
+                file->valid = false;
+                char path[512];
+                save_region_path(reader->directory, region, path, sizeof(path));
+                file->fd = open(path, O_RDONLY | O_CLOEXEC);
+                if (file->fd < 0)
+                        continue;
+
+                IoRead read = {};
+                read.fd = file->fd;
+                read.buffer = (uint8_t*)&file->header;
+                read.size = sizeof(SaveRegionHeader);
+                headers.push_back(read);
+                opened.push_back(file);
+                opened_regions.push_back(region);
+        }
+        run_reads(reader, headers, [&](int index)
+        {
+                if (headers[index].result == 0)
+                        region_validate(opened[index], opened_regions[index]);
+                else
+                        printf("unable to read a region header: %s\n", strerror(-headers[index].result));
+        });
+
+        // then every payload of the batch at once. images need no decoding and land where they are
+        // wanted: the whole image in image, the texels at its front in material
+        std::vector<IoRead> payloads;
+        size_t staged = 0;
+        for (int i = 0 ; i < count ; i++)
+        {
+                reads[i].image_ready = false;
+                glm::ivec3 region;
+                int slot;
+                if (!chunk_region(reads[i].chunk, &region, &slot))
+                        continue;
+                const RegionFile* file = &reader->regions[chunk_coord_key(region)];
+                if (!file->valid || file->header.sizes[slot] == 0)
+                        continue;
+
+                IoRead read = {};
+                read.fd = file->fd;
+                read.offset = file->offsets[slot];
+                read.target = i;
+                if (file->header.version == SAVE_REGION_VERSION_IMAGES)
+                {
+                        if (reads[i].image)
+                        {
+                                read.buffer = reads[i].image;
+                                read.size = CHUNK_IMAGE_BYTES;
+                                payloads.push_back(read);
+                        }
+                        if (reads[i].material)
+                        {
+                                read.buffer = reads[i].material;
+                                read.size = CHUNK_VOLUME;
+                                payloads.push_back(read);
+                        }
+                        continue;
+                }
+                if (reads[i].material == NULL)
+                        continue;
+
+                read.size = file->header.sizes[slot];
+                read.decode = true;
+                // a staging offset for now, staging is sized once they are all known
+                read.buffer = (uint8_t*)(uintptr_t)staged;
+                staged += read.size;
+                payloads.push_back(read);
+        }
+        reader->staging.resize(staged);
+        for (IoRead& read : payloads)
+                if (read.decode)
+                        read.buffer = reader->staging.data() + (uintptr_t)read.buffer;
+
+        run_reads(reader, payloads, [&](int index)
+        {
+                IoRead* read = &payloads[index];
+                if (read->result != 0 || !read->decode)
+                        return;
+                uint8_t* material = reads[read->target].material;
+                memset(material, 0, CHUNK_VOLUME);
+                if (!rle_decode(read->buffer, read->buffer + read->size, material, CHUNK_VOLUME))
+                        read->result = -EILSEQ;
+        });
+
+        // a request can have two reads, so the status is settled once all of them are in
+        for (const IoRead& read : payloads)
+        {
+                RegionRead* target = &reads[read.target];
+                if (read.result != 0)
+                        target->status = REGION_READ_ERROR;
+                else if (target->status != REGION_READ_ERROR)
+                        target->status = REGION_READ_OK;
+                if (read.result == 0 && read.buffer == target->image)
+                        target->image_ready = true;
+        }
+
+        int ok = 0;
+        for (int i = 0 ; i < count ; i++)
+        {
+                if (reads[i].status == REGION_READ_ERROR)
+                        printf("unable to read chunk %d %d %d from its region\n", reads[i].chunk.x, reads[i].chunk.y, reads[i].chunk.z);
+                ok += reads[i].status == REGION_READ_OK;
+        }
+        return ok;
+}
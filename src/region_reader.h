@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "jobs.h"
+#include "save.h"
+
+// submission queue entries of the io_uring, the most reads in flight at once
+#define REGION_READER_DEPTH 256
+// pread threads of the fallback, reads mostly wait on the disk so there are more than cores
+#define REGION_READER_THREADS 8
+
+enum RegionReaderBackend
+{
+        REGION_READER_URING,
+        REGION_READER_PREAD,
+};
+extern const char* region_reader_backend_names[];
+
+enum RegionReadStatus
+{
+        REGION_READ_OK,
+        // no region file, or the chunk isn't in it: keep the generated terrain
+        REGION_READ_MISSING,
+        REGION_READ_ERROR,
+};
+
+// one chunk to stream in from the region files of a save directory
+typedef struct RegionRead
+{
+        glm::ivec3 chunk;
+        // CHUNK_VOLUME bytes, only meaningful once status is REGION_READ_OK. may be NULL when only the image is wanted
+        uint8_t* material;
+        // optional, CHUNK_IMAGE_BYTES (see chunk_image.h), e.g. an upload staging slot. a region stored as
+        // images is read straight into it and image_ready is set. compressed regions leave it alone, and
+        // without a material to decode into they read as REGION_READ_MISSING
+        uint8_t* image;
+        bool image_ready;
+        int status;
+}RegionRead;
+
+// a region file opened by the reader, fd -1 when there is none
+typedef struct RegionFile
+{
+        int fd;
+        bool valid;
+        SaveRegionHeader header;
+        uint64_t offsets[SAVE_REGION_SLOTS];
+}RegionFile;
+
+// the rings shared with the kernel, see io_uring_setup(2)
+typedef struct RegionRing
+{
+        int fd;
+        unsigned int entries;
+        void* sq_map;
+        void* cq_map;
+        size_t sq_map_size, cq_map_size;
+        struct io_uring_sqe* sqes;
+        unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+        unsigned int *cq_head, *cq_tail, *cq_mask;
+        struct io_uring_cqe* cqes;
+}RegionRing;
+
+// reads single chunks out of the region files written by the saver, for streaming chunks in as the
+// camera moves. with io_uring one syscall submits a whole batch of reads and reaps whatever has
+// completed, the compressed payloads are decoded on the job pool while the rest are still in flight.
+// without io_uring (old kernel, seccomp) a pool of threads does blocking preads instead.
+// only the region header and the run length encoding are checked, the region checksum covers every
+// payload and needs the whole file, which save_open does verify. the decoder never reads past a payload
+// or writes past the chunk, so a damaged one is a REGION_READ_ERROR
+typedef struct RegionReader
+{
+        char directory[256];
+        int backend;
+        JobPool* pool;
+        RegionRing ring;
+        JobPool io;
+
+        // by packed region coordinate, kept open
+        std::unordered_map<uint64_t, RegionFile> regions;
+        // compressed payloads of the batch being read
+        std::vector<uint8_t> staging;
+
+        // totals, to see how many reads each syscall carried
+        uint64_t reads, syscalls, bytes;
+}RegionReader;
+
+// backend REGION_READER_URING falls back to preads when the kernel refuses the ring.
+// decoding runs on pool, which must outlive the reader
+int region_reader_init(RegionReader* reader, const char* directory, JobPool* pool, int backend);
+void region_reader_destroy(RegionReader* reader);
+
+// reads and decodes every request, returns how many are REGION_READ_OK. region files are opened on
+// first use and their headers read in a batch of their own
+int region_reader_read(RegionReader* reader, RegionRead* reads, int count);
+// closes the region files so a checkpoint written since is seen
+void region_reader_forget(RegionReader* reader);
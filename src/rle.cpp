@@ -0,0 +1,98 @@
+#include "rle.h"
+
+#include <string.h>
+
+
+void rle_put_varint(std::vector<uint8_t>& out, size_t value)
+{
+        while (value >= 0x80)
+        {
+                out.push_back((uint8_t)(value | 0x80));
+                value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+}
+
+
+bool rle_get_varint(const uint8_t** in, const uint8_t* end, size_t* value)
+{
+        *value = 0;
+        for (int shift = 0 ; *in < end ; shift += 7)
+        {
+                if (shift > 63)
+                        return false;
+                uint8_t byte = *(*in)++;
+                *value |= (size_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                        return true;
+        }
+        return false;
+}
+
+
+// zero runs shorter than this stay inside the literals, a pair costs at least two bytes
+#define RLE_MIN_ZEROS 4
+
+void rle_encode(std::vector<uint8_t>& out, const uint8_t* raw, size_t size)
+{
+        size_t i = 0;
+        while (i < size)
+        {
+                size_t zeros = 0;
+                while (i < size && raw[i] == 0)
+                {
+                        // most of a delta is zero, skip it a word at a time
+                        uint64_t word = 1;
+                        if (i + 8 <= size)
+                                memcpy(&word, raw + i, sizeof(word));
+                        if (word == 0)
+                        {
+                                zeros += 8;
+                                i += 8;
+                        }
+                        else
+                        {
+                                zeros++;
+                                i++;
+                        }
+                }
+                if (i == size)
+                        return;
+
+                size_t start = i, end = i, run = 0;
+                while (i < size && run < RLE_MIN_ZEROS)
+                {
+                        run = raw[i] == 0 ? run + 1 : 0;
+                        i++;
+                        if (run == 0)
+                                end = i;
+                }
+                i = end;
+
+                rle_put_varint(out, zeros);
+                rle_put_varint(out, end - start);
+                out.insert(out.end(), raw + start, raw + end);
+        }
+}
+
+
+bool rle_decode(const uint8_t* in, const uint8_t* end, uint8_t* raw, size_t size)
+{
+        size_t position = 0;
+        while (in < end)
+        {
+                size_t zeros, literals;
+                if (!rle_get_varint(&in, end, &zeros) || !rle_get_varint(&in, end, &literals))
+                        return false;
+                // compared against what is left, so a huge count can't wrap the sums
+                if (zeros > size - position)
+                        return false;
+                position += zeros;
+                if (literals > size - position || literals > (size_t)(end - in))
+                        return false;
+                memcpy(raw + position, in, literals);
+                position += literals;
+                in += literals;
+        }
+        return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// little endian base 128 varints. reading one stops at end, false when the stream ends inside it or it
+// runs past 64 bits
+void rle_put_varint(std::vector<uint8_t>& out, size_t value);
+bool rle_get_varint(const uint8_t** in, const uint8_t* end, size_t* value);
+
+// zero run length code for sparse byte streams (xor deltas, mostly empty chunks):
+// (varint zero bytes, varint literal bytes, literals) pairs. zeros past the last literal are left out
+void rle_encode(std::vector<uint8_t>& out, const uint8_t* raw, size_t size);
+// raw has to be zeroed and size bytes long, false when the stream runs past it or is cut short. never
+// reads outside [in, end) or writes outside raw, whatever the stream holds
+bool rle_decode(const uint8_t* in, const uint8_t* end, uint8_t* raw, size_t size);
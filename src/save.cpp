@@ -0,0 +1,719 @@
+#include "save.h"
+#include "chunk_image.h"
+#include "rle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+
+static double now_seconds()
+{
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t size)
+{
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0 ; i < size ; i++)
+                hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+}
+#define FNV_BASIS 2166136261u
+
+
+static bool write_all(int fd, const void* data, size_t size)
+{
+        const char* bytes = (const char*)data;
+        while (size > 0)
+        {
+                ssize_t written = write(fd, bytes, size);
+                if (written < 0)
+                {
+                        if (errno == EINTR)
+                                continue;
+                        return false;
+                }
+                bytes += written;
+                size -= written;
+        }
+        return true;
+}
+
+
+// a rename or unlink is only durable once the directory itself is synced
+static void sync_directory(const char* directory)
+{
+        int fd = open(directory, O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+                return;
+        fsync(fd);
+        close(fd);
+}
+
+
+static void segment_path(const SaveWorker* saver, uint64_t first, char* path, size_t size)
+{
+        snprintf(path, size, "%s/log.%016llx.wal", saver->directory, (unsigned long long)first);
+}
+
+
+void save_region_path(const char* directory, glm::ivec3 region, char* path, size_t size)
+{
+        snprintf(path, size, "%s/region.%d.%d.%d.bin", directory, region.x, region.y, region.z);
+}
+
+
+static void region_path(const SaveWorker* saver, glm::ivec3 region, char* path, size_t size)
+{
+        save_region_path(saver->directory, region, path, size);
+}
+
+
+static glm::ivec3 region_count(const SaveWorker* saver)
+{
+        return (glm::ivec3(saver->width, saver->height, saver->depth) + SAVE_REGION_CHUNKS-1) / SAVE_REGION_CHUNKS;
+}
+
+
+// occupancy of the columns in box from the material just written there
+static void rebuild_occupancy(Chunk* chunk, DirtyBox box)
+{
+        uint64_t rows = (box.max.y >= 64 ? ~0ull : (1ull << box.max.y) - 1) & ~((1ull << box.min.y) - 1);
+        for (int z = box.min.z ; z < box.max.z ; z++)
+        for (int x = box.min.x ; x < box.max.x ; x++)
+        {
+                uint64_t bits = 0;
+                for (int y = box.min.y ; y < box.max.y ; y++)
+                        bits |= (uint64_t)(chunk->material[chunk_voxel_index(x,y,z)] != 0) << y;
+                uint64_t* column = &chunk->occupancy[chunk_column_index(x,z)];
+                *column = (*column & ~rows) | bits;
+        }
+}
+
+
+static bool read_file(const char* path, std::vector<uint8_t>& data)
+{
+        FILE* file = fopen(path, "rb");
+        if (file == NULL)
+                return false;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        data.resize(size > 0 ? size : 0);
+        bool ok = size >= 0 && fread(data.data(), 1, data.size(), file) == data.size();
+        fclose(file);
+        return ok;
+}
+
+
+static void load_region(SaveWorker* saver, World* world, glm::ivec3 region)
+{
+        char path[512];
+        region_path(saver, region, path, sizeof(path));
+        std::vector<uint8_t> data;
+        if (!read_file(path, data))
+                return;
+
+        SaveRegionHeader header;
+        if (data.size() < sizeof(header))
+        {
+                printf("region %s is truncated, using generated terrain\n", path);
+                return;
+        }
+        memcpy(&header, data.data(), sizeof(header));
+        bool images = header.version == SAVE_REGION_VERSION_IMAGES;
+        size_t start = save_region_payload_offset(header.version);
+        size_t payload = 0;
+        bool sizes_ok = true;
+        for (int slot = 0 ; slot < SAVE_REGION_SLOTS ; slot++)
+        {
+                payload += header.sizes[slot];
+                sizes_ok &= !images || header.sizes[slot] == 0 || header.sizes[slot] == CHUNK_IMAGE_BYTES;
+        }
+        if (header.magic != SAVE_REGION_MAGIC || (header.version != SAVE_REGION_VERSION && !images) || !sizes_ok
+         || header.x != region.x || header.y != region.y || header.z != region.z
+         || start + payload != data.size()
+         || fnv1a(FNV_BASIS, data.data() + start, payload) != header.checksum)
+        {
+                printf("region %s is corrupt, using generated terrain\n", path);
+                return;
+        }
+
+        const uint8_t* in = data.data() + start;
+        for (int slot = 0 ; slot < SAVE_REGION_SLOTS ; slot++)
+        {
+                size_t size = header.sizes[slot];
+                glm::ivec3 c = region*SAVE_REGION_CHUNKS
+                             + glm::ivec3(slot % SAVE_REGION_CHUNKS, slot / SAVE_REGION_CHUNKS % SAVE_REGION_CHUNKS, slot / (SAVE_REGION_CHUNKS*SAVE_REGION_CHUNKS));
+                if (size == 0 || c.x >= world->width || c.y >= world->height || c.z >= world->depth)
+                {
+                        in += size;
+                        continue;
+                }
+
+                Chunk* chunk = world_chunk_write(world, world_chunk_index(world, c.x, c.y, c.z));
+                if (chunk)
+                {
+                        DirtyBox box = {glm::ivec3(0), glm::ivec3(CHUNK_SIZE)};
+                        if (images)
+                                chunk_image_unpack(chunk, in);
+                        else
+                        {
+                                memset(chunk->material, 0, CHUNK_VOLUME);
+                                rle_decode(in, in + size, chunk->material, CHUNK_VOLUME);
+                                rebuild_occupancy(chunk, box);
+                        }
+                        chunk_mark_dirty(chunk, box);
+                }
+                in += size;
+        }
+}
+
+
+// applies every intact record of a segment, returns the last sequence applied (0 for none)
+static uint64_t replay_segment(World* world, const char* path, int* records)
+{
+        std::vector<uint8_t> data;
+        if (!read_file(path, data))
+                return 0;
+
+        uint64_t last = 0;
+        std::vector<uint8_t> raw;
+        size_t offset = 0;
+        while (offset + sizeof(SaveRecordHeader) <= data.size())
+        {
+                SaveRecordHeader header;
+                memcpy(&header, data.data() + offset, sizeof(header));
+                const uint8_t* payload = data.data() + offset + sizeof(header);
+                if (header.magic != SAVE_WAL_MAGIC || offset + sizeof(header) + header.size > data.size())
+                        break;
+                uint32_t checksum = header.checksum;
+                header.checksum = 0;
+                if (fnv1a(fnv1a(FNV_BASIS, &header, sizeof(header)), payload, header.size) != checksum
+                 || (int)header.chunk >= world_chunk_count(world))
+                        break;
+
+                DirtyBox box;
+                for (int axis = 0 ; axis < 3 ; axis++)
+                {
+                        box.min[axis] = header.min[axis];
+                        box.max[axis] = header.max[axis] + 1;
+                }
+                glm::ivec3 size = box.max - box.min;
+                raw.assign((size_t)size.x*size.y*size.z, 0);
+                Chunk* chunk = world_chunk_write(world, header.chunk);
+                if (chunk && rle_decode(payload, payload + header.size, raw.data(), raw.size()))
+                {
+                        const uint8_t* row = raw.data();
+                        for (int z = box.min.z ; z < box.max.z ; z++)
+                        for (int y = box.min.y ; y < box.max.y ; y++)
+                        {
+                                memcpy(&chunk->material[chunk_voxel_index(box.min.x,y,z)], row, size.x);
+                                row += size.x;
+                        }
+                        rebuild_occupancy(chunk, box);
+                        chunk_mark_dirty(chunk, box);
+                }
+
+                last = header.sequence;
+                (*records)++;
+                offset += sizeof(header) + header.size;
+        }
+        if (offset != data.size())
+                printf("dropped a torn log tail of %zu bytes in %s\n", data.size() - offset, path);
+        return last;
+}
+
+
+static bool open_segment(SaveWorker* saver, uint64_t first)
+{
+        char path[512];
+        segment_path(saver, first, path, sizeof(path));
+        saver->log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        saver->log_first = first;
+        if (saver->log_fd < 0)
+        {
+                printf("unable to open the save log %s\n", path);
+                return false;
+        }
+        sync_directory(saver->directory);
+        return true;
+}
+
+
+static void append_record(std::vector<uint8_t>& log, const SaveJob* job)
+{
+        static std::vector<uint8_t> payload;
+        glm::ivec3 size = job->box.max - job->box.min;
+        payload.clear();
+        rle_encode(payload, job->texels, (size_t)size.x*size.y*size.z);
+
+        SaveRecordHeader header = {};
+        header.magic = SAVE_WAL_MAGIC;
+        header.size = payload.size();
+        header.sequence = job->sequence;
+        header.chunk = job->chunk;
+        for (int axis = 0 ; axis < 3 ; axis++)
+        {
+                header.min[axis] = job->box.min[axis];
+                header.max[axis] = job->box.max[axis] - 1;
+        }
+        header.checksum = fnv1a(fnv1a(FNV_BASIS, &header, sizeof(header)), payload.data(), payload.size());
+
+        log.insert(log.end(), (const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+        log.insert(log.end(), payload.begin(), payload.end());
+}
+
+
+// one write and one fsync for every record gathered since the last one
+static void flush_log(SaveWorker* saver, std::vector<uint8_t>& log, std::vector<double>& queued)
+{
+        if (log.empty())
+                return;
+        if (saver->log_fd < 0 || !write_all(saver->log_fd, log.data(), log.size()) || fdatasync(saver->log_fd) != 0)
+                printf("unable to write the save log, %zu records are not durable\n", queued.size());
+
+        double now = now_seconds(), total = 0.0, worst = 0.0;
+        for (double time : queued)
+        {
+                total += now - time;
+                worst = std::max(worst, now - time);
+        }
+
+        std::lock_guard<std::mutex> lock(saver->mutex);
+        saver->metrics.records += queued.size();
+        saver->metrics.fsyncs++;
+        saver->metrics.log_bytes += log.size();
+        saver->metrics.latency_milliseconds = total / queued.size() * 1000.0;
+        saver->metrics.latency_max_milliseconds = std::max(saver->metrics.latency_max_milliseconds, worst * 1000.0);
+        log.clear();
+        queued.clear();
+}
+
+
+// counts go to metrics: [0] chunks written, [1] chunks left to the generator
+static bool write_region(SaveWorker* saver, const World* world, glm::ivec3 region, size_t* written, uint64_t chunks[2])
+{
+        SaveRegionHeader header = {};
+        header.magic = SAVE_REGION_MAGIC;
+        header.version = saver->format == SAVE_FORMAT_IMAGES ? SAVE_REGION_VERSION_IMAGES : SAVE_REGION_VERSION;
+        header.x = region.x;
+        header.y = region.y;
+        header.z = region.z;
+
+        std::vector<uint8_t> payload;
+        // for chunks the cache has evicted
+        std::vector<uint8_t> scratch(CHUNK_VOLUME);
+        for (int slot = 0 ; slot < SAVE_REGION_SLOTS ; slot++)
+        {
+                glm::ivec3 c = region*SAVE_REGION_CHUNKS
+                             + glm::ivec3(slot % SAVE_REGION_CHUNKS, slot / SAVE_REGION_CHUNKS % SAVE_REGION_CHUNKS, slot / (SAVE_REGION_CHUNKS*SAVE_REGION_CHUNKS));
+                if (c.x >= world->width || c.y >= world->height || c.z >= world->depth)
+                        continue;
+                const Chunk* chunk = world->chunks[world_chunk_index(world, c.x, c.y, c.z)];
+                if (chunk == NULL)
+                        continue;
+                // unedited, or edited back: loading generates it again
+                if (saver->generator && generator_cache_matches(saver->generator, chunk))
+                {
+                        chunks[1]++;
+                        continue;
+                }
+                chunks[0]++;
+                size_t before = payload.size();
+                if (saver->format == SAVE_FORMAT_IMAGES)
+                {
+                        payload.resize(before + CHUNK_IMAGE_BYTES);
+                        chunk_image_pack(chunk, payload.data() + before);
+                }
+                else
+                        rle_encode(payload, chunk_material_read(chunk, scratch.data()), CHUNK_VOLUME);
+                header.sizes[slot] = payload.size() - before;
+        }
+        header.checksum = fnv1a(FNV_BASIS, payload.data(), payload.size());
+
+        char path[512], temporary[520];
+        region_path(saver, region, path, sizeof(path));
+        if (payload.empty())
+        {
+                // nothing left that the generator doesn't make
+                if (unlink(path) != 0 && errno != ENOENT)
+                {
+                        printf("unable to remove region %s\n", path);
+                        return false;
+                }
+                return true;
+        }
+
+        // padded up to where the payloads start
+        std::vector<uint8_t> head(save_region_payload_offset(header.version), 0);
+        memcpy(head.data(), &header, sizeof(header));
+
+        snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+        int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+                return false;
+        bool ok = write_all(fd, head.data(), head.size()) && write_all(fd, payload.data(), payload.size()) && fsync(fd) == 0;
+        close(fd);
+        if (!ok || rename(temporary, path) != 0)
+        {
+                printf("unable to write region %s\n", path);
+                unlink(temporary);
+                return false;
+        }
+        *written += head.size() + payload.size();
+        return true;
+}
+
+
+// folds everything up to sequence into the region files, then drops the log segments that held it
+static void checkpoint(SaveWorker* saver, uint64_t sequence)
+{
+        double start = now_seconds();
+
+        // the segment being appended to ends at sequence (jobs are in order), later records go to a new one
+        if (saver->log_fd >= 0 && saver->log_first <= sequence)
+        {
+                close(saver->log_fd);
+                saver->closed_segments.push_back(saver->log_first);
+                open_segment(saver, sequence + 1);
+        }
+
+        if (saver->store == NULL || saver->store->current.load() == NULL)
+                return;
+        if (saver->reader < 0)
+                saver->reader = snapshot_reader_register(saver->store);
+        if (saver->reader < 0)
+                return;
+
+        // the snapshot was published after the records were queued, so it holds at least all of them
+        const WorldSnapshot* snapshot = snapshot_acquire(saver->store, saver->reader);
+        const World* world = &snapshot->world;
+        glm::ivec3 regions = region_count(saver);
+        size_t written = 0;
+        uint64_t chunks[2] = {};
+        bool ok = true;
+        for (int rz = 0 ; rz < regions.z ; rz++)
+        for (int ry = 0 ; ry < regions.y ; ry++)
+        for (int rx = 0 ; rx < regions.x ; rx++)
+        {
+                glm::ivec3 region = glm::ivec3(rx, ry, rz);
+                glm::ivec3 first = region*SAVE_REGION_CHUNKS;
+                glm::ivec3 last = glm::min(first + SAVE_REGION_CHUNKS, glm::ivec3(world->width, world->height, world->depth));
+                bool changed = false;
+                for (int z = first.z ; z < last.z ; z++)
+                for (int y = first.y ; y < last.y ; y++)
+                for (int x = first.x ; x < last.x ; x++)
+                {
+                        int index = world_chunk_index(world, x, y, z);
+                        changed |= world->chunks[index] && world->chunks[index]->version != saver->saved_version[index];
+                }
+                if (!changed)
+                        continue;
+                if (!write_region(saver, world, region, &written, chunks))
+                {
+                        ok = false;
+                        continue;
+                }
+                for (int z = first.z ; z < last.z ; z++)
+                for (int y = first.y ; y < last.y ; y++)
+                for (int x = first.x ; x < last.x ; x++)
+                {
+                        int index = world_chunk_index(world, x, y, z);
+                        if (world->chunks[index])
+                                saver->saved_version[index] = world->chunks[index]->version;
+                }
+        }
+        snapshot_release(saver->store, saver->reader);
+        sync_directory(saver->directory);
+
+        // a failed region keeps the log around, the next checkpoint tries again
+        if (ok)
+        {
+                char path[512];
+                for (uint64_t first : saver->closed_segments)
+                {
+                        segment_path(saver, first, path, sizeof(path));
+                        unlink(path);
+                }
+                saver->closed_segments.clear();
+                sync_directory(saver->directory);
+        }
+
+        std::lock_guard<std::mutex> lock(saver->mutex);
+        saver->metrics.checkpoints++;
+        saver->metrics.region_bytes += written;
+        saver->metrics.chunks_written += chunks[0];
+        saver->metrics.chunks_generated += chunks[1];
+        saver->metrics.checkpoint_milliseconds = (now_seconds() - start) * 1000.0;
+}
+
+
+static void save_thread(SaveWorker* saver)
+{
+        std::vector<SaveJob*> batch;
+        std::vector<uint8_t> log;
+        std::vector<double> queued;
+        while (true)
+        {
+                {
+                        std::unique_lock<std::mutex> lock(saver->mutex);
+                        saver->wake.wait(lock, [saver]{ return !saver->running || !saver->pending.empty(); });
+                        if (saver->pending.empty())
+                                return;
+                        // everything that piled up during the last fsync goes out with the next one
+                        batch.assign(saver->pending.begin(), saver->pending.end());
+                        saver->pending.clear();
+                }
+
+                for (SaveJob* job : batch)
+                {
+                        if (job->kind == SAVE_RECORD)
+                        {
+                                append_record(log, job);
+                                queued.push_back(job->queued);
+                                glm::ivec3 size = job->box.max - job->box.min;
+                                std::lock_guard<std::mutex> lock(saver->mutex);
+                                saver->metrics.logical_bytes += (size_t)size.x*size.y*size.z;
+                        }
+                        else
+                        {
+                                flush_log(saver, log, queued);
+                                checkpoint(saver, job->sequence);
+                        }
+                        free(job->texels);
+                        free(job);
+                }
+                flush_log(saver, log, queued);
+        }
+}
+
+
+bool save_read_seed(const char* directory, unsigned int* seed)
+{
+        char path[512];
+        snprintf(path, sizeof(path), "%s/world.meta", directory);
+        FILE* file = fopen(path, "r");
+        if (file == NULL)
+                return false;
+        bool ok = fscanf(file, "seed %u", seed) == 1;
+        fclose(file);
+        return ok;
+}
+
+
+int save_open(SaveWorker* saver, const char* directory, World* world, ChunkStore* store, int format, GeneratorCache* generator)
+{
+        snprintf(saver->directory, sizeof(saver->directory), "%s", directory);
+        saver->format = format;
+        saver->generator = generator;
+        saver->width = world->width;
+        saver->height = world->height;
+        saver->depth = world->depth;
+        saver->store = store;
+        saver->next_sequence = 1;
+        saver->logged = false;
+        saver->last_checkpoint = now_seconds();
+        saver->log_fd = -1;
+        saver->reader = -1;
+        saver->metrics = {};
+
+        if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+        {
+                printf("unable to create the save directory %s\n", directory);
+                return -1;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/world.meta", directory);
+        FILE* meta = fopen(path, "r");
+        if (meta)
+        {
+                unsigned int seed;
+                int width, height, depth;
+                int read = fscanf(meta, "seed %u size %d %d %d", &seed, &width, &height, &depth);
+                fclose(meta);
+                if (read != 4 || seed != world->seed || width != world->width || height != world->height || depth != world->depth)
+                {
+                        printf("the save in %s belongs to another world\n", directory);
+                        return -1;
+                }
+        }
+        else
+        {
+                meta = fopen(path, "w");
+                if (meta == NULL)
+                {
+                        printf("unable to write %s\n", path);
+                        return -1;
+                }
+                fprintf(meta, "seed %u size %d %d %d\n", world->seed, world->width, world->height, world->depth);
+                fflush(meta);
+                fsync(fileno(meta));
+                fclose(meta);
+                sync_directory(directory);
+        }
+
+        int count = world_chunk_count(world);
+        std::vector<unsigned int> before(count, 0);
+        for (int i = 0 ; i < count ; i++)
+                if (world->chunks[i])
+                        before[i] = world->chunks[i]->version;
+
+        glm::ivec3 regions = region_count(saver);
+        for (int rz = 0 ; rz < regions.z ; rz++)
+        for (int ry = 0 ; ry < regions.y ; ry++)
+        for (int rx = 0 ; rx < regions.x ; rx++)
+                load_region(saver, world, glm::ivec3(rx, ry, rz));
+
+        // what the region files hold, chunks the log changes on top get rewritten by the next checkpoint.
+        // a chunk no region held may have been edited before the save was opened, it starts at 0 so
+        // the first checkpoint writes it
+        bool unsaved = false;
+        saver->saved_version.assign(count, 0);
+        for (int i = 0 ; i < count ; i++)
+        {
+                if (world->chunks[i] == NULL)
+                        continue;
+                if (world->chunks[i]->version != before[i])
+                        saver->saved_version[i] = world->chunks[i]->version;
+                else
+                        unsaved = true;
+        }
+
+        std::vector<uint64_t> segments;
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+        {
+                unsigned long long first;
+                if (sscanf(entry.path().filename().c_str(), "log.%llx.wal", &first) == 1)
+                        segments.push_back(first);
+        }
+        std::sort(segments.begin(), segments.end());
+
+        int records = 0;
+        for (uint64_t first : segments)
+        {
+                segment_path(saver, first, path, sizeof(path));
+                int before = records;
+                uint64_t last = replay_segment(world, path, &records);
+                saver->next_sequence = std::max(saver->next_sequence, last + 1);
+                if (records == before)
+                        unlink(path);
+                else
+                        saver->closed_segments.push_back(first);
+        }
+        if (records)
+                printf("recovered %d edits from the save log\n", records);
+        saver->logged = records || unsaved;
+
+        // recovered edits are already in the log and unsaved chunks go out with the next checkpoint,
+        // only new edits get logged
+        saver->logged_version.assign(count, 0);
+        for (int i = 0 ; i < count ; i++)
+                if (world->chunks[i])
+                        saver->logged_version[i] = world->chunks[i]->version;
+
+        if (!open_segment(saver, saver->next_sequence))
+                return -1;
+        saver->running = true;
+        saver->thread = std::thread(save_thread, saver);
+        return 0;
+}
+
+
+void save_close(SaveWorker* saver)
+{
+        save_checkpoint(saver, true);
+        {
+                std::lock_guard<std::mutex> lock(saver->mutex);
+                saver->running = false;
+        }
+        saver->wake.notify_one();
+        if (saver->thread.joinable())
+                saver->thread.join();
+        if (saver->log_fd >= 0)
+                close(saver->log_fd);
+        saver->log_fd = -1;
+}
+
+
+int save_log_dirty(SaveWorker* saver, const World* world)
+{
+        std::vector<SaveJob*> jobs;
+        double now = now_seconds();
+        for (int i = 0 ; i < world_chunk_count(world) ; i++)
+        {
+                const Chunk* chunk = world->chunks[i];
+                if (chunk == NULL || !chunk->dirty || chunk->version == saver->logged_version[i])
+                        continue;
+                saver->logged_version[i] = chunk->version;
+
+                DirtyBox box = chunk->dirty_box;
+                glm::ivec3 size = box.max - box.min;
+                SaveJob* job = (SaveJob*) calloc(1, sizeof(SaveJob));
+                job->kind = SAVE_RECORD;
+                job->sequence = saver->next_sequence++;
+                job->chunk = i;
+                job->box = box;
+                job->queued = now;
+                job->texels = (uint8_t*) malloc((size_t)size.x*size.y*size.z);
+                uint8_t* out = job->texels;
+                for (int z = box.min.z ; z < box.max.z ; z++)
+                for (int y = box.min.y ; y < box.max.y ; y++)
+                {
+                        memcpy(out, &chunk->material[chunk_voxel_index(box.min.x,y,z)], size.x);
+                        out += size.x;
+                }
+                jobs.push_back(job);
+        }
+        if (jobs.empty())
+                return 0;
+
+        {
+                std::lock_guard<std::mutex> lock(saver->mutex);
+                saver->pending.insert(saver->pending.end(), jobs.begin(), jobs.end());
+        }
+        saver->wake.notify_one();
+        saver->logged = true;
+        return jobs.size();
+}
+
+
+void save_checkpoint(SaveWorker* saver, bool force)
+{
+        double now = now_seconds();
+        if (!saver->logged || (!force && now - saver->last_checkpoint < SAVE_CHECKPOINT_SECONDS))
+                return;
+
+        SaveJob* job = (SaveJob*) calloc(1, sizeof(SaveJob));
+        job->kind = SAVE_CHECKPOINT;
+        job->sequence = saver->next_sequence - 1;
+        job->queued = now;
+        {
+                std::lock_guard<std::mutex> lock(saver->mutex);
+                saver->pending.push_back(job);
+        }
+        saver->wake.notify_one();
+        saver->logged = false;
+        saver->last_checkpoint = now;
+}
+
+
+void save_metrics(SaveWorker* saver, SaveMetrics* metrics)
+{
+        std::lock_guard<std::mutex> lock(saver->mutex);
+        *metrics = saver->metrics;
+        metrics->queue_depth = saver->pending.size();
+        size_t written = metrics->log_bytes + metrics->region_bytes;
+        metrics->write_amplification = metrics->logical_bytes ? (double)written / metrics->logical_bytes : 0.0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chunk.h"
+#include "generator_cache.h"
+#include "snapshot.h"
+
+// chunks per side of a region file
+#define SAVE_REGION_CHUNKS 2
+#define SAVE_REGION_SLOTS (SAVE_REGION_CHUNKS*SAVE_REGION_CHUNKS*SAVE_REGION_CHUNKS)
+// how often the log is folded into the region files while edits keep coming in
+#define SAVE_CHECKPOINT_SECONDS 10.0
+
+#define SAVE_WAL_MAGIC 0x4c415752u
+#define SAVE_REGION_MAGIC 0x52444d52u
+#define SAVE_REGION_VERSION 1
+// uncompressed: the payloads are chunk images (see chunk_image.h) that can be read straight into a
+// staging buffer and uploaded. they start on the first page after the header
+#define SAVE_REGION_VERSION_IMAGES 2
+#define SAVE_REGION_IMAGE_OFFSET 4096
+
+// one log record, followed by size bytes of payload: the material of box after the edit, x fastest,
+// run length encoded (see rle.h). applying it is idempotent so replaying over newer regions is harmless
+typedef struct SaveRecordHeader
+{
+        uint32_t magic;
+        uint32_t size;
+        uint64_t sequence;
+        uint32_t chunk;
+        // max stored minus one to fit a byte
+        uint8_t min[3], max[3];
+        uint8_t padding[2];
+        // fnv-1a over the header with this field zeroed, then the payload. a torn write fails it
+        uint32_t checksum;
+}SaveRecordHeader;
+
+// a region file: this header, then the chunk payloads back to back in slot order (x fastest).
+// a payload is the chunk's material run length encoded, or its CHUNK_IMAGE_BYTES image in the
+// images version. size 0 means the chunk isn't in the world.
+// written to a temporary name and renamed over the old file once it is on disk
+typedef struct SaveRegionHeader
+{
+        uint32_t magic, version;
+        int32_t x, y, z;
+        // fnv-1a over the payloads
+        uint32_t checksum;
+        uint32_t sizes[SAVE_REGION_SLOTS];
+}SaveRegionHeader;
+
+// where the payloads of a region file start
+inline size_t save_region_payload_offset(uint32_t version)
+{
+        return version == SAVE_REGION_VERSION_IMAGES ? SAVE_REGION_IMAGE_OFFSET : sizeof(SaveRegionHeader);
+}
+
+// what checkpoints write, either kind of region file is loaded
+enum SaveFormat
+{
+        SAVE_FORMAT_COMPRESSED,
+        SAVE_FORMAT_IMAGES,
+};
+
+enum SaveJobKind
+{
+        SAVE_RECORD,
+        // everything logged before it is in the published snapshot, fold the log into the regions
+        SAVE_CHECKPOINT,
+};
+
+typedef struct SaveJob
+{
+        int kind;
+        uint64_t sequence;
+        int chunk;
+        DirtyBox box;
+        uint8_t* texels;
+        // steady clock seconds, for the latency until the record is durable
+        double queued;
+}SaveJob;
+
+typedef struct SaveMetrics
+{
+        int queue_depth;
+        uint64_t records, fsyncs, checkpoints;
+        // material bytes the edits changed, and what the log and the region files wrote for them
+        size_t logical_bytes, log_bytes, region_bytes;
+        // chunks checkpoints wrote, and left out because they are still what the generator makes
+        uint64_t chunks_written, chunks_generated;
+        double write_amplification;
+        // from queueing a record to its fsync returning, over the last group commit, and the worst seen
+        double latency_milliseconds, latency_max_milliseconds;
+        double checkpoint_milliseconds;
+}SaveMetrics;
+
+// write behind persistence: the world thread hands over after-images of the dirty boxes, the save
+// thread appends them to a write ahead log with one fsync per batch (group commit) and
+// checkpoints the log into region files from a snapshot, so the frame loop never waits on the disk
+typedef struct SaveWorker
+{
+        char directory[256];
+        int width, height, depth;
+        int format;
+        ChunkStore* store;
+        // when set the regions only hold chunks that differ from it, the rest is generated again on load
+        GeneratorCache* generator;
+
+        // world thread only. logged_version is the chunk version the log has seen, so only edits get logged
+        std::vector<unsigned int> logged_version;
+        uint64_t next_sequence;
+        bool logged;
+        double last_checkpoint;
+
+        // save thread only
+        int log_fd;
+        uint64_t log_first;
+        // segments older than the one being appended to, deleted by the next checkpoint
+        std::vector<uint64_t> closed_segments;
+        // snapshot reader slot, and the chunk versions the region files hold
+        int reader;
+        std::vector<unsigned int> saved_version;
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<SaveJob*> pending;
+        bool running;
+
+        // guarded by mutex
+        SaveMetrics metrics;
+}SaveWorker;
+
+// the seed a save in directory was made with, false when there is no save there yet
+bool save_read_seed(const char* directory, unsigned int* seed);
+
+// loads the region files of directory into world, replays the log over them (a torn tail from a crash
+// is dropped) and starts the save thread. the store is only read by checkpoints, so it may be
+// initialized afterwards. format is what regions are rewritten as, see SaveFormat. with a generator
+// for the world seed only edited chunks are stored, NULL stores every chunk
+int save_open(SaveWorker* saver, const char* directory, World* world, ChunkStore* store, int format, GeneratorCache* generator);
+// logs whatever is still queued, checkpoints and stops the thread
+void save_close(SaveWorker* saver);
+
+// world thread, before upload_dirty_chunks clears the dirty boxes: queues their after-images
+int save_log_dirty(SaveWorker* saver, const World* world);
+// world thread, right after chunk_store_publish: queues a checkpoint once SAVE_CHECKPOINT_SECONDS have passed
+void save_checkpoint(SaveWorker* saver, bool force);
+
+void save_metrics(SaveWorker* saver, SaveMetrics* metrics);
+
+// where the region holding chunks region*SAVE_REGION_CHUNKS.. is stored in directory
+void save_region_path(const char* directory, glm::ivec3 region, char* path, size_t size);
@@ -0,0 +1,247 @@
+#include "shader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include <fstream>
+#include <filesystem>
+
+
+int read_file(const char * path, char** out)
+{
+        std::ifstream file (path);
+        if (file.is_open())
+        {
+                long long file_size = std::filesystem::file_size(path);
+                
+                *out = (char*) malloc((file_size+1)*sizeof(char));
+                for (long long i = 0 ; i < file_size; i++)
+                {
+                        char c;
+                        file.get(c);
+                        *(*out+i) = c;
+                }
+                // terminating byte because final character isn't one?
+                *(*out+file_size) = '\0';
+                file.close();
+        }
+        else
+        {
+                printf("Unable to read file at: %s\n",path);
+                file.close();
+                return -1;
+        }
+        return 0;
+}
+
+int write_file(const char *)
+{
+        return 0;
+}
+
+void set_shader_value_int(const char * loc, int value, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;
+        else
+                glUniform1i(location, value);
+}
+
+
+void set_shader_value_float(const char * loc, float value, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;//printf("Unable to locate uniform %s in shader %d\n",loc,shader_program);
+        else
+                glUniform1f(location, value);
+}
+
+
+void set_shader_value_vec2(const char * loc, glm::vec2 value, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;//printf("Unable to locate uniform %s in shader %d\n",loc,shader_program);
+        else
+                glUniform2f(location, value.x, value.y);
+}
+
+
+void set_shader_value_ivec2(const char * loc, glm::ivec2 value, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;
+        else
+                glUniform2i(location, value.x, value.y);
+}
+
+
+void set_shader_value_vec3(const char * loc, glm::vec3 value, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;
+        else
+                glUniform3f(location, value.x, value.y, value.z);
+}
+
+
+void set_shader_value_ivec3(const char * loc, glm::ivec3 value, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;
+        else
+                glUniform3i(location, value.x, value.y, value.z);
+}
+
+
+void set_shader_value_vec4_array(const char * loc, const glm::vec4* value, int size, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;
+        else
+                glUniform4fv(location, size, glm::value_ptr(value[0]));
+}
+
+
+void set_shader_value_float_array(const char * loc, float* value, int size, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;//printf("Unable to locate uniform %s in shader %d\n",loc,shader_program);
+        else
+                glUniform1fv(location,size,value);
+}
+
+
+void set_shader_value_matrix4(const char * loc, glm::mat4 value, unsigned int shader_program)
+{
+        int location = glGetUniformLocation(shader_program, loc);
+        if (location == -1)
+                return;//printf("Unable to locate uniform %s in shader %d\n",loc,shader_program);
+        else
+                glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+
+unsigned int load_shader(const char* vertex_shaderPath, const char* fragment_shaderPath)
+{
+        // VERTEX
+        char * vertex_source;
+        int vertex_file = read_file(vertex_shaderPath, &vertex_source);
+        if (vertex_file != 0)
+        {
+                printf("unable to compile shader. vertex shader couldn't be found.\n");
+                return -1;
+        }
+	
+	    unsigned int vertex_shader;
+	    vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+	    glShaderSource(vertex_shader, 1, (const char* const *)&vertex_source, NULL);
+	    glCompileShader(vertex_shader);
+
+	    int vertex_success;
+	    char vertex_info_log[512];
+	    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &vertex_success);
+	    if(!vertex_success)
+	    {
+	    	glGetShaderInfoLog(vertex_shader, 512, NULL, vertex_info_log);
+	    	printf("ERROR::SHADER::VERTEX::COMPILATION_FAILED: %s\n",vertex_info_log);
+	    }
+	    free(vertex_source);
+
+        // FRAGMENT
+
+        char * fragment_source;
+        int fragment_file = read_file(fragment_shaderPath, &fragment_source);
+        if (fragment_file != 0)
+        {
+                printf("unable to compile shader. fragment shader couldn't be found.\n");
+                return -1;
+        }
+
+	    unsigned int fragment_shader;
+	    fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	    glShaderSource(fragment_shader, 1, (const char* const *)&fragment_source, NULL);
+	    glCompileShader(fragment_shader);
+	    
+	    int fragment_success;
+	    char fragment_info_log[512];
+	    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &fragment_success);
+	    if(!fragment_success)
+	    {
+	    	glGetShaderInfoLog(fragment_shader, 512, NULL, fragment_info_log);
+	    	printf("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED: %s\n",fragment_info_log);
+	    }
+	    free(fragment_source);
+
+	    //SHADER PROGRAM
+	    unsigned int shader = glCreateProgram();
+	    glAttachShader(shader, vertex_shader);
+	    glAttachShader(shader, fragment_shader);
+	    glLinkProgram(shader);
+
+	    int shader_success;
+	    char shader_info_log[512];
+	    glGetProgramiv(shader, GL_LINK_STATUS, &shader_success);
+	    if(!shader_success)
+	    {
+	    	glGetProgramInfoLog(shader, 512, NULL, shader_info_log);
+	    	printf("ERROR::SHADER::PROGRAM::COMPILATION_FAILED: %s\n",shader_info_log);
+	    }
+	    
+	    glDeleteShader(vertex_shader);
+	    glDeleteShader(fragment_shader);
+
+	    return shader;
+}
+
+
+unsigned int load_compute_shader(const char* compute_shaderPath)
+{
+        char * compute_source;
+        int compute_file = read_file(compute_shaderPath, &compute_source);
+        if (compute_file != 0)
+        {
+                printf("unable to compile shader. compute shader couldn't be found.\n");
+                return -1;
+        }
+
+        unsigned int compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute_shader, 1, (const char* const *)&compute_source, NULL);
+        glCompileShader(compute_shader);
+
+        int compute_success;
+        char compute_info_log[512];
+        glGetShaderiv(compute_shader, GL_COMPILE_STATUS, &compute_success);
+        if(!compute_success)
+        {
+                glGetShaderInfoLog(compute_shader, 512, NULL, compute_info_log);
+                printf("ERROR::SHADER::COMPUTE::COMPILATION_FAILED: %s: %s\n",compute_shaderPath,compute_info_log);
+        }
+        free(compute_source);
+
+        unsigned int shader = glCreateProgram();
+        glAttachShader(shader, compute_shader);
+        glLinkProgram(shader);
+
+        int shader_success;
+        char shader_info_log[512];
+        glGetProgramiv(shader, GL_LINK_STATUS, &shader_success);
+        if(!shader_success)
+        {
+                glGetProgramInfoLog(shader, 512, NULL, shader_info_log);
+                printf("ERROR::SHADER::PROGRAM::COMPILATION_FAILED: %s\n",shader_info_log);
+        }
+
+        glDeleteShader(compute_shader);
+
+        return shader;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+// free out!
+int read_file(const char * path, char** out);
+int write_file(const char *);
+
+void set_shader_value_int(const char * loc, int value, unsigned int shader_program);
+void set_shader_value_float(const char * loc, float value, unsigned int shader_program);
+void set_shader_value_vec2(const char * loc, glm::vec2 value, unsigned int shader_program);
+void set_shader_value_ivec2(const char * loc, glm::ivec2 value, unsigned int shader_program);
+void set_shader_value_vec3(const char * loc, glm::vec3 value, unsigned int shader_program);
+void set_shader_value_ivec3(const char * loc, glm::ivec3 value, unsigned int shader_program);
+void set_shader_value_vec4_array(const char * loc, const glm::vec4* value, int size, unsigned int shader_program);
+void set_shader_value_float_array(const char * loc, float* value, int size, unsigned int shader_program);
+void set_shader_value_matrix4(const char * loc, glm::mat4 value, unsigned int shader_program);
+
+// returns -1 if either source file is missing
+unsigned int load_shader(const char* vertex_shaderPath, const char* fragment_shaderPath);
+unsigned int load_compute_shader(const char* compute_shaderPath);
@@ -0,0 +1,159 @@
+#include "simulation.h"
+
+#include <math.h>
+#include <chrono>
+
+
+glm::vec3 simulation_direction(float yaw, float pitch)
+{
+        return glm::vec3(cos(glm::radians(yaw)) * cos(glm::radians(pitch)),
+                         sin(glm::radians(pitch)),
+                         sin(glm::radians(yaw)) * cos(glm::radians(pitch)));
+}
+
+
+// one fixed step, same movement rules the render loop used to apply per frame
+static void simulation_tick(SimulationState* state, SimulationInput* input, float step)
+{
+        state->yaw += input->yaw_delta;
+        state->pitch += input->pitch_delta;
+        input->yaw_delta = 0.0f;
+        input->pitch_delta = 0.0f;
+
+        if (state->pitch > 89.0f)
+                state->pitch = 89.0f;
+        if (state->pitch < -89.0f)
+                state->pitch = -89.0f;
+
+        glm::vec3 front = simulation_direction(state->yaw, state->pitch);
+        glm::vec3 right = glm::normalize(glm::cross(glm::vec3(0.0f,1.0f,0.0f), front));
+        glm::vec3 up = glm::cross(front, right);
+        glm::vec3 side = glm::normalize(glm::cross(front, up));
+
+        float distance = (input->fast ? 2.0f : 1.0f) * step;
+        if (input->forward)
+                state->position += front * distance;
+        if (input->back)
+                state->position -= front * distance;
+        if (input->left)
+                state->position -= side * distance;
+        if (input->right)
+                state->position += side * distance;
+        if (input->down)
+                state->position -= up * distance;
+        if (input->up)
+                state->position += up * distance;
+}
+
+
+static void simulation_thread(Simulation* simulation)
+{
+        double next = glfwGetTime() + simulation->step;
+        while (simulation->running)
+        {
+                double now = glfwGetTime();
+                int ticks = 0;
+                while (now >= next && ticks < SIMULATION_MAX_CATCH_UP)
+                {
+                        {
+                                std::lock_guard<std::mutex> lock(simulation->mutex);
+                                simulation->previous = simulation->current;
+                                simulation_tick(&simulation->current, &simulation->input, simulation->step);
+                                simulation->current.time = next;
+                        }
+                        // the camera is free for the renderer again while the world is edited
+                        if (simulation->world_tick)
+                                simulation->world_tick(simulation->world_user);
+                        next += simulation->step;
+                        ticks++;
+                }
+                simulation->ticks += ticks;
+
+                // too far behind to catch up, skip the lost time rather than spiral
+                if (now >= next)
+                {
+                        simulation->dropped += (int)((now - next) / simulation->step) + 1;
+                        next = now + simulation->step;
+                }
+
+                std::this_thread::sleep_for(std::chrono::duration<double>(next - glfwGetTime()));
+        }
+}
+
+
+int simulation_init(Simulation* simulation, const Camera* camera, void (*world_tick)(void* user), void* world_user)
+{
+        simulation->step = 1.0 / SIMULATION_HZ;
+        simulation->input = {};
+        simulation->world_tick = world_tick;
+        simulation->world_user = world_user;
+
+        SimulationState state;
+        state.position = camera->position;
+        state.yaw = camera->yaw;
+        state.pitch = camera->pitch;
+        state.time = glfwGetTime();
+        simulation->previous = state;
+        simulation->current = state;
+
+        simulation->ticks = 0;
+        simulation->dropped = 0;
+        simulation->running = true;
+        simulation->thread = std::thread(simulation_thread, simulation);
+        return 0;
+}
+
+
+void simulation_destroy(Simulation* simulation)
+{
+        simulation->running = false;
+        if (simulation->thread.joinable())
+                simulation->thread.join();
+}
+
+
+void simulation_sample_input(Simulation* simulation, GLFWwindow* window)
+{
+        std::lock_guard<std::mutex> lock(simulation->mutex);
+        SimulationInput* input = &simulation->input;
+        input->forward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+        input->back = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+        input->left = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+        input->right = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+        input->down = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
+        input->up = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+        input->fast = glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS;
+}
+
+
+void simulation_look(Simulation* simulation, float yaw_delta, float pitch_delta)
+{
+        std::lock_guard<std::mutex> lock(simulation->mutex);
+        simulation->input.yaw_delta += yaw_delta;
+        simulation->input.pitch_delta += pitch_delta;
+}
+
+
+void simulation_interpolate(Simulation* simulation, double time, Camera* camera)
+{
+        SimulationState previous, current;
+        SimulationInput input;
+        {
+                std::lock_guard<std::mutex> lock(simulation->mutex);
+                previous = simulation->previous;
+                current = simulation->current;
+                input = simulation->input;
+        }
+
+        // drawing one step behind means there is always a tick on either side of the frame
+        float alpha = 1.0f;
+        if (current.time > previous.time)
+                alpha = glm::clamp((float)((time - simulation->step - previous.time) / (current.time - previous.time)), 0.0f, 1.0f);
+        camera->position = glm::mix(previous.position, current.position, alpha);
+
+        // orientation is late latched instead: the latest tick plus the mouse motion no tick has consumed yet,
+        // so looking around never waits for the simulation
+        camera->yaw = current.yaw + input.yaw_delta;
+        camera->pitch = glm::clamp(current.pitch + input.pitch_delta, -89.0f, 89.0f);
+        camera->direction = simulation_direction(camera->yaw, camera->pitch);
+}
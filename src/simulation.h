@@ -0,0 +1,70 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "camera.h"
+
+// ticks per second of the simulation thread, independent of the frame rate
+#define SIMULATION_HZ 120
+// after a stall the simulation drops time instead of running more than this many catch up ticks
+#define SIMULATION_MAX_CATCH_UP 8
+
+// what the player is asking for, sampled by the main thread (glfw input is main thread only)
+// and consumed by the next tick
+typedef struct SimulationInput
+{
+        bool forward, back, left, right, down, up, fast;
+        // mouse motion accumulated since the last tick, in degrees
+        float yaw_delta, pitch_delta;
+}SimulationInput;
+
+typedef struct SimulationState
+{
+        glm::vec3 position;
+        float yaw, pitch;
+        // glfwGetTime() this state belongs to
+        double time;
+}SimulationState;
+
+typedef struct Simulation
+{
+        double step;
+
+        std::thread thread;
+        std::mutex mutex;
+        std::atomic<bool> running;
+
+        // everything below is guarded by mutex
+        SimulationInput input;
+        // the two latest ticks, the renderer draws in between them
+        SimulationState previous, current;
+
+        // ticks run and ticks dropped since the last metrics read
+        std::atomic<int> ticks, dropped;
+
+        // run on the tick thread after every tick, outside mutex: world edits land here at the tick
+        // rate whatever the frame rate. NULL for none
+        void (*world_tick)(void* user);
+        void* world_user;
+}Simulation;
+
+// starts the tick thread from the camera's position and orientation, world_tick may be NULL
+int simulation_init(Simulation* simulation, const Camera* camera, void (*world_tick)(void* user), void* world_user);
+void simulation_destroy(Simulation* simulation);
+
+// main thread: held keys for the next tick
+void simulation_sample_input(Simulation* simulation, GLFWwindow* window);
+// main thread: mouse look, summed until a tick consumes it
+void simulation_look(Simulation* simulation, float yaw_delta, float pitch_delta);
+
+// writes the position at time - step into the camera, blended between the two latest ticks so motion
+// stays smooth at any frame rate. yaw, pitch and direction include mouse motion not yet ticked
+void simulation_interpolate(Simulation* simulation, double time, Camera* camera);
+
+// front vector for a yaw and pitch in degrees
+glm::vec3 simulation_direction(float yaw, float pitch);
@@ -0,0 +1,67 @@
+#include "slot_pool.h"
+
+#include <algorithm>
+
+
+void slot_pool_init(SlotPool* pool, int capacity)
+{
+        pool->capacity = capacity;
+        pool->used = 0;
+        pool->free.clear();
+        if (capacity > 0)
+                pool->free.push_back({0, capacity});
+}
+
+
+int slot_pool_alloc(SlotPool* pool, int count)
+{
+        for (size_t i = 0 ; i < pool->free.size() ; i++)
+        {
+                SlotRun& run = pool->free[i];
+                if (run.count < count)
+                        continue;
+                int first = run.first;
+                run.first += count;
+                run.count -= count;
+                if (run.count == 0)
+                        pool->free.erase(pool->free.begin() + i);
+                pool->used += count;
+                return first;
+        }
+        return -1;
+}
+
+
+void slot_pool_free(SlotPool* pool, int first, int count)
+{
+        if (count <= 0)
+                return;
+        auto next = std::lower_bound(pool->free.begin(), pool->free.end(), first,
+                                     [](const SlotRun& run, int first) { return run.first < first; });
+        auto run = pool->free.insert(next, {first, count});
+        // merge with the following run, then with the previous one
+        if (run + 1 != pool->free.end() && run->first + run->count == (run + 1)->first)
+        {
+                run->count += (run + 1)->count;
+                pool->free.erase(run + 1);
+        }
+        if (run != pool->free.begin() && (run - 1)->first + (run - 1)->count == run->first)
+        {
+                (run - 1)->count += run->count;
+                pool->free.erase(run);
+        }
+        pool->used -= count;
+}
+
+
+void slot_pool_grow(SlotPool* pool, int capacity)
+{
+        if (capacity <= pool->capacity)
+                return;
+        // merged with a free run that already reaches the old end
+        if (!pool->free.empty() && pool->free.back().first + pool->free.back().count == pool->capacity)
+                pool->free.back().count += capacity - pool->capacity;
+        else
+                pool->free.push_back({pool->capacity, capacity - pool->capacity});
+        pool->capacity = capacity;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+typedef struct SlotRun
+{
+        int first, count;
+}SlotRun;
+
+// hands out runs of consecutive fixed size slots of a buffer or texture that is allocated once, so what
+// comes and goes recycles the same gpu memory instead of reallocating it. first fit over the free runs.
+// spill files use it too, as pages of a file that grows (slot_pool_grow) when no free run is long enough
+typedef struct SlotPool
+{
+        int capacity, used;
+        // ordered by first, neighbours are merged as runs are freed
+        std::vector<SlotRun> free;
+}SlotPool;
+
+void slot_pool_init(SlotPool* pool, int capacity);
+// the first of count consecutive slots, -1 when no free run is that long
+int slot_pool_alloc(SlotPool* pool, int count);
+void slot_pool_free(SlotPool* pool, int first, int count);
+// adds the slots up to capacity as free, nothing when it isn't more than the pool has
+void slot_pool_grow(SlotPool* pool, int capacity);
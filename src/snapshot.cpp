@@ -0,0 +1,164 @@
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+
+static WorldSnapshot* snapshot_create(const World* world, unsigned long epoch)
+{
+        WorldSnapshot* snapshot = (WorldSnapshot*) calloc(1, sizeof(WorldSnapshot));
+        if (snapshot == NULL)
+                return NULL;
+        snapshot->world = *world;
+        snapshot->world.store = NULL;
+        snapshot->epoch = epoch;
+
+        int count = world_chunk_count(world);
+        snapshot->world.chunks = (Chunk**) malloc(count*sizeof(Chunk*));
+        // the tags as of this publish, the world thread goes on changing its own
+        snapshot->world.tags = world->tags ? (uint8_t*) malloc(count) : NULL;
+        if (snapshot->world.chunks == NULL || (world->tags && snapshot->world.tags == NULL))
+        {
+                free(snapshot->world.chunks);
+                free(snapshot->world.tags);
+                free(snapshot);
+                return NULL;
+        }
+        memcpy(snapshot->world.chunks, world->chunks, count*sizeof(Chunk*));
+        if (world->tags)
+                memcpy(snapshot->world.tags, world->tags, count);
+        return snapshot;
+}
+
+
+static void snapshot_destroy(WorldSnapshot* snapshot)
+{
+        free(snapshot->world.chunks);
+        free(snapshot->world.tags);
+        free(snapshot);
+}
+
+
+int chunk_store_init(ChunkStore* store, World* world)
+{
+        store->current = NULL;
+        store->epoch = 0;
+        for (int i = 0 ; i < SNAPSHOT_MAX_READERS ; i++)
+                store->readers[i] = SNAPSHOT_IDLE;
+        store->reader_count = 0;
+        store->chunks_copied = 0;
+        store->reclaimed = 0;
+
+        world->store = store;
+        if (chunk_store_publish(store, world) == 0)
+        {
+                printf("unable to allocate the first world snapshot\n");
+                world->store = NULL;
+                return -1;
+        }
+        return 0;
+}
+
+
+void chunk_store_destroy(ChunkStore* store, World* world)
+{
+        for (Retired& retired : store->retired)
+        {
+                if (retired.chunk)
+                        chunk_destroy(retired.chunk);
+                if (retired.snapshot)
+                        snapshot_destroy(retired.snapshot);
+        }
+        store->retired.clear();
+        for (Chunk* chunk : store->pending)
+                chunk_destroy(chunk);
+        store->pending.clear();
+
+        WorldSnapshot* current = store->current.exchange(NULL);
+        if (current)
+                snapshot_destroy(current);
+
+        // the world owns its chunks again and edits them in place
+        for (int i = 0 ; i < world_chunk_count(world) ; i++)
+                if (world->chunks[i])
+                        world->chunks[i]->shared = false;
+        world->store = NULL;
+}
+
+
+unsigned long chunk_store_publish(ChunkStore* store, World* world)
+{
+        unsigned long epoch = store->epoch.load() + 1;
+        WorldSnapshot* snapshot = snapshot_create(world, epoch);
+        if (snapshot == NULL)
+                return 0;
+        for (int i = 0 ; i < world_chunk_count(world) ; i++)
+                if (world->chunks[i])
+                        world->chunks[i]->shared = true;
+
+        // a reader that announces the new epoch started after this store, so it can only load the new
+        // snapshot. anything announced before may still hold the old one or the chunks it replaced
+        WorldSnapshot* previous = store->current.exchange(snapshot);
+        store->epoch.store(epoch);
+
+        if (previous)
+                store->retired.push_back({NULL, previous, epoch});
+        for (Chunk* chunk : store->pending)
+                store->retired.push_back({chunk, NULL, epoch});
+        store->pending.clear();
+
+        unsigned long oldest = SNAPSHOT_IDLE;
+        int readers = std::min(store->reader_count.load(), SNAPSHOT_MAX_READERS);
+        for (int i = 0 ; i < readers ; i++)
+                oldest = std::min(oldest, store->readers[i].load());
+
+        // retired is in epoch order, everything before the first one a reader might hold can go
+        size_t freed = 0;
+        while (freed < store->retired.size() && store->retired[freed].epoch <= oldest)
+        {
+                Retired& retired = store->retired[freed++];
+                if (retired.chunk)
+                        chunk_destroy(retired.chunk);
+                if (retired.snapshot)
+                        snapshot_destroy(retired.snapshot);
+        }
+        store->retired.erase(store->retired.begin(), store->retired.begin() + freed);
+        store->reclaimed = (int)freed;
+        store->chunks_copied = 0;
+        return epoch;
+}
+
+
+void chunk_store_retire(ChunkStore* store, Chunk* chunk)
+{
+        store->pending.push_back(chunk);
+        store->chunks_copied++;
+}
+
+
+int snapshot_reader_register(ChunkStore* store)
+{
+        int reader = store->reader_count.fetch_add(1);
+        if (reader >= SNAPSHOT_MAX_READERS)
+        {
+                printf("more than %d snapshot readers\n", SNAPSHOT_MAX_READERS);
+                return -1;
+        }
+        return reader;
+}
+
+
+const WorldSnapshot* snapshot_acquire(ChunkStore* store, int reader)
+{
+        // announce first, then load: the world thread either sees the announcement or we see its newer snapshot
+        store->readers[reader].store(store->epoch.load());
+        return store->current.load();
+}
+
+
+void snapshot_release(ChunkStore* store, int reader)
+{
+        store->readers[reader].store(SNAPSHOT_IDLE);
+}
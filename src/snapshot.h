@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "chunk.h"
+
+// threads that can hold a snapshot at the same time (mesher, saver, ...), each takes a slot once
+#define SNAPSHOT_MAX_READERS 8
+// announced by a reader slot that holds nothing
+#define SNAPSHOT_IDLE (~0ul)
+
+// a frozen view of the world, readers use snapshot->world with the usual world_get/raycast functions.
+// its voxels and mips are never written again: the world thread copies a published chunk before
+// editing it, and builds the mips of edited chunks before it publishes them. only the world thread's
+// bookkeeping (dirty, shared) still changes in place. tags is a copy taken at publish
+typedef struct WorldSnapshot
+{
+        World world;
+        unsigned long epoch;
+}WorldSnapshot;
+
+// a chunk or snapshot no longer published, freed once no reader can still be looking at it
+typedef struct Retired
+{
+        Chunk* chunk;
+        WorldSnapshot* snapshot;
+        unsigned long epoch;
+}Retired;
+
+// copy on write chunk storage with epoch based reclamation (rcu style). readers never lock:
+// they announce the epoch they started in and load the current snapshot. the world thread edits
+// private copies and publishes a new snapshot once per tick
+typedef struct ChunkStore
+{
+        std::atomic<WorldSnapshot*> current;
+        std::atomic<unsigned long> epoch;
+        std::atomic<unsigned long> readers[SNAPSHOT_MAX_READERS];
+        std::atomic<int> reader_count;
+
+        // world thread only. pending are chunks replaced since the last publish, the current snapshot still has them
+        std::vector<Chunk*> pending;
+        std::vector<Retired> retired;
+        // since the last publish, and what the last publish freed
+        int chunks_copied, reclaimed;
+}ChunkStore;
+
+// attaches the store to the world and publishes its chunks as the first snapshot
+int chunk_store_init(ChunkStore* store, World* world);
+// frees every snapshot and retired chunk and detaches from the world, no reader may be active
+void chunk_store_destroy(ChunkStore* store, World* world);
+
+// world thread: makes the world's current chunks the snapshot readers get from now on and frees
+// whatever the readers have moved past. returns the new epoch
+unsigned long chunk_store_publish(ChunkStore* store, World* world);
+// world thread: chunk was replaced by a copy, see world_chunk_write
+void chunk_store_retire(ChunkStore* store, Chunk* chunk);
+
+// any thread, once: a slot index for the calls below, -1 when every slot is taken
+int snapshot_reader_register(ChunkStore* store);
+// the snapshot stays valid until snapshot_release, holding it only delays freeing memory, never the world thread
+const WorldSnapshot* snapshot_acquire(ChunkStore* store, int reader);
+void snapshot_release(ChunkStore* store, int reader);
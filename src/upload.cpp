@@ -0,0 +1,490 @@
+#include "upload.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static void upload_job(UploadWorker* worker, UploadJob* job)
+{
+        size_t texel_bytes = (size_t)job->size.x*job->size.y*job->size.z;
+        size_t slab_bytes = job->slabs || job->staged ? UPLOAD_SLAB_BYTES : 0;
+        size_t mip_bytes = job->mips || job->staged ? CHUNK_MIP_BYTES : 0;
+        // offsets into the bound unpack buffer
+        size_t texel_offset = 0, slab_offset = 0, mip_offset = 0;
+        unsigned int buffer = 0;
+        int slot = -1;
+
+        if (job->staged)
+        {
+                // already laid out in the persistent buffer, the texture calls read it in place
+                size_t base = (size_t)job->stage_slot*CHUNK_IMAGE_BYTES;
+                buffer = worker->stage_buffer;
+                texel_offset = base + CHUNK_IMAGE_TEXELS;
+                slab_offset = base + CHUNK_IMAGE_SLABS;
+                mip_offset = base + CHUNK_IMAGE_MIPS;
+        }
+        else if (texel_bytes + slab_bytes + mip_bytes > 0)
+        {
+                slot = worker->next_pbo;
+                worker->next_pbo = (worker->next_pbo+1) % UPLOAD_PBO_COUNT;
+
+                // the staging buffer may still be read by an earlier glTexSubImage3D
+                if (worker->pbo_fence[slot])
+                {
+                        glClientWaitSync(worker->pbo_fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                        glDeleteSync(worker->pbo_fence[slot]);
+                        worker->pbo_fence[slot] = 0;
+                }
+
+                // slab words have to start on a word boundary inside the staging buffer
+                slab_offset = (texel_bytes + 15) & ~(size_t)15;
+                mip_offset = slab_offset + slab_bytes;
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, worker->pbo[slot]);
+                void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, mip_offset + mip_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                if (staging)
+                {
+                        memcpy(staging, job->texels, texel_bytes);
+                        if (slab_bytes)
+                                memcpy((char*)staging + slab_offset, job->slabs, slab_bytes);
+                        if (mip_bytes)
+                                memcpy((char*)staging + mip_offset, job->mips, mip_bytes);
+                        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                        buffer = worker->pbo[slot];
+                }
+                else
+                        printf("unable to map upload staging buffer %d\n", slot);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        if (buffer)
+        {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                if (texel_bytes > 0)
+                {
+                        glBindTexture(GL_TEXTURE_3D, worker->targets.texture);
+                        glTexSubImage3D(GL_TEXTURE_3D, 0,
+                                        job->offset.x, job->offset.y, job->offset.z,
+                                        job->size.x, job->size.y, job->size.z,
+                                        GL_RED_INTEGER, GL_UNSIGNED_BYTE, (void*)texel_offset);
+                        glBindTexture(GL_TEXTURE_3D, 0);
+                }
+
+                if (mip_bytes)
+                {
+                        glBindTexture(GL_TEXTURE_3D, worker->targets.texture);
+                        for (int level = 1 ; level < CHUNK_MIP_LEVELS ; level++)
+                        {
+                                int size = chunk_mip_size(level);
+                                glm::ivec3 offset = job->coord * size;
+                                glTexSubImage3D(GL_TEXTURE_3D, level, offset.x, offset.y, offset.z, size, size, size,
+                                                GL_RED_INTEGER, GL_UNSIGNED_BYTE, (void*)(mip_offset + chunk_mip_offset(level)));
+                        }
+                        glBindTexture(GL_TEXTURE_3D, 0);
+                }
+
+                for (int axis = 0 ; slab_bytes && axis < 3 ; axis++)
+                {
+                        glBindTexture(GL_TEXTURE_2D, worker->targets.slab_textures[axis]);
+                        for (int word = 0 ; word < BITSLAB_WORDS_PER_CHUNK ; word++)
+                        {
+                                glm::ivec2 offset = bitslab_chunk_offset(worker->targets.world_size, job->coord, axis, word);
+                                size_t source = slab_offset + ((size_t)axis*BITSLAB_CHUNK_TEXELS + (size_t)word*CHUNK_SIZE*CHUNK_SIZE)*sizeof(uint32_t);
+                                glTexSubImage2D(GL_TEXTURE_2D, 0, offset.x, offset.y, CHUNK_SIZE, CHUNK_SIZE,
+                                                GL_RED_INTEGER, GL_UNSIGNED_INT, (void*)source);
+                        }
+                }
+                glBindTexture(GL_TEXTURE_2D, 0);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        if (job->occupancy_size > 0 && job->staged)
+        {
+                // buffer to buffer, the columns never come back to the cpu
+                glBindBuffer(GL_COPY_READ_BUFFER, worker->stage_buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, worker->targets.occupancy_buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                    (size_t)job->stage_slot*CHUNK_IMAGE_BYTES + CHUNK_IMAGE_OCCUPANCY, job->occupancy_offset, job->occupancy_size);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        else if (job->occupancy_size > 0)
+        {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, worker->targets.occupancy_buffer);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, job->occupancy_offset, job->occupancy_size, job->occupancy);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+
+        if (slot >= 0)
+                worker->pbo_fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // also what hands a stage slot back, see upload_worker_collect
+        job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // fences are only visible to other contexts once they reach the gpu
+        glFlush();
+
+        worker->bytes_uploaded += texel_bytes + slab_bytes + mip_bytes + job->occupancy_size;
+
+        free(job->texels);
+        free(job->occupancy);
+        free(job->slabs);
+        free(job->mips);
+        job->texels = NULL;
+        job->occupancy = NULL;
+        job->slabs = NULL;
+        job->mips = NULL;
+}
+
+
+static void upload_thread(UploadWorker* worker)
+{
+        glfwMakeContextCurrent(worker->context);
+
+        glGenBuffers(UPLOAD_PBO_COUNT, worker->pbo);
+        for (int i = 0 ; i < UPLOAD_PBO_COUNT ; i++)
+        {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, worker->pbo[i]);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, UPLOAD_PBO_SIZE, NULL, GL_STREAM_DRAW);
+                worker->pbo_fence[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        while (true)
+        {
+                UploadJob* job;
+                {
+                        std::unique_lock<std::mutex> lock(worker->mutex);
+                        worker->wake.wait(lock, [worker]{ return !worker->running || !worker->pending.empty(); });
+                        if (!worker->running)
+                                break;
+                        job = worker->pending.front();
+                        worker->pending.pop_front();
+                }
+
+                upload_job(worker, job);
+
+                {
+                        std::lock_guard<std::mutex> lock(worker->mutex);
+                        worker->in_flight.push_back(job);
+                }
+                worker->queue_depth--;
+        }
+
+        for (int i = 0 ; i < UPLOAD_PBO_COUNT ; i++)
+                if (worker->pbo_fence[i])
+                        glDeleteSync(worker->pbo_fence[i]);
+        glDeleteBuffers(UPLOAD_PBO_COUNT, worker->pbo);
+        glFinish();
+
+        glfwMakeContextCurrent(NULL);
+}
+
+
+int upload_worker_init(UploadWorker* worker, GLFWwindow* share, UploadTargets targets)
+{
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        worker->context = glfwCreateWindow(1, 1, "upload", NULL, share);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (!worker->context)
+        {
+                printf("unable to create shared upload context.\n");
+                return -1;
+        }
+
+        // created here, with the render context current, so the pointer is there before anyone asks for a slot
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        size_t stage_size = (size_t)UPLOAD_STAGE_SLOTS*CHUNK_IMAGE_BYTES;
+        glGenBuffers(1, &worker->stage_buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, worker->stage_buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, stage_size, NULL, flags);
+        worker->stage = (uint8_t*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, stage_size, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        worker->stage_free.clear();
+        if (worker->stage)
+                for (int i = UPLOAD_STAGE_SLOTS-1 ; i >= 0 ; i--)
+                        worker->stage_free.push_back(i);
+        else
+                printf("no persistent staging buffer, chunk images take the regular upload path\n");
+
+        worker->render_context = glfwGetCurrentContext();
+        worker->targets = targets;
+        worker->next_pbo = 0;
+        worker->running = true;
+        worker->queue_depth = 0;
+        worker->bytes_uploaded = 0;
+        worker->completed = 0;
+        glm::ivec3 chunks = targets.world_size / CHUNK_SIZE;
+        worker->resident_version.assign(chunks.x*chunks.y*chunks.z, 0);
+        worker->thread = std::thread(upload_thread, worker);
+        return 0;
+}
+
+
+void upload_worker_destroy(UploadWorker* worker)
+{
+        {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                worker->running = false;
+        }
+        worker->wake.notify_one();
+        if (worker->thread.joinable())
+                worker->thread.join();
+
+        for (UploadJob* job : worker->pending)
+        {
+                free(job->texels);
+                free(job->occupancy);
+                free(job->slabs);
+                free(job->mips);
+                free(job);
+        }
+        worker->pending.clear();
+
+        for (UploadJob* job : worker->in_flight)
+        {
+                glDeleteSync(job->fence);
+                free(job);
+        }
+        worker->in_flight.clear();
+
+        if (worker->stage)
+        {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, worker->stage_buffer);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &worker->stage_buffer);
+        worker->stage = NULL;
+        worker->stage_free.clear();
+
+        glfwDestroyWindow(worker->context);
+        worker->context = NULL;
+}
+
+
+void upload_worker_submit(UploadWorker* worker, UploadJob* job)
+{
+        {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                worker->pending.push_back(job);
+        }
+        worker->queue_depth++;
+        worker->wake.notify_one();
+}
+
+
+uint8_t* upload_stage_acquire(UploadWorker* worker, int* slot)
+{
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (worker->stage_free.empty())
+                return NULL;
+        *slot = worker->stage_free.back();
+        worker->stage_free.pop_back();
+        return worker->stage + (size_t)*slot*CHUNK_IMAGE_BYTES;
+}
+
+
+void upload_stage_release(UploadWorker* worker, int slot)
+{
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->stage_free.push_back(slot);
+}
+
+
+void upload_stage_submit(UploadWorker* worker, int slot, int chunk, glm::ivec3 coord, unsigned int version)
+{
+        UploadJob* job = (UploadJob*) calloc(1, sizeof(UploadJob));
+        job->chunk = chunk;
+        job->version = version;
+        job->offset = coord*CHUNK_SIZE;
+        job->size = glm::ivec3(CHUNK_SIZE);
+        job->coord = coord;
+        job->occupancy_offset = (size_t)chunk*CHUNK_COLUMNS*sizeof(uint64_t);
+        job->occupancy_size = CHUNK_COLUMNS*sizeof(uint64_t);
+        job->staged = true;
+        job->stage_slot = slot;
+        upload_worker_submit(worker, job);
+}
+
+
+int upload_region_images(UploadWorker* worker, RegionReader* reader, World* world, const std::vector<int>& chunks)
+{
+        if (glfwGetCurrentContext() != worker->render_context)
+        {
+                printf("chunk images can only be uploaded from the render thread\n");
+                return 0;
+        }
+
+        int uploaded = 0;
+        size_t first = 0;
+        while (first < chunks.size() && worker->stage)
+        {
+                RegionRead reads[UPLOAD_STAGE_SLOTS];
+                int slots[UPLOAD_STAGE_SLOTS];
+                int count = 0;
+                while (count < UPLOAD_STAGE_SLOTS && first + count < chunks.size())
+                {
+                        uint8_t* image = upload_stage_acquire(worker, &slots[count]);
+                        if (image == NULL)
+                                break;
+                        reads[count] = {};
+                        reads[count].chunk = world->chunks[chunks[first + count]]->coord;
+                        reads[count].image = image;
+                        count++;
+                }
+                if (count == 0)
+                {
+                        // every slot is still on its way to the gpu
+                        upload_worker_collect(worker);
+                        std::this_thread::yield();
+                        continue;
+                }
+
+                region_reader_read(reader, reads, count);
+                for (int i = 0 ; i < count ; i++)
+                {
+                        int index = chunks[first + i];
+                        Chunk* chunk = world->chunks[index];
+                        if (!reads[i].image_ready || !chunk->dirty)
+                        {
+                                upload_stage_release(worker, slots[i]);
+                                continue;
+                        }
+                        upload_stage_submit(worker, slots[i], index, chunk->coord, chunk->version);
+                        chunk->dirty = false;
+                        // raycasts still want the cpu side mips
+                        if (chunk->mips_version != chunk->version)
+                                chunk_build_mips(chunk);
+                        uploaded++;
+                }
+                first += count;
+        }
+        return uploaded;
+}
+
+
+int upload_dirty_chunks(UploadWorker* worker, World* world)
+{
+        // world thread only, an evicted chunk is unpacked here (see chunk_cache.h)
+        static uint8_t scratch[CHUNK_VOLUME];
+        int queued = 0;
+        for (int i = 0 ; i < world_chunk_count(world) ; i++)
+        {
+                Chunk* chunk = world->chunks[i];
+                if (chunk == NULL || !chunk->dirty)
+                        continue;
+                const uint8_t* material = chunk_material_read(chunk, scratch);
+
+                DirtyBox box = chunk->dirty_box;
+                glm::ivec3 size = box.max - box.min;
+
+                UploadJob* job = (UploadJob*) calloc(1, sizeof(UploadJob));
+                job->chunk = i;
+                job->version = chunk->version;
+                job->offset = chunk->coord*CHUNK_SIZE + box.min;
+                job->size = size;
+
+                // pack the dirty box so the worker never touches live chunk memory
+                job->texels = (uint8_t*) malloc((size_t)size.x*size.y*size.z);
+                uint8_t* out = job->texels;
+                for (int z = box.min.z ; z < box.max.z ; z++)
+                for (int y = box.min.y ; y < box.max.y ; y++)
+                {
+                        memcpy(out, &material[chunk_voxel_index(box.min.x,y,z)], size.x);
+                        out += size.x;
+                }
+
+                // columns are x + z*CHUNK_SIZE so whole rows of z are contiguous
+                int first_column = chunk_column_index(0, box.min.z);
+                int column_count = (box.max.z-box.min.z)*CHUNK_SIZE;
+                job->occupancy_offset = ((size_t)i*CHUNK_COLUMNS + first_column)*sizeof(uint64_t);
+                job->occupancy_size = column_count*sizeof(uint64_t);
+                job->occupancy = (uint64_t*) malloc(job->occupancy_size);
+                memcpy(job->occupancy, &chunk->occupancy[first_column], job->occupancy_size);
+
+                // a transpose covers a whole 64x64 block so slabs are always repacked for the full chunk
+                job->coord = chunk->coord;
+                job->slabs = (uint32_t*) malloc(UPLOAD_SLAB_BYTES);
+                for (int axis = 0 ; axis < 3 ; axis++)
+                        bitslab_pack_chunk(chunk->occupancy, axis, job->slabs + axis*BITSLAB_CHUNK_TEXELS);
+
+                if (chunk->mips_version != chunk->version)
+                {
+                        lod_build_mips(chunk->occupancy, material, chunk->occupancy_mips, chunk->material_mips);
+                        chunk->mips_version = chunk->version;
+                }
+                job->mips = (uint8_t*) malloc(CHUNK_MIP_BYTES);
+                memcpy(job->mips, chunk->material_mips, CHUNK_MIP_BYTES);
+
+                chunk->dirty = false;
+                upload_worker_submit(worker, job);
+                queued++;
+        }
+        return queued;
+}
+
+
+int upload_worker_collect(UploadWorker* worker)
+{
+        std::vector<UploadJob*> ready;
+        {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                for (size_t i = 0 ; i < worker->in_flight.size() ; )
+                {
+                        UploadJob* job = worker->in_flight[i];
+                        // a gpu side wait, the cpu goes on. the worker flushed the fence before listing the job
+                        if (!job->waited)
+                        {
+                                glWaitSync(job->fence, 0, GL_TIMEOUT_IGNORED);
+                                job->waited = true;
+                        }
+                        GLenum status = glClientWaitSync(job->fence, 0, 0);
+                        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+                        {
+                                ready.push_back(job);
+                                worker->in_flight[i] = worker->in_flight.back();
+                                worker->in_flight.pop_back();
+                        }
+                        else
+                                i++;
+                }
+        }
+
+        // changes made by another context are only guaranteed visible once their fence has been waited on
+        // and the object is bound again in this one
+        if (!ready.empty())
+        {
+                for (int axis = 0 ; axis < 3 ; axis++)
+                {
+                        glBindTexture(GL_TEXTURE_2D, worker->targets.slab_textures[axis]);
+                        glBindTexture(GL_TEXTURE_2D, 0);
+                }
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, worker->targets.occupancy_buffer);
+                glBindTexture(GL_TEXTURE_3D, worker->targets.texture);
+        }
+
+        for (UploadJob* job : ready)
+        {
+                if (job->version > worker->resident_version[job->chunk])
+                        worker->resident_version[job->chunk] = job->version;
+                if (job->staged)
+                        upload_stage_release(worker, job->stage_slot);
+                glDeleteSync(job->fence);
+                free(job);
+        }
+        worker->completed += ready.size();
+        return ready.size();
+}
+
+
+void upload_worker_metrics(UploadWorker* worker, UploadMetrics* metrics)
+{
+        metrics->queue_depth = worker->queue_depth;
+        {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                metrics->in_flight = worker->in_flight.size();
+        }
+        metrics->bytes_per_frame = worker->bytes_uploaded.exchange(0);
+        metrics->completed_per_frame = worker->completed;
+        worker->completed = 0;
+}
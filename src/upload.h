@@ -0,0 +1,143 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bitslab.h"
+#include "chunk.h"
+#include "chunk_image.h"
+#include "lod.h"
+#include "region_reader.h"
+
+// number of staging buffers cycled by the worker, each holds one full chunk of texels plus its bit slabs and mips
+#define UPLOAD_PBO_COUNT 4
+#define UPLOAD_SLAB_BYTES CHUNK_IMAGE_SLAB_BYTES
+#define UPLOAD_PBO_SIZE (CHUNK_VOLUME + UPLOAD_SLAB_BYTES + CHUNK_MIP_BYTES + 32)
+// chunk images the persistently mapped staging buffer holds, see upload_stage_acquire
+#define UPLOAD_STAGE_SLOTS 16
+
+typedef struct UploadJob
+{
+        int chunk;
+        unsigned int version;
+
+        // region of the voxel texture, in texels. texels is packed x fastest
+        glm::ivec3 offset, size;
+        uint8_t* texels;
+
+        // byte range of the occupancy buffer
+        size_t occupancy_offset, occupancy_size;
+        uint64_t* occupancy;
+
+        // whole chunk bit slab blocks, axis after axis, see bitslab.h
+        glm::ivec3 coord;
+        uint32_t* slabs;
+
+        // whole chunk material mips, levels 1.. of the voxel texture
+        uint8_t* mips;
+
+        // the whole chunk is a chunk image already sitting in stage_slot of the persistent staging
+        // buffer, the pointers above are all NULL
+        bool staged;
+        int stage_slot;
+
+        // signalled once the upload has landed, owned by the render thread after that
+        GLsync fence;
+        // the render context has queued a glWaitSync on fence
+        bool waited;
+}UploadJob;
+
+typedef struct UploadMetrics
+{
+        int queue_depth;
+        int in_flight;
+        size_t bytes_per_frame;
+        int completed_per_frame;
+}UploadMetrics;
+
+// gpu objects the worker writes into, all created by the render context.
+// the render context keeps occupancy_buffer on shader storage binding 0
+typedef struct UploadTargets
+{
+        unsigned int texture, occupancy_buffer;
+        unsigned int slab_textures[3];
+        // in voxels
+        glm::ivec3 world_size;
+}UploadTargets;
+
+// owns a hidden window whose context is shared with the render context,
+// all texture/buffer writes for chunk updates happen on its thread
+typedef struct UploadWorker
+{
+        GLFWwindow* context;
+        // current on the thread that called upload_worker_init, the only one that may collect
+        GLFWwindow* render_context;
+        UploadTargets targets;
+
+        unsigned int pbo[UPLOAD_PBO_COUNT];
+        GLsync pbo_fence[UPLOAD_PBO_COUNT];
+        int next_pbo;
+
+        // persistently mapped and coherent, so any thread can fill a slot without a context and the
+        // texture updates read it in place. NULL without buffer storage. free slots are guarded by mutex,
+        // a slot comes back once the upload reading it has signalled
+        unsigned int stage_buffer;
+        uint8_t* stage;
+        std::vector<int> stage_free;
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<UploadJob*> pending;
+        std::vector<UploadJob*> in_flight;
+        bool running;
+
+        std::atomic<int> queue_depth;
+        std::atomic<size_t> bytes_uploaded;
+        int completed;
+
+        // render thread only, the chunk version every chunk (world index) has on the gpu as of the last collect
+        std::vector<unsigned int> resident_version;
+}UploadWorker;
+
+
+// must be called from the thread owning the render context (glfw window creation rule)
+int upload_worker_init(UploadWorker* worker, GLFWwindow* share, UploadTargets targets);
+void upload_worker_destroy(UploadWorker* worker);
+
+void upload_worker_submit(UploadWorker* worker, UploadJob* job);
+
+// packs the dirty region of every dirty chunk (plus its bit slabs and rebuilt mips) into a job, returns the number of jobs queued
+int upload_dirty_chunks(UploadWorker* worker, World* world);
+
+// any thread: a free slot of the persistent staging buffer to write a chunk image into, NULL when every
+// slot is still in flight
+uint8_t* upload_stage_acquire(UploadWorker* worker, int* slot);
+// hands back a slot that wasn't filled after all
+void upload_stage_release(UploadWorker* worker, int slot);
+// queues the image in slot as the whole of chunk (world index), uploaded from where it is
+void upload_stage_submit(UploadWorker* worker, int slot, int chunk, glm::ivec3 coord, unsigned int version);
+
+// render thread, before the world is handed to the world thread: of the dirty chunks listed, those stored
+// as images in the region files of reader are read from disk straight into the staging buffer and uploaded
+// from there, and are clean afterwards. only list chunks the world holds as loaded from the regions.
+// collects uploads while it waits for a free slot, so it does nothing (returns 0) without the render
+// context current. returns how many went that way, the rest stay dirty for the usual path
+int upload_region_images(UploadWorker* worker, RegionReader* reader, World* world, const std::vector<int>& chunks);
+
+// render thread, before drawing: has the render context wait on the fence of every upload issued so far,
+// so no draw after this reads a chunk the worker is still writing. jobs whose fence has signalled are
+// swapped in and the targets bound again, which is what makes another context's writes visible here
+// (the texture unit and the GL_TEXTURE_3D/2D bindings end up on targets.texture and 0).
+// returns the number swapped in
+int upload_worker_collect(UploadWorker* worker);
+
+// fills metrics and resets the per frame counters
+void upload_worker_metrics(UploadWorker* worker, UploadMetrics* metrics);